@@ -1,11 +1,21 @@
+#include <cstddef>
+#include <cstring>
+#include <esp_attr.h>
 #include <esp_log.h>
+#include <esp_rom_crc.h>
+#include <esp_timer.h>
 
 #include "air_sensor.hpp"
+#include "event_trace.hpp"
+#include "live_status.hpp"
+
+RTC_NOINIT_ATTR air_sensor::history_checkpoint air_sensor::rtc_checkpoint;
 
 esp_err_t air_sensor::init()
 {
     esp_err_t ret = temp_sensor.init(misty::TS_DRDY_PIN, misty::I2C_SDA_PIN, misty::I2C_SCL_PIN);
     ret = ret ?: temp_sensor.reset();
+    ret = ret ?: temp_sensor.probe();
     if (ret != ESP_OK) {
         ESP_LOGW(TAG, "init: can't init temperature sensor: 0x%x", ret);
         return ret;
@@ -16,7 +26,7 @@ esp_err_t air_sensor::init()
         humid_slots[idx] = -1; // RH is % so it can't be negative anyway
     }
 
-    measure_timer = xTimerCreate("air_sense", pdMS_TO_TICKS(MEAS_WINDOW_INTERVAL_MINUTE * 60000UL), pdTRUE, this, sense_timer_cb);
+    measure_timer = xTimerCreate("air_sense", pdMS_TO_TICKS(MEASURE_INTERVAL_MINUTE * 60000UL), pdTRUE, this, sense_timer_cb);
     if (measure_timer == nullptr) {
         ESP_LOGE(TAG, "Failed to create air sensor timer");
         return ESP_ERR_NO_MEM;
@@ -28,6 +38,32 @@ esp_err_t air_sensor::init()
         return ESP_ERR_NO_MEM;
     }
 
+    if (nvs_open(NVS_NAMESPACE, NVS_READWRITE, &nvs) != ESP_OK) {
+        ESP_LOGW(TAG, "init: can't open NVS, history won't survive power loss");
+        nvs = 0;
+    }
+
+    // RTC memory is the freshest copy, NVS is the fallback after a power loss
+    const history_checkpoint *checkpoint = &rtc_checkpoint;
+    ret = restore_checkpoint(rtc_checkpoint, "RTC");
+    if (ret != ESP_OK && ret != ESP_ERR_INVALID_STATE && nvs != 0) {
+        size_t len = sizeof(pending_checkpoint);
+        if (nvs_get_blob(nvs, NVS_HISTORY_KEY, &pending_checkpoint, &len) == ESP_OK && len == sizeof(pending_checkpoint)) {
+            checkpoint = &pending_checkpoint;
+            ret = restore_checkpoint(pending_checkpoint, "NVS");
+        }
+    }
+
+    if (ret == ESP_ERR_INVALID_STATE) {
+        // Try again on each reading until SNTP or the config page sets the clock
+        if (checkpoint != &pending_checkpoint) {
+            pending_checkpoint = *checkpoint;
+        }
+
+        restore_pending = true;
+        ESP_LOGI(TAG, "init: clock not set yet, history restore deferred");
+    }
+
     if (xTaskCreate(sense_process_task, "air_sense_tsk", 4096, this, tskIDLE_PRIORITY + 3, nullptr) == pdFAIL) {
         ESP_LOGE(TAG, "Failed to create air sensor task");
         return ESP_ERR_NO_MEM;
@@ -53,16 +89,29 @@ esp_err_t air_sensor::sense()
         return ret;
     }
 
+    if (restore_pending && time(nullptr) >= MIN_VALID_TIME) {
+        restore_pending = false;
+        restore_checkpoint(pending_checkpoint, "deferred");
+    }
+
+    latest_temperature_sample = temperature;
+    latest_humidity_sample = humidity;
+    latest_sample_uptime_sec = (uint32_t)(esp_timer_get_time() / 1000000) + 1; // +1 so a sample right at boot isn't 0
+
     temp_accumulator += temperature;
     humid_accumulator += humidity;
     accumulated_reading_cnt += 1;
+    event_trace::instance().add(event_trace::TRACE_SENSE_SAMPLE, accumulated_reading_cnt, to_centi(temperature), to_centi(humidity));
 
     if (accumulated_reading_cnt >= MEAS_ACCUM_COUNT) {
-        ESP_LOGW(TAG, "sense: Write average value to slot %d", (int)history_slot_idx);
         humid_slots[history_slot_idx] = (humid_accumulator / (float)accumulated_reading_cnt);
         temp_slots[history_slot_idx] = (temp_accumulator / (float)accumulated_reading_cnt);
+        event_trace::instance().add(event_trace::TRACE_SENSE_SLOT_COMMIT, history_slot_idx,
+            to_centi(temp_slots[history_slot_idx]), to_centi(humid_slots[history_slot_idx]));
 
         history_slot_idx += 1;
+        const time_t now = time(nullptr);
+        last_commit_at = now >= MIN_VALID_TIME ? now : 0;
 
         if (history_slot_idx >= MEAS_SLOTS) {
             history_slot_idx = 0;
@@ -71,8 +120,18 @@ esp_err_t air_sensor::sense()
         accumulated_reading_cnt = 0;
         temp_accumulator = 0;
         humid_accumulator = 0;
+
+        // Once a fresh slot is in, an old checkpoint can't be lined up with it anymore
+        restore_pending = false;
+        save_checkpoint();
     }
 
+    update_average();
+    return ESP_OK;
+}
+
+void air_sensor::update_average()
+{
     float temperature_sum = 0, humidity_sum = 0;
     size_t valid_count = 0;
 
@@ -86,6 +145,8 @@ esp_err_t air_sensor::sense()
         }
     }
 
+    valid_slots_count = valid_count;
+
     // Include the current partial accumulation in the average if it exists
     if (accumulated_reading_cnt > 0) {
         temperature_sum += (temp_accumulator / (float)accumulated_reading_cnt);
@@ -97,12 +158,98 @@ esp_err_t air_sensor::sense()
         latest_humidity_avg = humidity_sum / (float)valid_count;
         latest_temperature_avg = temperature_sum / (float)valid_count;
         xEventGroupSetBits(measure_evt, HAS_VALID_DATA);
+
+        const live_status::air_state state = {
+            .temperature = latest_temperature_avg.load(),
+            .humidity = latest_humidity_avg.load(),
+            .valid_slots = (uint16_t)valid_slots_count.load(),
+        };
+        live_status::post(live_status::STATUS_AIR, &state, sizeof(state));
+    }
+
+    event_trace::instance().add(event_trace::TRACE_SENSE_AVERAGE, valid_count,
+        to_centi(latest_temperature_avg.load()), to_centi(latest_humidity_avg.load()));
+}
+
+void air_sensor::save_checkpoint()
+{
+    rtc_checkpoint.magic = CHECKPOINT_MAGIC;
+    rtc_checkpoint.version = CHECKPOINT_VERSION;
+    rtc_checkpoint.slot_count = MEAS_SLOTS;
+    rtc_checkpoint.saved_at = time(nullptr);
+    rtc_checkpoint.history_slot_idx = history_slot_idx;
+    memcpy(rtc_checkpoint.temp_slots, temp_slots, sizeof(temp_slots));
+    memcpy(rtc_checkpoint.humid_slots, humid_slots, sizeof(humid_slots));
+    rtc_checkpoint.crc = checkpoint_crc(rtc_checkpoint);
+
+    slots_since_nvs_checkpoint += 1;
+    if (nvs == 0 || slots_since_nvs_checkpoint < NVS_CHECKPOINT_SLOTS || rtc_checkpoint.saved_at < MIN_VALID_TIME) {
+        return;
+    }
+
+    esp_err_t ret = nvs_set_blob(nvs, NVS_HISTORY_KEY, &rtc_checkpoint, sizeof(rtc_checkpoint));
+    ret = ret ?: nvs_commit(nvs);
+    if (ret != ESP_OK) {
+        ESP_LOGW(TAG, "checkpoint: can't write NVS: 0x%x", ret);
+        return;
     }
 
-    ESP_LOGI(TAG, "sense: avg temp=%.3f, humid=%.3f", latest_temperature_avg.load(), latest_humidity_avg.load());
+    slots_since_nvs_checkpoint = 0;
+}
+
+esp_err_t air_sensor::restore_checkpoint(const history_checkpoint& checkpoint, const char* source)
+{
+    if (checkpoint.magic != CHECKPOINT_MAGIC || checkpoint.version != CHECKPOINT_VERSION
+        || checkpoint.slot_count != MEAS_SLOTS || checkpoint.history_slot_idx >= MEAS_SLOTS) {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    if (checkpoint.crc != checkpoint_crc(checkpoint)) {
+        ESP_LOGW(TAG, "restore: %s checkpoint CRC mismatch", source);
+        return ESP_ERR_INVALID_CRC;
+    }
+
+    // Without a wall clock on either side there's no telling how old it is
+    const time_t now = time(nullptr);
+    if (now < MIN_VALID_TIME) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    const int64_t age = (int64_t)now - checkpoint.saved_at;
+    if (checkpoint.saved_at < MIN_VALID_TIME || age < 0 || age >= (int64_t)(MEAS_WINDOW_HOURS * 3600)) {
+        ESP_LOGI(TAG, "restore: %s checkpoint is stale, age %lld sec", source, age);
+        return ESP_ERR_TIMEOUT;
+    }
+
+    memcpy(temp_slots, checkpoint.temp_slots, sizeof(temp_slots));
+    memcpy(humid_slots, checkpoint.humid_slots, sizeof(humid_slots));
+    history_slot_idx = checkpoint.history_slot_idx;
+
+    // Slots that would have been written while we were down are gone, so they shouldn't count towards the average
+    const size_t missed_slots = age / SLOT_PERIOD_SEC;
+    for (size_t cnt = 0; cnt < missed_slots; cnt += 1) {
+        temp_slots[history_slot_idx] = -300;
+        humid_slots[history_slot_idx] = -1;
+        history_slot_idx = (history_slot_idx + 1) % MEAS_SLOTS;
+    }
+
+    last_commit_at = checkpoint.saved_at + (time_t)(missed_slots * SLOT_PERIOD_SEC);
+    update_average();
+    event_trace::instance().add(event_trace::TRACE_SENSE_RESTORED, valid_slots_count, (uint32_t)age, missed_slots);
+    ESP_LOGI(TAG, "restore: %u slots from %s checkpoint, age %lld sec", valid_slots_count.load(), source, age);
     return ESP_OK;
 }
 
+uint32_t air_sensor::checkpoint_crc(const history_checkpoint& checkpoint)
+{
+    return esp_rom_crc32_le(0, (const uint8_t *)&checkpoint, offsetof(history_checkpoint, crc));
+}
+
+uint32_t air_sensor::to_centi(float val)
+{
+    return (uint32_t)(int32_t)(val * 100.0f);
+}
+
 bool air_sensor::has_valid_reading() const
 {
     if (measure_evt == nullptr) {
@@ -122,6 +269,50 @@ float air_sensor::average_humidity() const
     return latest_humidity_avg;
 }
 
+float air_sensor::latest_temperature() const
+{
+    return latest_temperature_sample;
+}
+
+float air_sensor::latest_humidity() const
+{
+    return latest_humidity_sample;
+}
+
+uint32_t air_sensor::latest_sample_age_sec() const
+{
+    const uint32_t sampled_at = latest_sample_uptime_sec;
+    if (sampled_at == 0) {
+        return UINT32_MAX;
+    }
+
+    return (uint32_t)(esp_timer_get_time() / 1000000) + 1 - sampled_at;
+}
+
+size_t air_sensor::history_slots_valid() const
+{
+    return valid_slots_count;
+}
+
+size_t air_sensor::history_oldest_idx() const
+{
+    // The next slot to be written is the one that's been sitting there the longest
+    return history_slot_idx;
+}
+
+time_t air_sensor::history_end_time() const
+{
+    return last_commit_at;
+}
+
+bool air_sensor::history_slot(size_t oldest_idx, size_t pos, float& temp_out, float& humid_out) const
+{
+    const size_t idx = (oldest_idx + pos) % MEAS_SLOTS;
+    temp_out = temp_slots[idx];
+    humid_out = humid_slots[idx];
+    return temp_out > -273.0f && humid_out >= 0;
+}
+
 void air_sensor::sense_timer_cb(TimerHandle_t timer)
 {
     auto *ctx = (air_sensor *)pvTimerGetTimerID(timer);
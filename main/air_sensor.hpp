@@ -1,7 +1,9 @@
 #pragma once
 
 #include <atomic>
+#include <ctime>
 #include <esp_err.h>
+#include <nvs.h>
 #include <freertos/FreeRTOS.h>
 #include <freertos/timers.h>
 #include <freertos/event_groups.h>
@@ -29,17 +31,70 @@ private:
     static constexpr size_t MEAS_ACCUM_COUNT = 5; // Every MEAS_WINDOW_INTERVAL_MINUTE measure MEAS_ACCUM_COUNT times
     static constexpr size_t MEASURE_INTERVAL_MINUTE = MEAS_WINDOW_INTERVAL_MINUTE / MEAS_ACCUM_COUNT;
     static constexpr size_t MEAS_SLOTS = (MEAS_WINDOW_HOURS * 60) / MEAS_WINDOW_INTERVAL_MINUTE;
+    static constexpr time_t SLOT_PERIOD_SEC = MEAS_WINDOW_INTERVAL_MINUTE * 60;
+    static constexpr size_t NVS_CHECKPOINT_SLOTS = 6; // RTC memory gets every slot, NVS only every 3 hours to spare the flash
+    static constexpr uint32_t CHECKPOINT_MAGIC = 0x48534d41; // "AMSH"
+    static constexpr uint16_t CHECKPOINT_VERSION = 1;
+    static constexpr time_t MIN_VALID_TIME = 1704067200; // 2024-01-01, anything earlier means the clock was never set
+    static constexpr char NVS_NAMESPACE[] = "air";
+    static constexpr char NVS_HISTORY_KEY[] = "history";
     static constexpr char TAG[] = "air_sensor";
 
+    struct history_checkpoint
+    {
+        uint32_t magic;
+        uint16_t version;
+        uint16_t slot_count;
+        int64_t saved_at; // UNIX time in seconds
+        uint32_t history_slot_idx;
+        float temp_slots[MEAS_SLOTS];
+        float humid_slots[MEAS_SLOTS];
+        uint32_t crc; // Over everything above
+    };
 
 public:
     esp_err_t init();
     bool has_valid_reading() const;
     [[nodiscard]] float average_temperature() const;
     [[nodiscard]] float average_humidity() const;
+    [[nodiscard]] float latest_temperature() const;
+    [[nodiscard]] float latest_humidity() const;
+    [[nodiscard]] uint32_t latest_sample_age_sec() const; // UINT32_MAX if nothing was sampled yet
+    [[nodiscard]] size_t history_slots_valid() const;
+    static constexpr size_t history_slot_count() { return MEAS_SLOTS; }
+    static constexpr uint32_t history_slot_period_sec() { return SLOT_PERIOD_SEC; }
+
+    // Binary layout of GET /api/history?format=bin, all little endian
+    struct __attribute__((packed)) history_dump_header
+    {
+        uint32_t magic;
+        uint8_t version;
+        uint8_t slot_count;
+        uint16_t slot_period_sec;
+        uint32_t end_time; // UNIX time the newest slot was committed, 0 if unknown
+    };
+
+    struct __attribute__((packed)) history_dump_slot
+    {
+        int16_t temp_centi; // INT16_MIN if the slot has no data
+        uint16_t humid_centi; // UINT16_MAX if the slot has no data
+    };
+
+    static constexpr uint32_t HISTORY_DUMP_MAGIC = 0x5453484d; // "MHST"
+    static constexpr uint8_t HISTORY_DUMP_VERSION = 1;
+
+    // Time ordered view of the ring: pos 0 is the oldest slot, history_slot_count() - 1 the newest completed one
+    [[nodiscard]] size_t history_oldest_idx() const;
+    [[nodiscard]] time_t history_end_time() const; // When the newest slot was committed, 0 if the clock wasn't set
+    bool history_slot(size_t oldest_idx, size_t pos, float &temp_out, float &humid_out) const;
 
 private:
     esp_err_t sense();
+    void update_average();
+    void save_checkpoint();
+    esp_err_t restore_checkpoint(const history_checkpoint &checkpoint, const char *source);
+    static uint32_t checkpoint_crc(const history_checkpoint &checkpoint);
+    static uint32_t to_centi(float val); // For trace records, which only carry integers
     static void sense_timer_cb(TimerHandle_t timer);
     static void sense_process_task(void *_ctx);
 
@@ -60,16 +115,24 @@ private:
     // One-hour accumulator
     uint8_t accumulated_reading_cnt = 0;
     size_t history_slot_idx = 0;
-    size_t valid_slots_count = 0;
+    std::atomic<size_t> valid_slots_count = 0; // Read by the status endpoint
     float temp_accumulator = 0;
     float humid_accumulator = 0;
     TimerHandle_t measure_timer = nullptr;
     EventGroupHandle_t measure_evt = nullptr;
     std::atomic<float> latest_temperature_avg = 0;
     std::atomic<float> latest_humidity_avg = 0;
+    std::atomic<float> latest_temperature_sample = 0;
+    std::atomic<float> latest_humidity_sample = 0;
+    std::atomic<uint32_t> latest_sample_uptime_sec = 0; // 0 until the first sample
     float temp_slots[MEAS_SLOTS] = {};
     float humid_slots[MEAS_SLOTS] = {};
-
+    size_t slots_since_nvs_checkpoint = 0;
+    time_t last_commit_at = 0;
+    nvs_handle_t nvs = 0;
+    bool restore_pending = false; // Checkpoint found at boot but the clock wasn't set yet to tell its age
+    history_checkpoint pending_checkpoint = {};
+    static history_checkpoint rtc_checkpoint; // Survives soft resets (including OTA reboots) and deep sleep
 
     hdc2080 temp_sensor = hdc2080();
 };
@@ -0,0 +1,142 @@
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <iterator>
+#include <esp_http_server.h>
+
+#include "api_schema.hpp"
+#include "pump_manager.hpp"
+
+namespace api_schema
+{
+    static bool is_dow_schedule(const void *obj)
+    {
+        return ((const schedule_doc *)obj)->entry.schedule_type == ESP_SCHEDULE_TYPE_DAYS_OF_WEEK;
+    }
+
+    static bool is_sun_schedule(const void *obj)
+    {
+        return !is_dow_schedule(obj);
+    }
+
+    // Query values arrive as whatever the client typed, so anything cut off, trailing or out of range is rejected whole
+    static bool query_long(const char *query, const char *key, long min, long max, long &out)
+    {
+        char val[16] = { 0 };
+        if (httpd_query_key_value(query, key, val, sizeof(val)) != ESP_OK || val[0] == '\0') {
+            return false;
+        }
+
+        char *end = nullptr;
+        errno = 0;
+        out = strtol(val, &end, 10);
+        return errno == 0 && *end == '\0' && out >= min && out <= max;
+    }
+
+    static constexpr json_schema::alias SCHEDULE_TYPE_NAMES[] = {
+        { "dow", ESP_SCHEDULE_TYPE_DAYS_OF_WEEK },
+        { "sunrise", ESP_SCHEDULE_TYPE_SUNRISE },
+        { "sunset", ESP_SCHEDULE_TYPE_SUNSET },
+    };
+
+    constexpr json_schema::field SCHEDULE_FIELDS[] = {
+        { .key = "name", .type = json_schema::TYPE_STRING, .size = sizeof(schedule_doc::name),
+            .offset = offsetof(schedule_doc, name), .min = 1, .required = true },
+        { .key = "pump", .type = json_schema::TYPE_UINT, .size = sizeof(sched_manager::pump_bits),
+            .offset = offsetof(schedule_doc, entry.select_pumps), .min = 1, .max = sched_manager::PUMP_ALL, .required = true },
+        { .key = "dow", .type = json_schema::TYPE_UINT, .size = sizeof(uint8_t),
+            .offset = offsetof(schedule_doc, entry.day_of_week), .min = 1, .max = 0x7f, .required = true },
+        { .key = "h", .type = json_schema::TYPE_UINT, .size = sizeof(uint8_t),
+            .offset = offsetof(schedule_doc, entry.dow.hour), .min = 0, .max = 23, .required = true, .present = is_dow_schedule },
+        { .key = "m", .type = json_schema::TYPE_UINT, .size = sizeof(uint8_t),
+            .offset = offsetof(schedule_doc, entry.dow.minute), .min = 0, .max = 59, .required = true, .present = is_dow_schedule },
+        { .key = "offset", .type = json_schema::TYPE_INT, .size = sizeof(int16_t),
+            .offset = offsetof(schedule_doc, entry.offset_minute), .min = INT16_MIN, .max = INT16_MAX, .required = true, .present = is_sun_schedule },
+        { .key = "duration", .type = json_schema::TYPE_UINT, .size = sizeof(uint32_t), .count = sched_manager::PROFILE_COUNT,
+            .offset = offsetof(schedule_doc, entry.duration_ms), .min = 0, .max = UINT32_MAX, .required = true },
+        { .key = "type", .type = json_schema::TYPE_UINT, .size = sizeof(esp_schedule_type_t),
+            .offset = offsetof(schedule_doc, entry.schedule_type), .min = 0, .max = 31,
+            .allowed = BIT(ESP_SCHEDULE_TYPE_DAYS_OF_WEEK) | BIT(ESP_SCHEDULE_TYPE_SUNRISE) | BIT(ESP_SCHEDULE_TYPE_SUNSET),
+            .required = true, .aliases = SCHEDULE_TYPE_NAMES, .alias_cnt = std::size(SCHEDULE_TYPE_NAMES) },
+    };
+
+    constexpr size_t SCHEDULE_FIELD_CNT = std::size(SCHEDULE_FIELDS);
+
+    constexpr json_schema::field PUMP_RUN_FIELDS[] = {
+        { .key = "pump", .type = json_schema::TYPE_UINT, .size = sizeof(uint8_t),
+            .offset = offsetof(pump_run_doc, pump), .min = 1, .max = sched_manager::PUMP_ALL, .required = true },
+        { .key = "duration", .type = json_schema::TYPE_UINT, .size = sizeof(uint32_t),
+            .offset = offsetof(pump_run_doc, duration_ms), .min = 0, .max = pump_manager::RUN_MAX_MS, .required = true },
+        { .key = "duty", .type = json_schema::TYPE_UINT, .size = sizeof(uint8_t),
+            .offset = offsetof(pump_run_doc, duty), .min = 1, .max = pump_manager::DUTY_MAX },
+    };
+
+    constexpr size_t PUMP_RUN_FIELD_CNT = std::size(PUMP_RUN_FIELDS);
+
+    const char *parse_schedule_query(const char *query, schedule_doc &doc)
+    {
+        // Get the type first
+        char val[16] = { 0 };
+        if (httpd_query_key_value(query, "type", val, sizeof(val)) != ESP_OK) {
+            return "Can't parse schedule type";
+        }
+
+        auto &entry = doc.entry;
+        if (strncmp("sunrise", val, sizeof(val)) == 0) {
+            entry.schedule_type = ESP_SCHEDULE_TYPE_SUNRISE;
+        } else if (strncmp("sunset", val, sizeof(val)) == 0) {
+            entry.schedule_type = ESP_SCHEDULE_TYPE_SUNSET;
+        } else if (strncmp("dow", val, sizeof(val)) == 0) {
+            entry.schedule_type = ESP_SCHEDULE_TYPE_DAYS_OF_WEEK;
+        } else {
+            return "Invalid schedule type";
+        }
+
+        long num = 0;
+        if (!query_long(query, "pump", 1, sched_manager::PUMP_ALL, num)) {
+            return "Invalid pump selection";
+        }
+
+        entry.select_pumps = (sched_manager::pump_bits)num;
+
+        if (!query_long(query, "dow", 1, 0x7f, num)) {
+            return "Invalid day of week selection";
+        }
+
+        entry.day_of_week = (uint8_t)num;
+
+        if (entry.schedule_type == ESP_SCHEDULE_TYPE_DAYS_OF_WEEK) {
+            if (!query_long(query, "hour", 0, 23, num)) {
+                return "Invalid DoW hour";
+            }
+
+            entry.dow.hour = (uint8_t)num;
+
+            if (!query_long(query, "min", 0, 59, num)) {
+                return "Invalid DoW minute";
+            }
+
+            entry.dow.minute = (uint8_t)num;
+        } else {
+            if (!query_long(query, "off", -sched_manager::MAX_SUN_OFFSET_MIN, sched_manager::MAX_SUN_OFFSET_MIN, num)) {
+                return "Invalid offset";
+            }
+
+            entry.offset_minute = (int16_t)num;
+        }
+
+        static constexpr const char *DURATION_KEYS[] = { "durd", "durm", "durw" };
+        for (size_t idx = 0; idx < std::size(DURATION_KEYS); idx += 1) {
+            if (!query_long(query, DURATION_KEYS[idx], 0, INT32_MAX, num)) {
+                return "Invalid duration";
+            }
+
+            entry.duration_ms[idx] = (uint32_t)num;
+        }
+
+        memset(doc.name, 0, sizeof(doc.name));
+        httpd_query_key_value(query, "name", doc.name, sizeof(doc.name)); // A missing or cut off name fails validation later
+        doc.name[sizeof(doc.name) - 1] = '\0';
+        return nullptr;
+    }
+}
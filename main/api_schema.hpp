@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "json_schema.hpp"
+#include "sched_manager.hpp"
+
+// Request body shapes of the API, kept out of config_server so they build without esp_http_server's request API (see test/host)
+namespace api_schema
+{
+    // What a schedule looks like over the API, the name lives in the NVS key rather than in the entry
+    using schedule_doc = sched_manager::named_entry;
+
+    // Body of POST /api/pump, a duration of 0 stops the selected pumps instead
+    struct pump_run_doc
+    {
+        uint8_t pump;
+        uint32_t duration_ms;
+        uint8_t duty;
+    };
+
+    // Field order is the output order of GET /api/schedule?name=
+    extern const json_schema::field SCHEDULE_FIELDS[];
+    extern const size_t SCHEDULE_FIELD_CNT;
+
+    extern const json_schema::field PUMP_RUN_FIELDS[];
+    extern const size_t PUMP_RUN_FIELD_CNT;
+
+    // Query string form of POST /api/schedule, same return convention as json_schema::parse_object()
+    const char *parse_schedule_query(const char *query, schedule_doc &doc);
+}
@@ -0,0 +1,93 @@
+#include <cstdio>
+#include <cstring>
+#include <bootloader_random.h>
+#include <esp_log.h>
+#include <esp_random.h>
+#include <esp_timer.h>
+#include <mbedtls/constant_time.h>
+#include <mbedtls/md.h>
+
+#include "auth_token.hpp"
+
+esp_err_t auth_token::init()
+{
+    nvs_handle_t nvs = 0;
+    esp_err_t ret = nvs_open(NVS_NAMESPACE, NVS_READWRITE, &nvs);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "init: can't open NVS: 0x%x", ret);
+        return ret;
+    }
+
+    size_t len = sizeof(token);
+    ret = nvs_get_blob(nvs, NVS_TOKEN_KEY, token, &len);
+    if (ret == ESP_ERR_NVS_NOT_FOUND || (ret == ESP_OK && len != sizeof(token))) {
+        // First boot (or after a factory reset), the RF subsystem isn't up yet so turn on the entropy source by hand
+        bootloader_random_enable();
+        esp_fill_random(token, sizeof(token));
+        bootloader_random_disable();
+
+        ret = nvs_set_blob(nvs, NVS_TOKEN_KEY, token, sizeof(token));
+        ret = ret ?: nvs_commit(nvs);
+        ESP_LOGI(TAG, "init: new pairing token generated");
+    }
+
+    nvs_close(nvs);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "init: can't load token: 0x%x", ret);
+        return ret;
+    }
+
+    for (size_t idx = 0; idx < sizeof(token); idx += 1) {
+        snprintf(token_hex + idx * 2, 3, "%02x", token[idx]);
+    }
+
+    return derive_ap_password();
+}
+
+bool auth_token::check(const char *hex) const
+{
+    // Covers the terminator too, so a prefix of the token doesn't pass; no early exit on the first mismatch
+    return mbedtls_ct_memcmp(hex, token_hex, sizeof(token_hex)) == 0;
+}
+
+void auth_token::open_pairing()
+{
+    pair_deadline_us = esp_timer_get_time() + PAIR_WINDOW_MS * 1000LL;
+    ESP_LOGI(TAG, "open_pairing: window open for %lu s", PAIR_WINDOW_MS / 1000);
+}
+
+bool auth_token::take_pairing(char *out, size_t out_len)
+{
+    int64_t deadline = pair_deadline_us.load();
+    if (out_len <= TOKEN_HEX_LEN || deadline == 0 || esp_timer_get_time() > deadline) {
+        return false;
+    }
+
+    // Only the first client wins if two race for the same window
+    if (!pair_deadline_us.compare_exchange_strong(deadline, 0)) {
+        return false;
+    }
+
+    strlcpy(out, token_hex, out_len);
+    return true;
+}
+
+esp_err_t auth_token::derive_ap_password()
+{
+    uint8_t mac[32] = {};
+    const auto *md = mbedtls_md_info_from_type(MBEDTLS_MD_SHA256);
+    int ret = mbedtls_md_hmac(md, token, sizeof(token), (const uint8_t *)AP_PASSWORD_LABEL, strlen(AP_PASSWORD_LABEL), mac);
+    if (ret != 0) {
+        ESP_LOGE(TAG, "derive: HMAC failed: -0x%x", -ret);
+        return ESP_FAIL;
+    }
+
+    // Crockford base32, no i/l/o/u to mix up with digits when typing it in
+    static constexpr char ALPHABET[] = "0123456789abcdefghjkmnpqrstvwxyz";
+    for (size_t idx = 0; idx < AP_PASSWORD_LEN; idx += 1) {
+        ap_pwd[idx] = ALPHABET[mac[idx] & 0x1f];
+    }
+
+    ap_pwd[AP_PASSWORD_LEN] = '\0';
+    return ESP_OK;
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <esp_err.h>
+#include <nvs.h>
+
+// Pairing token for the config API, generated once and kept in NVS until a factory reset
+class auth_token
+{
+public:
+    static auth_token &instance()
+    {
+        static auth_token _instance;
+        return _instance;
+    }
+
+    void operator=(auth_token const &) = delete;
+    auth_token(auth_token const &) = delete;
+
+    static constexpr size_t TOKEN_LEN = 16;
+    static constexpr size_t TOKEN_HEX_LEN = TOKEN_LEN * 2;
+    static constexpr size_t AP_PASSWORD_LEN = 12; // WPA2 wants at least 8
+    static constexpr uint32_t PAIR_WINDOW_MS = 120 * 1000;
+
+    esp_err_t init();
+
+    // hex must point to at least TOKEN_HEX_LEN + 1 readable bytes, zero padded past the terminator
+    bool check(const char *hex) const;
+
+    // Derived from the token, so it changes along with it and never needs storing
+    const char *ap_password() const { return ap_pwd; }
+
+    // A config button press lets exactly one client fetch the token within PAIR_WINDOW_MS
+    void open_pairing();
+    bool take_pairing(char *out, size_t out_len);
+
+private:
+    auth_token() = default;
+    esp_err_t derive_ap_password();
+
+    uint8_t token[TOKEN_LEN] = {};
+    char token_hex[TOKEN_HEX_LEN + 1] = {};
+    char ap_pwd[AP_PASSWORD_LEN + 1] = {};
+    std::atomic<int64_t> pair_deadline_us = 0; // 0 while closed
+
+    static constexpr char NVS_NAMESPACE[] = "auth";
+    static constexpr char NVS_TOKEN_KEY[] = "token";
+    static constexpr char AP_PASSWORD_LABEL[] = "misty-ap";
+    static constexpr char TAG[] = "auth";
+};
@@ -1,19 +1,81 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iterator>
 #include <esp_log.h>
 #include <esp_app_desc.h>
+#include <esp_heap_caps.h>
 #include <esp_wifi.h>
 #include <esp_partition.h>
+#include <esp_rom_crc.h>
+#include <esp_timer.h>
 #include <freertos/FreeRTOS.h>
 #include <freertos/task.h>
 #include <sys/time.h>
 #include "config_server.hpp"
 
+#include "air_sensor.hpp"
+#include "api_schema.hpp"
+#include "auth_token.hpp"
 #include "esp_ota_ops.h"
+#include "event_trace.hpp"
+#include "http_parse.hpp"
+#include "json_schema.hpp"
+#include "live_status.hpp"
 #include "mjson.h"
 #include "net_configurator.hpp"
+#include "ota_manager.hpp"
+#include "pin_defs.hpp"
+#include "power_stats.hpp"
+#include "pump_manager.hpp"
 #include "sched_manager.hpp"
-
-extern const char index_html_start[] asm("_binary_index_html_start");
-extern const char index_html_end[] asm("_binary_index_html_end");
+#include "water_log.hpp"
+
+extern const uint8_t index_html_gz_start[] asm("_binary_index_html_gz_start");
+extern const uint8_t index_html_gz_end[] asm("_binary_index_html_gz_end");
+
+config_server::web_asset config_server::assets[] = {
+    { index_html_gz_start, index_html_gz_end, "text/html", "gzip", {} },
+};
+
+// Everything the server answers to, registered in one pass by init()
+constexpr config_server::route config_server::routes[] = {
+    { .uri = "/", .method = HTTP_GET, .handler = asset_handler, .ctx = &assets[0] },
+    { .uri = "/api/schedule", .method = HTTP_GET, .handler = get_schedule_handler },
+    { .uri = "/api/schedule", .method = HTTP_POST, .handler = add_schedule_handler, .auth = true },
+    { .uri = "/api/schedule", .method = HTTP_PUT, .handler = update_schedule_handler, .auth = true },
+    { .uri = "/api/schedule", .method = HTTP_DELETE, .handler = remove_schedule_handler, .auth = true },
+    { .uri = "/api/schedules/export", .method = HTTP_GET, .handler = export_schedules_handler },
+    { .uri = "/api/schedules/import", .method = HTTP_PUT, .handler = import_schedules_handler, .auth = true },
+    { .uri = "/api/wifi", .method = HTTP_POST, .handler = set_wifi_config_handler, .auth = true },
+    { .uri = "/api/fwinfo", .method = HTTP_GET, .handler = get_firmware_info_handler },
+    { .uri = "/api/status", .method = HTTP_GET, .handler = get_status_handler },
+    { .uri = "/api/history", .method = HTTP_GET, .handler = get_history_handler },
+    { .uri = "/api/time", .method = HTTP_POST, .handler = set_time_handler, .auth = true },
+    { .uri = "/api/pump", .method = HTTP_POST, .handler = run_pump_handler, .auth = true },
+    { .uri = "/api/ota", .method = HTTP_POST, .handler = ota_update_handler, .auth = true },
+    { .uri = "/api/ota/status", .method = HTTP_GET, .handler = get_ota_status_handler },
+    { .uri = "/api/pm", .method = HTTP_GET, .handler = get_pm_stats_handler },
+    { .uri = "/api/stats/heap", .method = HTTP_GET, .handler = get_heap_stats_handler },
+    { .uri = "/api/stats/routes", .method = HTTP_GET, .handler = get_route_stats_handler },
+    { .uri = "/api/stats/wifi", .method = HTTP_GET, .handler = get_wifi_stats_handler },
+    { .uri = "/api/trace", .method = HTTP_GET, .handler = get_trace_handler },
+    { .uri = "/api/trace", .method = HTTP_POST, .handler = flush_trace_handler, .auth = true },
+    { .uri = "/api/waterlog", .method = HTTP_GET, .handler = get_water_log_handler },
+    { .uri = "/api/live", .method = HTTP_GET, .handler = live_handler, .websocket = true },
+    { .uri = "/api/pair", .method = HTTP_POST, .handler = pair_handler },
+};
+
+config_server::route_stats config_server::stats[std::size(routes)] = {};
+char config_server::scratch[SCRATCH_LEN] = {};
+
+static constexpr json_schema::field FIRMWARE_INFO_FIELDS[] = {
+    { .key = "sdk", .type = json_schema::TYPE_STRING, .size = sizeof(esp_app_desc_t::idf_ver), .offset = offsetof(esp_app_desc_t, idf_ver) },
+    { .key = "fw", .type = json_schema::TYPE_STRING, .size = sizeof(esp_app_desc_t::version), .offset = offsetof(esp_app_desc_t, version) },
+    { .key = "compDate", .type = json_schema::TYPE_STRING, .size = sizeof(esp_app_desc_t::date), .offset = offsetof(esp_app_desc_t, date) },
+};
 
 esp_err_t config_server::init()
 {
@@ -23,83 +85,41 @@ esp_err_t config_server::init()
     }
 
     httpd_config_t cfg = HTTPD_DEFAULT_CONFIG();
-    cfg.stack_size = 16384;
+    cfg.stack_size = HTTPD_STACK_SIZE;
+    cfg.max_open_sockets = HTTPD_MAX_SOCKETS;
+    cfg.lru_purge_enable = true; // A new client closes the longest idle socket rather than getting refused
+    cfg.max_uri_handlers = std::size(routes);
     esp_err_t ret = httpd_start(&httpd, &cfg);
     if (ret != ESP_OK) {
         ESP_LOGE(TAG, "init: can't start httpd");
         return ret;
     }
 
-    httpd_uri_t add_schedule_cfg = {
-        .uri = "/api/schedule",
-        .method = HTTP_POST,
-        .handler = add_schedule_handler,
-        .user_ctx = this,
-    };
-    ret = ret ?: httpd_register_uri_handler(httpd, &add_schedule_cfg);
-
-    httpd_uri_t remove_schedule_cfg = {
-        .uri = "/api/schedule",
-        .method = HTTP_DELETE,
-        .handler = remove_schedule_handler,
-        .user_ctx = this,
-    };
-    ret = ret ?: httpd_register_uri_handler(httpd, &remove_schedule_cfg);
-
-    httpd_uri_t get_schedule_cfg = {
-        .uri = "/api/schedule",
-        .method = HTTP_GET,
-        .handler = get_schedule_handler,
-        .user_ctx = this,
-    };
-    ret = ret ?: httpd_register_uri_handler(httpd, &get_schedule_cfg);
+    for (auto &asset : assets) {
+        // Assets only change with a firmware update, so hash them once for the ETag
+        const uint32_t crc = esp_rom_crc32_le(0, asset.start, asset.end - asset.start);
+        snprintf(asset.etag, sizeof(asset.etag), "\"%08lx\"", crc);
+    }
 
-    if (ret != ESP_OK) {
-        ESP_LOGE(TAG, "init: can't register handlers: 0x%x", ret);
-    }
-
-    httpd_uri_t set_wifi_handler = {
-        .uri = "/api/wifi",
-        .method = HTTP_POST,
-        .handler = set_wifi_config_handler,
-        .user_ctx = this,
-    };
-    ret = ret ?: httpd_register_uri_handler(httpd, &set_wifi_handler);
-
-    httpd_uri_t get_fw_handler = {
-        .uri = "/api/fwinfo",
-        .method = HTTP_GET,
-        .handler = get_firmware_info_handler,
-        .user_ctx = this,
-    };
-    ret = ret ?: httpd_register_uri_handler(httpd, &get_fw_handler);
-
-    httpd_uri_t set_time_cfg = {
-        .uri = "/api/time",
-        .method = HTTP_POST,
-        .handler = set_time_handler,
-        .user_ctx = this,
-    };
-    ret = ret ?: httpd_register_uri_handler(httpd, &set_time_cfg);
-
-    httpd_uri_t ota_update_cfg = {
-        .uri = "/api/ota",
-        .method = HTTP_POST,
-        .handler = ota_update_handler,
-        .user_ctx = this,
-    };
-    ret = ret ?: httpd_register_uri_handler(httpd, &ota_update_cfg);
-
-    httpd_uri_t index_cfg = {
-        .uri = "/",
-        .method = HTTP_GET,
-        .handler = index_handler,
-        .user_ctx = this,
-    };
-    ret = ret ?: httpd_register_uri_handler(httpd, &index_cfg);
+    // Every route goes through dispatch(), which finds its entry again through user_ctx
+    for (const auto &route : routes) {
+        const httpd_uri_t uri_cfg = {
+            .uri = route.uri,
+            .method = route.method,
+            .handler = dispatch,
+            .user_ctx = (void *)&route,
+            .is_websocket = route.websocket,
+        };
+
+        ret = httpd_register_uri_handler(httpd, &uri_cfg);
+        if (ret != ESP_OK) {
+            ESP_LOGE(TAG, "init: can't register %s %s: 0x%x", http_method_str(route.method), route.uri, ret);
+            break;
+        }
+    }
 
-    if (ret != ESP_OK) {
-        ESP_LOGE(TAG, "init: can't register handlers: 0x%x", ret);
+    if (ret == ESP_OK && live_evt_handle == nullptr) {
+        ret = esp_event_handler_instance_register(MISTY_STATUS_EVENTS, ESP_EVENT_ANY_ID, live_event_handler, this, &live_evt_handle);
     }
 
     ESP_LOGI(TAG, "init: server started");
@@ -108,6 +128,12 @@ esp_err_t config_server::init()
 
 esp_err_t config_server::stop()
 {
+    // Before the server goes, the handler would otherwise queue work onto a dead instance
+    if (live_evt_handle != nullptr) {
+        esp_event_handler_instance_unregister(MISTY_STATUS_EVENTS, ESP_EVENT_ANY_ID, live_evt_handle);
+        live_evt_handle = nullptr;
+    }
+
     if (httpd != nullptr) {
         esp_err_t ret = httpd_stop(httpd);
         httpd = nullptr;
@@ -117,16 +143,86 @@ esp_err_t config_server::stop()
     return ESP_OK;
 }
 
+esp_err_t config_server::dispatch(httpd_req_t* req)
+{
+    const auto *route = (const config_server::route *)req->user_ctx;
+    auto &stat = stats[route - routes];
+
+    // Handlers see the route's own context, same as if they had been registered directly
+    req->user_ctx = route->ctx;
+    const int64_t start_us = esp_timer_get_time();
+    const esp_err_t ret = route->auth && !is_authorized(req) ? send_unauthorized(req) : route->handler(req);
+    const auto elapsed_us = (uint32_t)(esp_timer_get_time() - start_us);
+
+    // Only ever touched from the httpd task, no locking needed
+    stat.count += 1;
+    stat.errors += ret == ESP_OK ? 0 : 1;
+    stat.total_us += elapsed_us;
+    stat.max_us = std::max(stat.max_us, elapsed_us);
+    return ret;
+}
+
+bool config_server::is_authorized(httpd_req_t* req)
+{
+    // Sized so the header only fits if the token part is exactly as long as ours, anything longer fails as truncated
+    char auth[sizeof(BEARER_PREFIX) + auth_token::TOKEN_HEX_LEN] = {};
+    if (httpd_req_get_hdr_value_str(req, "Authorization", auth, sizeof(auth)) != ESP_OK
+        || strncmp(auth, BEARER_PREFIX, sizeof(BEARER_PREFIX) - 1) != 0) {
+        return false;
+    }
+
+    return auth_token::instance().check(auth + sizeof(BEARER_PREFIX) - 1);
+}
+
+esp_err_t config_server::send_unauthorized(httpd_req_t* req)
+{
+    ESP_LOGW(TAG, "auth: rejected %s %s", http_method_str((httpd_method_t)req->method), req->uri);
+    httpd_resp_set_hdr(req, "WWW-Authenticate", "Bearer");
+    return httpd_resp_send_err(req, HTTPD_401_UNAUTHORIZED, "Pairing token required");
+}
+
+esp_err_t config_server::pair_handler(httpd_req_t* req)
+{
+    char token[auth_token::TOKEN_HEX_LEN + 1] = {};
+    if (!auth_token::instance().take_pairing(token, sizeof(token))) {
+        return httpd_resp_send_err(req, HTTPD_403_FORBIDDEN, "Press the config button to pair");
+    }
+
+    ESP_LOGI(TAG, "pair: token handed out");
+    httpd_resp_set_type(req, "application/json");
+    chunk_writer writer = { .req = req };
+    mjson_printf(chunk_writer::print, &writer, "{%Q:%Q,%Q:%Q}", "token", token, "ap_password", auth_token::instance().ap_password());
+    return writer.finish();
+}
+
+esp_err_t config_server::get_route_stats_handler(httpd_req_t* req)
+{
+    httpd_resp_set_type(req, "application/json");
+    chunk_writer writer = { .req = req };
+    chunk_writer::print("[", 1, &writer);
+    for (size_t idx = 0; idx < std::size(routes); idx += 1) {
+        const auto &stat = stats[idx];
+        mjson_printf(chunk_writer::print, &writer, "%s{%Q:%Q,%Q:%Q,%Q:%lu,%Q:%lu,%Q:%lu,%Q:%lu}", idx == 0 ? "" : ",",
+            "uri", routes[idx].uri, "method", http_method_str(routes[idx].method), "count", (unsigned long)stat.count,
+            "errors", (unsigned long)stat.errors, "avg_us", (unsigned long)(stat.count == 0 ? 0 : stat.total_us / stat.count),
+            "max_us", (unsigned long)stat.max_us);
+    }
+
+    chunk_writer::print("]", 1, &writer);
+    return writer.finish();
+}
+
 esp_err_t config_server::get_schedule_handler(httpd_req_t* req)
 {
     httpd_resp_set_type(req, "application/json");
 
     char query[64] = { 0 };
-    char out[256] = { 0 };
+    char *out = scratch;
+    out[0] = '\0';
     if (httpd_req_get_url_query_len(req) > sizeof(query) - 1 || httpd_req_get_url_query_len(req) <= 1) {
-        esp_err_t ret = sched_manager::instance().list_all_schedule_names_to_json(out, sizeof(out));
+        esp_err_t ret = sched_manager::instance().list_all_schedule_names_to_json(out, SCRATCH_LEN);
         if (ret == ESP_OK) {
-            return httpd_resp_send(req, out, (ssize_t)strnlen(out, sizeof(out)));
+            return httpd_resp_send(req, out, (ssize_t)strnlen(out, SCRATCH_LEN));
         } else if (ret == ESP_ERR_NVS_NOT_FOUND) {
             return httpd_resp_sendstr(req, "[]");
         } else {
@@ -135,9 +231,9 @@ esp_err_t config_server::get_schedule_handler(httpd_req_t* req)
     }
 
     if (httpd_req_get_url_query_str(req, query, sizeof(query) - 1) != ESP_OK) {
-        esp_err_t ret = sched_manager::instance().list_all_schedule_names_to_json(out, sizeof(out));
+        esp_err_t ret = sched_manager::instance().list_all_schedule_names_to_json(out, SCRATCH_LEN);
         if (ret == ESP_OK) {
-            return httpd_resp_send(req, out, (ssize_t)strnlen(out, sizeof(out)));
+            return httpd_resp_send(req, out, (ssize_t)strnlen(out, SCRATCH_LEN));
         } else if (ret == ESP_ERR_NVS_NOT_FOUND) {
             return httpd_resp_sendstr(req, "[]");
         } else {
@@ -156,32 +252,27 @@ esp_err_t config_server::get_schedule_handler(httpd_req_t* req)
         return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Failed to get schedule");
     }
 
-    int len = 0;
-    if (entry.schedule_type == ESP_SCHEDULE_TYPE_DAYS_OF_WEEK) {
-        len = snprintf(out, sizeof(out), R"({"name":"%s","pump":%u,"dow":%u,"h":%u,"m":%u,"duration":[%lu,%lu,%lu],"type":%u})",
-            name, entry.select_pumps, entry.day_of_week, entry.dow.hour, entry.dow.minute,
-            entry.duration_ms[sched_manager::PROFILE_DRY], entry.duration_ms[sched_manager::PROFILE_MODERATE],
-            entry.duration_ms[sched_manager::PROFILE_WET], (uint8_t)entry.schedule_type);
-    } else if (entry.schedule_type == ESP_SCHEDULE_TYPE_SUNRISE || entry.schedule_type == ESP_SCHEDULE_TYPE_SUNSET) {
-        len = snprintf(out, sizeof(out), R"({"name":"%s","pump":%u,"dow":%u,"offset":%d,"duration":[%lu,%lu,%lu],"type":%u})",
-           name, entry.select_pumps, entry.day_of_week, entry.offset_minute,
-           entry.duration_ms[sched_manager::PROFILE_DRY], entry.duration_ms[sched_manager::PROFILE_MODERATE],
-           entry.duration_ms[sched_manager::PROFILE_WET], (uint8_t)entry.schedule_type);
-    } else {
+    if (entry.schedule_type != ESP_SCHEDULE_TYPE_DAYS_OF_WEEK && entry.schedule_type != ESP_SCHEDULE_TYPE_SUNRISE && entry.schedule_type != ESP_SCHEDULE_TYPE_SUNSET) {
         ESP_LOGE(TAG, "Invalid schedule type %u (probably corrupted?)", entry.schedule_type);
         return httpd_resp_send_err(req, HTTPD_505_VERSION_NOT_SUPPORTED, "Invalid schedule type");
     }
 
-    if (len < 1) {
-        ESP_LOGE(TAG, "Can't format output JSON");
-        return httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Can't format output JSON");
-    }
+    schedule_doc doc = {};
+    strncpy(doc.name, name, sizeof(doc.name) - 1);
+    doc.entry = entry;
 
-    return httpd_resp_send(req, out, (ssize_t)strnlen(out, sizeof(out)));
+    chunk_writer writer = { .req = req };
+    json_schema::print_object(chunk_writer::print, &writer, api_schema::SCHEDULE_FIELDS, api_schema::SCHEDULE_FIELD_CNT, &doc);
+    return writer.finish();
 }
 
 esp_err_t config_server::add_schedule_handler(httpd_req_t* req)
 {
+    // A body means the JSON API, otherwise fall back to the original query string form
+    if (req->content_len > 0) {
+        return schedule_json_body(req, false);
+    }
+
     char query[256] = { 0 };
     if (httpd_req_get_url_query_len(req) > sizeof(query) - 1 || httpd_req_get_url_query_len(req) <= 1) {
         return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid argument");
@@ -191,169 +282,84 @@ esp_err_t config_server::add_schedule_handler(httpd_req_t* req)
         return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid argument");
     }
 
-    ESP_LOGI(TAG, "add_sched: got query str: %s", query);
-
-    // Get the type first
-    char val[16] = { 0 };
-    auto ret = httpd_query_key_value(query, "type", val, sizeof(val) - 1);
-    val[sizeof(val) - 1] = '\0';
-    if (ret != ESP_OK) {
-        ESP_LOGE(TAG, "add_sched: failed to parse type");
-        return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Can't parse schedule type");
+    schedule_doc doc = {};
+    const char *error = api_schema::parse_schedule_query(query, doc);
+    if (error != nullptr) {
+        ESP_LOGW(TAG, "add_sched: %s", error);
+        return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, error);
     }
 
-    ESP_LOGI(TAG, "add_sched: type=%s", val);
-    sched_manager::cron_store_entry entry = {};
-    if (strncmp("sunrise", val, sizeof(val)) == 0) {
-        entry.schedule_type = ESP_SCHEDULE_TYPE_SUNRISE;
-    } else if (strncmp("sunset", val, sizeof(val)) == 0) {
-        entry.schedule_type = ESP_SCHEDULE_TYPE_SUNSET;
-    } else if (strncmp("dow", val, sizeof(val)) == 0) {
-        entry.schedule_type = ESP_SCHEDULE_TYPE_DAYS_OF_WEEK;
-    } else {
-        ESP_LOGW(TAG, "add_sched: invalid type");
-        return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid schedule type");
-    }
-
-    ESP_LOGI(TAG, "add_sched: type=%u", entry.schedule_type);
-
-    // Pump selection
-    memset(val, 0, sizeof(val));
-    ret = httpd_query_key_value(query, "pump", val, sizeof(val) - 1);
-    val[sizeof(val) - 1] = '\0';
-    if (ret != ESP_OK) {
-        ESP_LOGE(TAG, "add_sched: failed to parse pump");
-        return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Can't parse schedule type");
-    }
-
-    auto pump_select = strtol(val, nullptr, 10);
-    ESP_LOGI(TAG, "add_sched: pump=%s parsed to %ld", val, pump_select);
-    if (pump_select < 1 || pump_select > sched_manager::PUMP_ALL) {
-        ESP_LOGW(TAG, "add_sched: invalid pump selection");
-        return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid pump selection");
-    }
-
-    entry.select_pumps = (sched_manager::pump_bits)(pump_select & 0xff);
+    return commit_schedule(req, doc.name, doc.entry);
+}
 
-    // DoW
-    memset(val, 0, sizeof(val));
-    ret = httpd_query_key_value(query, "dow", val, sizeof(val) - 1);
-    val[sizeof(val) - 1] = '\0';
-    if (ret != ESP_OK) {
-        ESP_LOGE(TAG, "add_sched: failed to parse DoW");
-        return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Can't parse schedule DoW");
-    }
+esp_err_t config_server::update_schedule_handler(httpd_req_t* req)
+{
+    return schedule_json_body(req, true);
+}
 
-    auto dow = strtol(val, nullptr, 10);
-    ESP_LOGI(TAG, "add_sched: dow=%s parsed to %ld", val, dow);
-    if (dow < 1) {
-        ESP_LOGW(TAG, "add_sched: invalid DoW selection");
-        return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid day of week selection");
+esp_err_t config_server::schedule_json_body(httpd_req_t* req, bool update)
+{
+    char buf[SCHEDULE_JSON_MAX_LEN] = { 0 };
+    if (req->content_len >= sizeof(buf)) {
+        return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Content too long");
     }
 
-    entry.day_of_week = (uint8_t)(dow & 0xff);
-
-
-    // DoW hours and minutes
-    if (entry.schedule_type == ESP_SCHEDULE_TYPE_DAYS_OF_WEEK) {
-        memset(val, 0, sizeof(val));
-        ret = httpd_query_key_value(query, "hour", val, sizeof(val) - 1);
-        val[sizeof(val) - 1] = '\0';
-        if (ret != ESP_OK) {
-            ESP_LOGE(TAG, "add_sched: failed to parse DoW hour");
-            return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Can't parse dow.hour type");
-        }
-
-        auto hour = strtol(val, nullptr, 10);
-        ESP_LOGI(TAG, "add_sched: dow.hour=%s parsed to %ld", val, hour);
-        if (hour < 0 || hour >= 24) {
-            ESP_LOGW(TAG, "add_sched: invalid DoW hour");
-            return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid DoW hour");
-        }
-
-        entry.dow.hour = (uint8_t)(hour & 0xff);
-
-        memset(val, 0, sizeof(val));
-        ret = httpd_query_key_value(query, "min", val, sizeof(val) - 1);
-        val[sizeof(val) - 1] = '\0';
-        if (ret != ESP_OK) {
-            ESP_LOGE(TAG, "add_sched: failed to parse DoW minute");
-            return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Can't parse dow.minute type");
-        }
-
-        auto min = strtol(val, nullptr, 10);
-        ESP_LOGI(TAG, "add_sched: dow.min=%s parsed to %ld", val, min);
-        if (min < 0 || min >= 60) {
-            ESP_LOGW(TAG, "add_sched: invalid DoW minute");
-            return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid DoW minute");
-        }
-
-        entry.dow.minute = (uint8_t)(min & 0xff);
-    } else {
-        memset(val, 0, sizeof(val));
-        ret = httpd_query_key_value(query, "off", val, sizeof(val) - 1);
-        val[sizeof(val) - 1] = '\0';
-        if (ret != ESP_OK) {
-            ESP_LOGE(TAG, "add_sched: failed to parse DoW hour");
-            return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Can't parse offset type");
+    int received = 0;
+    while (received < (int)req->content_len) {
+        int ret = httpd_req_recv(req, buf + received, req->content_len - received);
+        if (ret <= 0) {
+            if (ret == HTTPD_SOCK_ERR_TIMEOUT) {
+                httpd_resp_send_408(req);
+            }
+            return ESP_FAIL;
         }
 
-        auto offset = (int16_t)strtol(val, nullptr, 10);
-        ESP_LOGI(TAG, "add_sched: sun.offset=%s parsed to %ld", val, offset);
-
-        entry.offset_minute = offset;
+        received += ret;
     }
 
-    memset(val, 0, sizeof(val));
-    ret = httpd_query_key_value(query, "durd", val, sizeof(val) - 1);
-    val[sizeof(val) - 1] = '\0';
-    if (ret != ESP_OK) {
-        ESP_LOGE(TAG, "add_sched: failed to parse dry duration");
-        return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Can't parse dry duration");
+    schedule_doc doc = {};
+    const char *error = json_schema::parse_object(buf, received, api_schema::SCHEDULE_FIELDS, api_schema::SCHEDULE_FIELD_CNT, &doc);
+    if (error != nullptr) {
+        ESP_LOGW(TAG, "add_sched: %s", error);
+        return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, error);
     }
 
-    auto dry_dur = (uint32_t)strtol(val, nullptr, 10);
-    ESP_LOGI(TAG, "add_sched: dry duration=%s parsed to %ld", val, dry_dur);
-
-    entry.duration_ms[sched_manager::PROFILE_DRY] = dry_dur;
+    return commit_schedule(req, doc.name, doc.entry, update);
+}
 
-    memset(val, 0, sizeof(val));
-    ret = httpd_query_key_value(query, "durm", val, sizeof(val) - 1);
-    val[sizeof(val) - 1] = '\0';
-    if (ret != ESP_OK) {
-        ESP_LOGE(TAG, "add_sched: failed to parse moderate duration");
-        return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Can't parse moderate duration");
+esp_err_t config_server::commit_schedule(httpd_req_t* req, const char* name, const sched_manager::cron_store_entry& entry, bool update)
+{
+    // Same checks the NVS load path applies, so nothing gets stored that would be skipped on the next boot
+    const char *error = sched_manager::validate_name(name);
+    error = error ?: sched_manager::validate_entry(entry);
+    if (error != nullptr) {
+        ESP_LOGW(TAG, "commit_sched: %s", error);
+        event_trace::instance().add(event_trace::TRACE_SCHED_REJECTED, 0, sizeof(entry));
+        return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, error);
     }
 
-    auto moderate_dur = (uint32_t)strtol(val, nullptr, 10);
-    ESP_LOGI(TAG, "add_sched: moderate duration=%s parsed to %ld", val, moderate_dur);
-
-    entry.duration_ms[sched_manager::PROFILE_MODERATE] = moderate_dur;
-
-    memset(val, 0, sizeof(val));
-    ret = httpd_query_key_value(query, "durw", val, sizeof(val) - 1);
-    val[sizeof(val) - 1] = '\0';
-    if (ret != ESP_OK) {
-        ESP_LOGE(TAG, "add_sched: failed to parse wet duration");
-        return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Can't parse wet duration");
+    uint32_t when = entry.select_pumps | (entry.day_of_week << 8);
+    if (entry.schedule_type == ESP_SCHEDULE_TYPE_DAYS_OF_WEEK) {
+        when |= (entry.dow.hour << 16) | (entry.dow.minute << 24);
+    } else {
+        when |= ((uint16_t)entry.offset_minute << 16);
     }
 
-    auto wet_dur = (uint32_t)strtol(val, nullptr, 10);
-    ESP_LOGI(TAG, "add_sched: wet duration=%s parsed to %ld", val, wet_dur);
-
-    entry.duration_ms[sched_manager::PROFILE_WET] = wet_dur;
+    event_trace::instance().add(event_trace::TRACE_SCHED_PARSED, entry.schedule_type, when, entry.duration_ms[sched_manager::PROFILE_MODERATE]);
+    if (update) {
+        bool changed = false;
+        esp_err_t ret = sched_manager::instance().update_schedule(name, &entry, &changed);
+        if (ret == ESP_ERR_NOT_FOUND) {
+            return httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "No such schedule");
+        } else if (ret != ESP_OK) {
+            ESP_LOGW(TAG, "update_sched: update failed: 0x%x", ret);
+            return httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Update schedule failed");
+        }
 
-    memset(val, 0, sizeof(val));
-    ret = httpd_query_key_value(query, "name", val, sizeof(val) - 1);
-    val[sizeof(val) - 1] = '\0';
-    if (strnlen(val, sizeof(val)) > NVS_KEY_NAME_MAX_SIZE || strnlen(val, sizeof(val)) == 0) {
-        ESP_LOGE(TAG, "add_sched: Invalid name");
-        return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid name");
+        return httpd_resp_sendstr(req, changed ? "OK" : "Unchanged");
     }
 
-    ESP_LOGI(TAG, "add_sched: name=%s", val);
-
-    ret = sched_manager::instance().set_schedule(val, &entry);
+    esp_err_t ret = sched_manager::instance().set_schedule(name, &entry);
     if (ret != ESP_OK) {
         ESP_LOGW(TAG, "add_sched: set schedule failed: 0x%x", ret);
         return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Set schedule failed");
@@ -390,25 +396,135 @@ esp_err_t config_server::remove_schedule_handler(httpd_req_t* req)
     return ret;
 }
 
+esp_err_t config_server::export_schedules_handler(httpd_req_t* req)
+{
+    httpd_resp_set_type(req, "application/json");
+
+    auto *docs = (schedule_doc *)calloc(sched_manager::MAX_SCHEDULES, sizeof(schedule_doc));
+    if (docs == nullptr) {
+        return httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "No memory");
+    }
+
+    const size_t cnt = sched_manager::instance().get_all_schedules(docs, sched_manager::MAX_SCHEDULES);
+
+    chunk_writer writer = { .req = req };
+    chunk_writer::print("[", 1, &writer);
+    for (size_t idx = 0; idx < cnt; idx += 1) {
+        if (idx > 0) {
+            chunk_writer::print(",", 1, &writer);
+        }
+
+        json_schema::print_object(chunk_writer::print, &writer, api_schema::SCHEDULE_FIELDS, api_schema::SCHEDULE_FIELD_CNT, &docs[idx]);
+    }
+
+    chunk_writer::print("]", 1, &writer);
+    free(docs);
+    return writer.finish();
+}
+
+esp_err_t config_server::import_schedules_handler(httpd_req_t* req)
+{
+    if (req->content_len < 2 || req->content_len > SCHEDULE_IMPORT_MAX_LEN) {
+        return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid content length");
+    }
+
+    char *buf = (char *)calloc(1, req->content_len + 1);
+    if (buf == nullptr) {
+        return httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "No memory");
+    }
+
+    int received = 0;
+    while (received < (int)req->content_len) {
+        int ret = httpd_req_recv(req, buf + received, req->content_len - received);
+        if (ret <= 0) {
+            free(buf);
+            if (ret == HTTPD_SOCK_ERR_TIMEOUT) {
+                httpd_resp_send_408(req);
+            }
+            return ESP_FAIL;
+        }
+
+        received += ret;
+    }
+
+    // Validate the whole document before anything gets touched, the parsed set is too big for the httpd stack
+    auto *docs = (schedule_doc *)calloc(sched_manager::MAX_SCHEDULES, sizeof(schedule_doc));
+    if (docs == nullptr) {
+        free(buf);
+        return httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "No memory");
+    }
+
+    const char *error = nullptr;
+    size_t cnt = 0;
+    if (mjson(buf, received, nullptr, nullptr) <= 0 || buf[strspn(buf, " \t\r\n")] != '[') {
+        error = "Expecting a JSON array";
+    }
+
+    int offset = 0, key_off = 0, key_len = 0, val_off = 0, val_len = 0, val_type = 0;
+    while (error == nullptr && (offset = mjson_next(buf, received, offset, &key_off, &key_len, &val_off, &val_len, &val_type)) > 0) {
+        if (cnt >= sched_manager::MAX_SCHEDULES) {
+            error = "Too many schedules";
+            break;
+        }
+
+        error = json_schema::parse_object(buf + val_off, val_len, api_schema::SCHEDULE_FIELDS, api_schema::SCHEDULE_FIELD_CNT, &docs[cnt]);
+        error = error ?: sched_manager::validate_name(docs[cnt].name);
+        error = error ?: sched_manager::validate_entry(docs[cnt].entry);
+        for (size_t idx = 0; error == nullptr && idx < cnt; idx += 1) {
+            if (strncmp(docs[idx].name, docs[cnt].name, sizeof(schedule_doc::name)) == 0) {
+                error = "Duplicate name";
+            }
+        }
+
+        // Left pointing at the failed one, so the log below names the right entry
+        cnt += error == nullptr ? 1 : 0;
+    }
+
+    free(buf);
+    if (error != nullptr) {
+        free(docs);
+        ESP_LOGW(TAG, "import: schedule %u: %s", cnt, error);
+        return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, error);
+    }
+
+    esp_err_t ret = sched_manager::instance().replace_all_schedules(docs, cnt);
+    free(docs);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "import: replace failed: 0x%x", ret);
+        return httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Import failed");
+    }
+
+    ESP_LOGI(TAG, "import: %u schedules", cnt);
+    ret = httpd_resp_set_status(req, "202 Accepted");
+    ret = ret ?: httpd_resp_sendstr(req, "OK");
+    return ret;
+}
+
 esp_err_t config_server::set_wifi_config_handler(httpd_req_t* req)
 {
-    char query[96] = { 0 };
+    // Room for a full length SSID and passphrase plus the key names
+    char query[144] = { 0 };
     if (httpd_req_get_url_query_len(req) > sizeof(query) - 1 || httpd_req_get_url_query_len(req) <= 1) {
         return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid argument length");
     }
 
-    if (httpd_req_get_url_query_str(req, query, sizeof(query) - 1) != ESP_OK) {
+    if (httpd_req_get_url_query_str(req, query, sizeof(query)) != ESP_OK) {
         return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid argument");
     }
 
+    // A cut off SSID or password would save credentials that can never connect, so truncation is an error too
     wifi_config_t config = {};
-    auto ret = httpd_query_key_value(query, "ssid", (char *)config.sta.ssid, sizeof(wifi_config_t::sta.ssid) - 1);
-    config.sta.ssid[sizeof(wifi_config_t::sta.ssid) - 1] = '\0';
+    auto ret = httpd_query_key_value(query, "ssid", (char *)config.sta.ssid, sizeof(wifi_config_t::sta.ssid));
+    ret = ret ?: httpd_query_key_value(query, "pwd", (char *)config.sta.password, sizeof(wifi_config_t::sta.password));
+    if (ret != ESP_OK || config.sta.ssid[0] == '\0') {
+        ESP_LOGW(TAG, "set_wifi: bad query: 0x%x", ret);
+        return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid SSID or password");
+    }
 
-    ret = ret ?: httpd_query_key_value(query, "pwd", (char *)config.sta.password, sizeof(wifi_config_t::sta.password) - 1);
-    config.sta.password[sizeof(wifi_config_t::sta.password) - 1] = '\0';
+    char flag[4] = { 0 };
+    const bool static_ip = httpd_query_key_value(query, "static_ip", flag, sizeof(flag)) == ESP_OK && strncmp(flag, "1", sizeof(flag)) == 0;
 
-    ret = ret ?: net_configurator::instance().set_wifi_config(&config);
+    ret = net_configurator::instance().set_wifi_config(&config, static_ip);
     if (ret != ESP_OK) {
         ESP_LOGE(TAG, "Failed to set wifi: 0x%x", ret);
         return httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Failed to set WiFi");
@@ -432,41 +548,141 @@ esp_err_t config_server::get_firmware_info_handler(httpd_req_t* req)
 {
     httpd_resp_set_type(req, "application/json");
 
-    char out[192] = { 0 };
-    int len = snprintf(out, sizeof(out), R"({"sdk":"%s","fw":"%s","compDate":"%s"})", IDF_VER, esp_app_get_description()->version, esp_app_get_description()->date);
-    if (len < 2) {
-        return httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Invalid firmware info");
+    chunk_writer writer = { .req = req };
+    json_schema::print_object(chunk_writer::print, &writer, FIRMWARE_INFO_FIELDS, std::size(FIRMWARE_INFO_FIELDS), esp_app_get_description());
+    return writer.finish();
+}
+
+esp_err_t config_server::get_status_handler(httpd_req_t* req)
+{
+    // Only cached values in here - the sensor task, pump timers and schedulers keep them current
+    const auto &sensor = air_sensor::instance();
+    const auto &pump = pump_manager::instance();
+    const uint8_t running = pump.running_pumps();
+    static constexpr const char *CHARGE_NAMES[] = { "none", "charging", "done" };
+
+    httpd_resp_set_type(req, "application/json");
+    chunk_writer writer = { .req = req };
+    mjson_printf(chunk_writer::print, &writer, "{%Q:%lu,%Q:{%Q:%B,%Q:%.*g,%Q:%.*g,%Q:%lu,%Q:%lu,%Q:",
+        "uptime", (unsigned long)(esp_timer_get_time() / 1000000),
+        "air", "valid", (int)sensor.has_valid_reading(), "temp", 4, (double)sensor.average_temperature(),
+        "rh", 4, (double)sensor.average_humidity(), "slots", (unsigned long)sensor.history_slots_valid(),
+        "slots_total", (unsigned long)air_sensor::history_slot_count(), "sample");
+
+    const uint32_t sample_age = sensor.latest_sample_age_sec();
+    if (sample_age == UINT32_MAX) {
+        mjson_printf(chunk_writer::print, &writer, "null}");
+    } else {
+        mjson_printf(chunk_writer::print, &writer, "{%Q:%.*g,%Q:%.*g,%Q:%lu}}",
+            "temp", 4, (double)sensor.latest_temperature(), "rh", 4, (double)sensor.latest_humidity(), "age", (unsigned long)sample_age);
+    }
+
+    mjson_printf(chunk_writer::print, &writer, ",%Q:{%Q:%B,%Q:{%Q:%B,%Q:%lu},%Q:{%Q:%B,%Q:%lu}},%Q:%Q,%Q:",
+        "pumps", "test", (int)pump.test_mode(),
+        "a", "running", (int)((running & 0b01) != 0), "remaining_ms", (unsigned long)pump.remaining_ms(0b01),
+        "b", "running", (int)((running & 0b10) != 0), "remaining_ms", (unsigned long)pump.remaining_ms(0b10),
+        "charge", CHARGE_NAMES[misty::get_charge_state()], "next");
+
+    time_t next_at = 0;
+    char next_name[NVS_KEY_NAME_MAX_SIZE] = { 0 };
+    if (sched_manager::instance().next_fire(next_at, next_name, sizeof(next_name))) {
+        mjson_printf(chunk_writer::print, &writer, "{%Q:%Q,%Q:%ld}}", "name", next_name, "at", (long)next_at);
+    } else {
+        mjson_printf(chunk_writer::print, &writer, "null}");
+    }
+
+    return writer.finish();
+}
+
+esp_err_t config_server::get_history_handler(httpd_req_t* req)
+{
+    char query[32] = { 0 };
+    char format[8] = { 0 };
+    const bool binary = httpd_req_get_url_query_str(req, query, sizeof(query) - 1) == ESP_OK
+        && httpd_query_key_value(query, "format", format, sizeof(format) - 1) == ESP_OK && strncmp(format, "bin", sizeof(format)) == 0;
+
+    // Straight from the ring into the chunk writer, the ring is only ever read in time order from one fixed start
+    const auto &sensor = air_sensor::instance();
+    const size_t oldest_idx = sensor.history_oldest_idx();
+    const size_t slot_cnt = air_sensor::history_slot_count();
+    chunk_writer writer = { .req = req };
+    float temp = 0, humid = 0;
+
+    if (binary) {
+        httpd_resp_set_type(req, "application/octet-stream");
+        air_sensor::history_dump_header header = {};
+        header.magic = air_sensor::HISTORY_DUMP_MAGIC;
+        header.version = air_sensor::HISTORY_DUMP_VERSION;
+        header.slot_count = slot_cnt;
+        header.slot_period_sec = air_sensor::history_slot_period_sec();
+        header.end_time = (uint32_t)sensor.history_end_time();
+        chunk_writer::print((const char *)&header, sizeof(header), &writer);
+
+        for (size_t pos = 0; pos < slot_cnt; pos += 1) {
+            air_sensor::history_dump_slot slot = { .temp_centi = INT16_MIN, .humid_centi = UINT16_MAX };
+            if (sensor.history_slot(oldest_idx, pos, temp, humid)) {
+                slot.temp_centi = (int16_t)lroundf(temp * 100.0f);
+                slot.humid_centi = (uint16_t)lroundf(humid * 100.0f);
+            }
+
+            chunk_writer::print((const char *)&slot, sizeof(slot), &writer);
+        }
+
+        return writer.finish();
+    }
+
+    // Column per quantity rather than an object per slot, about half the size
+    httpd_resp_set_type(req, "application/json");
+    mjson_printf(chunk_writer::print, &writer, "{%Q:%lu,%Q:%ld,%Q:[", "period", (unsigned long)air_sensor::history_slot_period_sec(),
+        "end", (long)sensor.history_end_time(), "temp");
+    for (size_t pos = 0; pos < slot_cnt; pos += 1) {
+        const char *sep = pos == 0 ? "" : ",";
+        if (sensor.history_slot(oldest_idx, pos, temp, humid)) {
+            mjson_printf(chunk_writer::print, &writer, "%s%.*g", sep, 4, (double)temp);
+        } else {
+            mjson_printf(chunk_writer::print, &writer, "%snull", sep);
+        }
+    }
+
+    mjson_printf(chunk_writer::print, &writer, "],%Q:[", "rh");
+    for (size_t pos = 0; pos < slot_cnt; pos += 1) {
+        const char *sep = pos == 0 ? "" : ",";
+        if (sensor.history_slot(oldest_idx, pos, temp, humid)) {
+            mjson_printf(chunk_writer::print, &writer, "%s%.*g", sep, 4, (double)humid);
+        } else {
+            mjson_printf(chunk_writer::print, &writer, "%snull", sep);
+        }
     }
 
-    return httpd_resp_send(req, out, len);
+    mjson_printf(chunk_writer::print, &writer, "]}");
+    return writer.finish();
 }
 
 esp_err_t config_server::set_time_handler(httpd_req_t* req)
 {
     char buf[128] = { 0 };
-    int ret = 0, remaining = req->content_len;
-
-    if (remaining >= sizeof(buf)) {
-        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Content too long");
-        return ESP_FAIL;
+    if (req->content_len >= sizeof(buf)) {
+        return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Content too long");
     }
 
-    if (remaining > 0) {
-        ret = httpd_req_recv(req, buf, remaining);
+    int received = 0;
+    while (received < (int)req->content_len) {
+        int ret = httpd_req_recv(req, buf + received, req->content_len - received);
         if (ret <= 0) {
             if (ret == HTTPD_SOCK_ERR_TIMEOUT) {
                 httpd_resp_send_408(req);
             }
             return ESP_FAIL;
         }
-        buf[ret] = '\0';
+
+        received += ret;
     }
 
+    // Anything that isn't a plain epoch second would turn into garbage (or UB) on the time_t cast
     double now_ts = 0;
-    if (mjson_get_number(buf, ret, "$.now", &now_ts) == 0) {
-        ESP_LOGE(TAG, "set_time: failed to parse JSON: %s", buf);
-        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid JSON");
-        return ESP_OK;
+    if (mjson_get_number(buf, received, "$.now", &now_ts) == 0 || !std::isfinite(now_ts) || now_ts < 0 || now_ts > UINT32_MAX) {
+        ESP_LOGW(TAG, "set_time: invalid body");
+        return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid JSON");
     }
 
     struct timeval tv;
@@ -480,75 +696,610 @@ esp_err_t config_server::set_time_handler(httpd_req_t* req)
     return httpd_resp_sendstr(req, "OK");
 }
 
-esp_err_t config_server::index_handler(httpd_req_t* req)
+esp_err_t config_server::run_pump_handler(httpd_req_t* req)
 {
-    httpd_resp_set_type(req, "text/html");
-    const size_t len = index_html_end - index_html_start;
-    return httpd_resp_send(req, index_html_start, (ssize_t)len);
+    char buf[PUMP_JSON_MAX_LEN] = { 0 };
+    if (req->content_len >= sizeof(buf)) {
+        return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Content too long");
+    }
+
+    int received = 0;
+    while (received < (int)req->content_len) {
+        int ret = httpd_req_recv(req, buf + received, req->content_len - received);
+        if (ret <= 0) {
+            if (ret == HTTPD_SOCK_ERR_TIMEOUT) {
+                httpd_resp_send_408(req);
+            }
+            return ESP_FAIL;
+        }
+
+        received += ret;
+    }
+
+    pump_run_doc doc = { .duty = pump_manager::DUTY_MAX };
+    const char *error = json_schema::parse_object(buf, received, api_schema::PUMP_RUN_FIELDS, api_schema::PUMP_RUN_FIELD_CNT, &doc);
+    if (error != nullptr) {
+        ESP_LOGW(TAG, "run_pump: %s", error);
+        return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, error);
+    }
+
+    // Same pump_manager path the scheduler uses, so the off timers, water log and live updates all apply
+    auto &pump = pump_manager::instance();
+    esp_err_t ret = doc.duration_ms == 0 ? pump.stop(doc.pump) : pump.run_manual(doc.pump, doc.duration_ms, doc.duty);
+    if (ret == ESP_ERR_INVALID_STATE) {
+        return httpd_resp_send_custom_err(req, "409 Conflict", "Pump test mode is on");
+    } else if (ret == ESP_ERR_INVALID_ARG) {
+        ESP_LOGW(TAG, "run_pump: rejected pumps 0x%x, %lu ms", doc.pump, doc.duration_ms);
+        return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid pump run");
+    } else if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "run_pump: failed: 0x%x", ret);
+        return httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Pump failed");
+    }
+
+    ESP_LOGI(TAG, "run_pump: pumps 0x%x for %lu ms at %u%%", doc.pump, doc.duration_ms, doc.duty);
+    return httpd_resp_sendstr(req, "OK");
+}
+
+esp_err_t config_server::asset_handler(httpd_req_t* req)
+{
+    const auto *asset = (const web_asset *)req->user_ctx;
+    httpd_resp_set_hdr(req, "ETag", asset->etag);
+    httpd_resp_set_hdr(req, "Cache-Control", "no-cache"); // Browser may keep it, but must revalidate so an OTA shows up
+
+    char if_none_match[sizeof(web_asset::etag) + 8] = {};
+    if (httpd_req_get_hdr_value_str(req, "If-None-Match", if_none_match, sizeof(if_none_match)) == ESP_OK
+        && strstr(if_none_match, asset->etag) != nullptr) {
+        httpd_resp_set_status(req, "304 Not Modified");
+        return httpd_resp_send(req, nullptr, 0);
+    }
+
+    // Only the compressed copy is in flash, so a client that can't take it gets nothing rather than garbage
+    if (asset->encoding != nullptr) {
+        httpd_resp_set_hdr(req, "Vary", "Accept-Encoding");
+        const bool has_header = httpd_req_get_hdr_value_str(req, "Accept-Encoding", scratch, SCRATCH_LEN) == ESP_OK;
+        if (!http_parse::accepts_encoding(has_header ? scratch : nullptr, asset->encoding)) {
+            return httpd_resp_send_custom_err(req, "406 Not Acceptable", "This page is only available gzip encoded");
+        }
+
+        httpd_resp_set_hdr(req, "Content-Encoding", asset->encoding);
+    }
+
+    httpd_resp_set_type(req, asset->type);
+
+    return send_asset_chunked(req, *asset);
+}
+
+esp_err_t config_server::send_asset_chunked(httpd_req_t* req, const web_asset& asset)
+{
+    // Hand out slices of the mapped flash directly, nothing gets staged on the stack or heap
+    const uint8_t *pos = asset.start;
+    while (pos < asset.end) {
+        const size_t len = (size_t)(asset.end - pos) < ASSET_CHUNK_SIZE ? (size_t)(asset.end - pos) : ASSET_CHUNK_SIZE;
+        esp_err_t ret = httpd_resp_send_chunk(req, (const char *)pos, (ssize_t)len);
+        if (ret != ESP_OK) {
+            ESP_LOGE(TAG, "asset: send %s failed at %u: 0x%x", req->uri, pos - asset.start, ret);
+            return ret;
+        }
+
+        pos += len;
+    }
+
+    return httpd_resp_send_chunk(req, nullptr, 0);
 }
 
 esp_err_t config_server::ota_update_handler(httpd_req_t *req)
 {
-    char buf[1024];
-    esp_ota_handle_t update_handle = 0;
-    const esp_partition_t *update_partition = esp_ota_get_next_update_partition(nullptr);
+    if (req->content_len == 0) {
+        return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Empty image");
+    }
+
+    // Content-Range makes this one piece of a bigger upload, a piece not starting at 0 continues a suspended one
+    size_t range_first = 0;
+    size_t upload_size = req->content_len;
+    char range[48] = { 0 };
+    if (httpd_req_get_hdr_value_str(req, "Content-Range", range, sizeof(range)) == ESP_OK) {
+        unsigned long first = 0, last = 0, total = 0;
+        if (!http_parse::parse_content_range(range, first, last, total) || first > last || last >= total
+            || last - first + 1 != req->content_len) {
+            return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid Content-Range");
+        }
 
-    if (update_partition == nullptr) {
-        ESP_LOGE(TAG, "ota: No partition found");
-        return httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "No OTA partition");
+        range_first = first;
+        upload_size = total;
     }
 
-    ESP_LOGI(TAG, "ota: Writing to partition subtype %d at offset 0x%lx",
-             update_partition->subtype, update_partition->address);
+    auto &ota = ota_manager::instance();
+    ota.expire_suspended();
 
-    esp_err_t err = esp_ota_begin(update_partition, OTA_SIZE_UNKNOWN, &update_handle);
-    if (err != ESP_OK) {
-        ESP_LOGE(TAG, "ota: esp_ota_begin failed (%s)", esp_err_to_name(err));
-        return httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "OTA begin failed");
+    size_t remaining = req->content_len;
+    esp_err_t err = ESP_OK;
+    if (range_first > 0) {
+        if (ota.resume(range_first, upload_size) != ESP_OK) {
+            // The body says where we actually are, so the client can go again from there (or from 0)
+            return send_ota_status(req, "416 Range Not Satisfiable");
+        }
+    } else {
+        // A fresh upload replaces whatever was left suspended
+        ota.abort();
+
+        // Optional, browsers can't hash over plain HTTP - the image's own appended digest is still checked either way
+        char sha_hex[ota_manager::SHA256_LEN * 2 + 1] = { 0 };
+        uint8_t expected_sha256[ota_manager::SHA256_LEN] = { 0 };
+        bool has_sha256 = httpd_req_get_hdr_value_str(req, "X-OTA-SHA256", sha_hex, sizeof(sha_hex)) == ESP_OK;
+        if (has_sha256 && !ota_manager::parse_sha256_hex(sha_hex, expected_sha256)) {
+            return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid X-OTA-SHA256");
+        }
+
+        char format[8] = { 0 };
+        bool is_delta = false;
+        if (httpd_req_get_hdr_value_str(req, "X-OTA-Format", format, sizeof(format)) == ESP_OK) {
+            if (strcmp(format, "delta") == 0) {
+                is_delta = true;
+            } else if (strcmp(format, "full") != 0) {
+                return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Unknown X-OTA-Format");
+            }
+        }
+
+        if (is_delta) {
+            // The patch header says what to patch against and what should come out, so read it before starting
+            ota_manager::delta_header header = {};
+            if (remaining <= sizeof(header)) {
+                return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Truncated patch");
+            }
+
+            size_t header_len = 0;
+            while (header_len < sizeof(header)) {
+                int ret = httpd_req_recv(req, (char *)&header + header_len, sizeof(header) - header_len);
+                if (ret <= 0) {
+                    if (ret == HTTPD_SOCK_ERR_TIMEOUT) {
+                        httpd_resp_send_408(req);
+                    }
+                    return ESP_FAIL;
+                }
+
+                header_len += ret;
+            }
+
+            remaining -= sizeof(header);
+            err = ota.begin_delta(header, upload_size);
+            if (err == ESP_ERR_INVALID_VERSION) {
+                return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid patch header");
+            } else if (err == ESP_ERR_NOT_SUPPORTED) {
+                return httpd_resp_send_custom_err(req, "409 Conflict", "Patch is not for the running firmware");
+            }
+        } else {
+            err = ota.begin(upload_size, has_sha256 ? expected_sha256 : nullptr);
+        }
+
+        if (err != ESP_OK) {
+            return httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "OTA begin failed");
+        }
     }
 
-    int remaining = req->content_len;
     while (remaining > 0) {
-        int to_recv = (remaining < sizeof(buf)) ? remaining : sizeof(buf);
-        int ret = httpd_req_recv(req, buf, to_recv);
-        if (ret <= 0) {
-            if (ret == HTTPD_SOCK_ERR_TIMEOUT) {
+        uint8_t *buf = ota.acquire();
+        if (buf == nullptr) {
+            ota.abort();
+            return httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "OTA write failed");
+        }
+
+        // Fill a whole buffer before handing it over, the writer then programs it while we receive the next one
+        size_t filled = 0;
+        uint32_t timeouts = 0;
+        bool dropped = false;
+        while (filled < ota_manager::BUF_SIZE && remaining > 0) {
+            const size_t to_recv = std::min(remaining, ota_manager::BUF_SIZE - filled);
+            int ret = httpd_req_recv(req, (char *)buf + filled, to_recv);
+            if (ret == HTTPD_SOCK_ERR_TIMEOUT && ++timeouts < OTA_RECV_MAX_TIMEOUTS) {
                 continue;
+            } else if (ret <= 0) {
+                dropped = true;
+                break;
             }
-            ESP_LOGE(TAG, "ota: recv failed");
-            esp_ota_end(update_handle);
-            return ESP_FAIL;
+
+            timeouts = 0;
+            filled += ret;
+            remaining -= ret;
+        }
+
+        // Whatever did arrive still goes in, so a resume can start right after it
+        if (filled > 0) {
+            err = ota.submit(buf, filled);
+        } else {
+            ota.release(buf);
         }
 
-        err = esp_ota_write(update_handle, buf, ret);
         if (err != ESP_OK) {
-            ESP_LOGE(TAG, "ota: write failed (%s)", esp_err_to_name(err));
-            esp_ota_end(update_handle);
+            ota.abort();
             return httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "OTA write failed");
         }
 
-        remaining -= ret;
+        if (dropped) {
+            ESP_LOGW(TAG, "ota: connection lost at %u of %u bytes, waiting for a resume", ota.offset(), ota.size());
+            ota.suspend();
+            return ESP_FAIL;
+        }
     }
 
-    err = esp_ota_end(update_handle);
-    if (err != ESP_OK) {
-        ESP_LOGE(TAG, "ota: end failed (%s)", esp_err_to_name(err));
-        return httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "OTA end failed");
+    if (ota.offset() < ota.size()) {
+        // Piece done, more to come
+        ota.suspend();
+        return send_ota_status(req, "202 Accepted");
     }
 
-    err = esp_ota_set_boot_partition(update_partition);
-    if (err != ESP_OK) {
-        ESP_LOGE(TAG, "ota: set_boot_partition failed (%s)", esp_err_to_name(err));
-        return httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Set boot partition failed");
+    const bool is_delta = ota.is_delta();
+    const bool verified = ota.verifying();
+    ota_manager::result result = {};
+    err = ota.finish(result);
+    if (err == ESP_ERR_INVALID_CRC) {
+        return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "SHA-256 mismatch");
+    } else if (err != ESP_OK) {
+        return httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "OTA failed");
     }
 
-    ESP_LOGI(TAG, "ota: OTA success, rebooting...");
+    const uint32_t kb_per_sec = result.elapsed_ms > 0 ? (uint32_t)((uint64_t)result.bytes * 1000 / 1024 / result.elapsed_ms) : 0;
+    ESP_LOGI(TAG, "ota: OTA success, %u bytes (%u sent) at %lu KB/s, rebooting...", result.bytes, result.received, kb_per_sec);
+
     httpd_resp_set_status(req, "202 Accepted");
-    httpd_resp_sendstr(req, "OTA Success. Rebooting...");
-    
+    httpd_resp_set_type(req, "application/json");
+    chunk_writer writer = { .req = req };
+    mjson_printf(chunk_writer::print, &writer, "{%Q:%Q,%Q:%lu,%Q:%lu,%Q:%lu,%Q:%lu,%Q:%H,%Q:%B}",
+        "format", is_delta ? "delta" : "full", "bytes", (unsigned long)result.bytes, "received", (unsigned long)result.received, "ms",
+        (unsigned long)result.elapsed_ms, "kbps", (unsigned long)kb_per_sec,
+        "sha256", (int)sizeof(result.sha256), result.sha256, "verified", (int)verified);
+    writer.finish();
+
+    water_log::instance().flush();
+
     // Give time for the response to go out
     vTaskDelay(pdMS_TO_TICKS(1000));
     esp_restart();
 
     return ESP_OK;
 }
+
+esp_err_t config_server::get_ota_status_handler(httpd_req_t *req)
+{
+    ota_manager::instance().expire_suspended();
+    return send_ota_status(req, HTTPD_200);
+}
+
+esp_err_t config_server::send_ota_status(httpd_req_t *req, const char *status)
+{
+    const auto &ota = ota_manager::instance();
+    httpd_resp_set_status(req, status);
+    httpd_resp_set_type(req, "application/json");
+    chunk_writer writer = { .req = req };
+    mjson_printf(chunk_writer::print, &writer, "{%Q:%B,%Q:%Q,%Q:%lu,%Q:%lu,%Q:%B}",
+        "active", (int)ota.active(), "format", ota.is_delta() ? "delta" : "full",
+        "offset", (unsigned long)ota.offset(), "size", (unsigned long)ota.size(), "verified", (int)ota.verifying());
+    return writer.finish();
+}
+
+esp_err_t config_server::get_pm_stats_handler(httpd_req_t* req)
+{
+    httpd_resp_set_type(req, "text/plain");
+
+    // Stream the dump straight into HTTP chunks instead of formatting the whole thing into a buffer first
+    cookie_io_functions_t io_funcs = {};
+    io_funcs.write = chunk_stream_write;
+    FILE *out = fopencookie(req, "w", io_funcs);
+    if (out == nullptr) {
+        return httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Can't open stream");
+    }
+
+    setvbuf(out, scratch, _IOFBF, SCRATCH_LEN);
+
+    esp_err_t ret = power_stats::instance().dump(out);
+    fclose(out);
+
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "pm_stats: dump failed: 0x%x", ret);
+    }
+
+    return httpd_resp_send_chunk(req, nullptr, 0);
+}
+
+esp_err_t config_server::get_heap_stats_handler(httpd_req_t* req)
+{
+    // Runs on the httpd task itself, so the high water mark covers every handler served since boot
+    const UBaseType_t stack_min_free = uxTaskGetStackHighWaterMark(nullptr);
+    int fds[CONFIG_LWIP_MAX_SOCKETS] = {};
+    size_t fd_cnt = std::size(fds);
+    if (httpd_get_client_list(req->handle, &fd_cnt, fds) != ESP_OK) {
+        fd_cnt = 0;
+    }
+
+    httpd_resp_set_type(req, "application/json");
+    chunk_writer writer = { .req = req };
+    mjson_printf(chunk_writer::print, &writer, "{%Q:{%Q:%lu,%Q:%lu,%Q:%lu},%Q:{%Q:%lu,%Q:%lu,%Q:%lu,%Q:%lu}}",
+        "heap", "free", (unsigned long)heap_caps_get_free_size(MALLOC_CAP_8BIT),
+        "min_free", (unsigned long)heap_caps_get_minimum_free_size(MALLOC_CAP_8BIT),
+        "largest", (unsigned long)heap_caps_get_largest_free_block(MALLOC_CAP_8BIT),
+        "httpd", "stack", (unsigned long)HTTPD_STACK_SIZE, "stack_min_free", (unsigned long)stack_min_free,
+        "sockets", (unsigned long)HTTPD_MAX_SOCKETS, "open", (unsigned long)fd_cnt);
+    return writer.finish();
+}
+
+esp_err_t config_server::get_wifi_stats_handler(httpd_req_t* req)
+{
+    const auto &net = net_configurator::instance();
+    const auto &stats = net.get_connect_stats();
+
+    httpd_resp_set_type(req, "application/json");
+    chunk_writer writer = { .req = req };
+    mjson_printf(chunk_writer::print, &writer, "{%Q:%B,%Q:{%Q:%lu,%Q:%lu,%Q:%lu,%Q:%B,%Q:%B},%Q:%lu,%Q:{%Q:%lu,%Q:%lu,%Q:%lu}}",
+        "static_ip", (int)net.static_ip_enabled(),
+        "connect_ms", "last", (unsigned long)stats.last_ms, "min", (unsigned long)stats.min_ms, "max", (unsigned long)stats.max_ms,
+        "fast", (int)stats.last_fast, "static", (int)stats.last_static,
+        "sync_ms", (unsigned long)stats.last_sync_ms,
+        "count", "total", (unsigned long)stats.connects, "fast", (unsigned long)stats.fast_connects, "fallback", (unsigned long)stats.fallbacks);
+    return writer.finish();
+}
+
+esp_err_t config_server::get_trace_handler(httpd_req_t* req)
+{
+    httpd_resp_set_type(req, "application/octet-stream");
+
+    char query[32] = { 0 };
+    char src[8] = { 0 };
+    if (httpd_req_get_url_query_str(req, query, sizeof(query) - 1) == ESP_OK
+        && httpd_query_key_value(query, "src", src, sizeof(src) - 1) == ESP_OK && strncmp(src, "flash", sizeof(src)) == 0) {
+        return send_flash_trace(req);
+    }
+
+    auto &trace = event_trace::instance();
+    uint32_t seq = 0, end_seq = 0;
+    trace.snapshot_range(seq, end_seq);
+
+    event_trace::dump_header header = {};
+    header.magic = event_trace::DUMP_MAGIC;
+    header.version = event_trace::DUMP_VERSION;
+    header.record_size = sizeof(event_trace::record);
+    header.record_count = end_seq - seq;
+    header.first_seq = seq;
+    header.now_us = (uint32_t)esp_timer_get_time();
+
+    esp_err_t ret = httpd_resp_send_chunk(req, (const char *)&header, sizeof(header));
+    if (ret != ESP_OK) {
+        return ret;
+    }
+
+    // Copy out a few records at a time so the ring lock is never held across a socket send
+    event_trace::record records[16];
+    size_t cnt = 0;
+    while ((cnt = trace.read(seq, end_seq, records, sizeof(records) / sizeof(records[0]))) > 0) {
+        ret = httpd_resp_send_chunk(req, (const char *)records, (ssize_t)(cnt * sizeof(event_trace::record)));
+        if (ret != ESP_OK) {
+            ESP_LOGE(TAG, "trace: send failed: 0x%x", ret);
+            return ret;
+        }
+    }
+
+    return httpd_resp_send_chunk(req, nullptr, 0);
+}
+
+esp_err_t config_server::send_flash_trace(httpd_req_t* req)
+{
+    auto &trace = event_trace::instance();
+    event_trace::dump_header header = {};
+    esp_err_t ret = trace.read_flash(0, &header, sizeof(header));
+    if (ret == ESP_ERR_NOT_FOUND) {
+        return httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "No trace partition");
+    }
+
+    if (ret != ESP_OK || header.magic != event_trace::DUMP_MAGIC || header.record_size != sizeof(event_trace::record)
+        || header.record_count > event_trace::RECORD_COUNT) {
+        return httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "No trace snapshot");
+    }
+
+    ret = httpd_resp_send_chunk(req, (const char *)&header, sizeof(header));
+
+    size_t offset = sizeof(header);
+    const size_t end = sizeof(header) + header.record_count * sizeof(event_trace::record);
+    while (ret == ESP_OK && offset < end) {
+        const size_t len = (end - offset) < SCRATCH_LEN ? (end - offset) : SCRATCH_LEN;
+        ret = trace.read_flash(offset, scratch, len);
+        ret = ret ?: httpd_resp_send_chunk(req, scratch, (ssize_t)len);
+        offset += len;
+    }
+
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "trace: flash dump failed: 0x%x", ret);
+        return ret;
+    }
+
+    return httpd_resp_send_chunk(req, nullptr, 0);
+}
+
+esp_err_t config_server::flush_trace_handler(httpd_req_t* req)
+{
+    esp_err_t ret = event_trace::instance().flush_to_flash();
+    if (ret == ESP_ERR_NOT_FOUND) {
+        return httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "No trace partition");
+    } else if (ret != ESP_OK) {
+        return httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Trace flush failed");
+    }
+
+    httpd_resp_set_status(req, "202 Accepted");
+    return httpd_resp_sendstr(req, "OK");
+}
+
+esp_err_t config_server::get_water_log_handler(httpd_req_t* req)
+{
+    httpd_resp_set_type(req, "application/json");
+
+    auto &log = water_log::instance();
+    log.flush(); // So the entries still batched in RAM show up too
+
+    esp_err_t ret = httpd_resp_send_chunk(req, "[", 1);
+
+    // Only one flash batch and one JSON object in RAM at a time, however long the log is
+    water_log::entry entries[8];
+    char *out = scratch;
+    uint32_t cursor = 0;
+    size_t cnt = 0;
+    bool first = true;
+    while (ret == ESP_OK && (cnt = log.read(cursor, entries, sizeof(entries) / sizeof(entries[0]))) > 0) {
+        for (size_t idx = 0; idx < cnt && ret == ESP_OK; idx += 1) {
+            const auto &item = entries[idx];
+            char name[sizeof(water_log::entry::name) + 1] = { 0 };
+            memcpy(name, item.name, sizeof(item.name));
+
+            // Names are escaped, entries logged before the name check existed may still hold quotes or backslashes
+            int len = mjson_snprintf(out, SCRATCH_LEN, "%s{%Q:%lu,%Q:%lu,%Q:%u,%Q:%Q,%Q:%u,%Q:%d,%Q:%lu,%Q:%d}",
+                first ? "" : ",", "seq", item.seq, "ts", item.timestamp, "kind", (unsigned)item.kind, "name", name,
+                "pump", (unsigned)item.pumps, "profile", item.profile == UINT8_MAX ? -1 : (int)item.profile,
+                "duration", item.duration_ms, "rh", item.humidity_centi == UINT16_MAX ? -1 : (int)item.humidity_centi);
+            if (len < 1 || len >= (int)SCRATCH_LEN - 1) {
+                continue;
+            }
+
+            ret = httpd_resp_send_chunk(req, out, len);
+            first = false;
+        }
+    }
+
+    ret = ret ?: httpd_resp_send_chunk(req, "]", 1);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "waterlog: send failed: 0x%x", ret);
+        return ret;
+    }
+
+    return httpd_resp_send_chunk(req, nullptr, 0);
+}
+
+esp_err_t config_server::live_handler(httpd_req_t* req)
+{
+    if (req->method == HTTP_GET) {
+        // Handshake done - start the client off with the current state, after that it only hears about changes
+        auto &sensor = air_sensor::instance();
+        char buf[LIVE_MSG_MAX_LEN] = { 0 };
+        int len = mjson_snprintf(buf, sizeof(buf), "{%Q:%Q,%Q:%u,%Q:%B,%Q:%.*g,%Q:%.*g}",
+            "type", "hello", "pumps", pump_manager::instance().running_pumps(), "sensor", (int)sensor.has_valid_reading(),
+            "temp", 4, (double)sensor.average_temperature(), "rh", 4, (double)sensor.average_humidity());
+
+        httpd_ws_frame_t frame = {};
+        frame.type = HTTPD_WS_TYPE_TEXT;
+        frame.payload = (uint8_t *)buf;
+        frame.len = len;
+        return httpd_ws_send_frame(req, &frame);
+    }
+
+    // Clients have nothing to say on this channel, but whatever they send still has to be drained
+    httpd_ws_frame_t frame = {};
+    esp_err_t ret = httpd_ws_recv_frame(req, &frame, 0);
+    if (ret != ESP_OK || frame.len == 0) {
+        return ret;
+    }
+
+    uint8_t buf[LIVE_MSG_MAX_LEN] = { 0 };
+    frame.payload = buf;
+    return httpd_ws_recv_frame(req, &frame, sizeof(buf));
+}
+
+void config_server::live_event_handler(void* _ctx, esp_event_base_t evt_base, int32_t evt_id, void* evt_data)
+{
+    auto *ctx = (config_server *)_ctx;
+    auto *msg = (live_msg *)malloc(sizeof(live_msg));
+    if (msg == nullptr) {
+        return;
+    }
+
+    int len = 0;
+    switch (evt_id) {
+        case live_status::STATUS_PUMP: {
+            const auto *state = (const live_status::pump_state *)evt_data;
+            len = mjson_snprintf(msg->buf, sizeof(msg->buf), "{%Q:%Q,%Q:%u,%Q:%B,%Q:%lu}", "type", "pump",
+                "pumps", state->pumps, "running", (int)state->running, "ms", (unsigned long)state->duration_ms);
+            break;
+        }
+        case live_status::STATUS_AIR: {
+            const auto *state = (const live_status::air_state *)evt_data;
+            len = mjson_snprintf(msg->buf, sizeof(msg->buf), "{%Q:%Q,%Q:%.*g,%Q:%.*g,%Q:%u}", "type", "air",
+                "temp", 4, (double)state->temperature, "rh", 4, (double)state->humidity, "slots", state->valid_slots);
+            break;
+        }
+        case live_status::STATUS_SCHEDULE_FIRED: {
+            const auto *fired = (const live_status::schedule_fired *)evt_data;
+            len = mjson_snprintf(msg->buf, sizeof(msg->buf), "{%Q:%Q,%Q:%Q,%Q:%u,%Q:%u,%Q:%lu}", "type", "schedule",
+                "name", fired->name, "pumps", fired->pumps, "profile", fired->profile, "ms", (unsigned long)fired->duration_ms);
+            break;
+        }
+        default: {
+            break;
+        }
+    }
+
+    // Sockets belong to the httpd task, so the actual sending happens over there
+    msg->httpd = ctx->httpd;
+    msg->len = len;
+    if (len <= 0 || (size_t)len >= sizeof(msg->buf) || httpd_queue_work(ctx->httpd, live_broadcast, msg) != ESP_OK) {
+        free(msg);
+    }
+}
+
+void config_server::live_broadcast(void* _msg)
+{
+    auto *msg = (live_msg *)_msg;
+    int fds[CONFIG_LWIP_MAX_SOCKETS] = {};
+    size_t fd_cnt = std::size(fds);
+    if (httpd_get_client_list(msg->httpd, &fd_cnt, fds) == ESP_OK) {
+        httpd_ws_frame_t frame = {};
+        frame.type = HTTPD_WS_TYPE_TEXT;
+        frame.payload = (uint8_t *)msg->buf;
+        frame.len = msg->len;
+        for (size_t idx = 0; idx < fd_cnt; idx += 1) {
+            if (httpd_ws_get_fd_info(msg->httpd, fds[idx]) == HTTPD_WS_CLIENT_WEBSOCKET) {
+                httpd_ws_send_frame_async(msg->httpd, fds[idx], &frame);
+            }
+        }
+    }
+
+    free(msg);
+}
+
+int config_server::chunk_writer::print(const char* data, int data_len, void* _ctx)
+{
+    auto *ctx = (chunk_writer *)_ctx;
+    const int total_len = data_len;
+    while (data_len > 0 && ctx->err == ESP_OK) {
+        const int copy_len = data_len < (int)sizeof(buf) - ctx->len ? data_len : (int)sizeof(buf) - ctx->len;
+        memcpy(ctx->buf + ctx->len, data, copy_len);
+        ctx->len += copy_len;
+        data += copy_len;
+        data_len -= copy_len;
+
+        if (ctx->len == sizeof(buf)) {
+            ctx->err = httpd_resp_send_chunk(ctx->req, ctx->buf, ctx->len);
+            ctx->len = 0;
+        }
+    }
+
+    return ctx->err == ESP_OK ? total_len : 0;
+}
+
+esp_err_t config_server::chunk_writer::finish()
+{
+    if (err == ESP_OK && len > 0) {
+        err = httpd_resp_send_chunk(req, buf, len);
+        len = 0;
+    }
+
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "chunk_writer: send failed: 0x%x", err);
+        return err;
+    }
+
+    return httpd_resp_send_chunk(req, nullptr, 0);
+}
+
+ssize_t config_server::chunk_stream_write(void* _req, const char* buf, size_t len)
+{
+    auto *req = (httpd_req_t *)_req;
+    if (httpd_resp_send_chunk(req, buf, (ssize_t)len) != ESP_OK) {
+        return -1;
+    }
+
+    return (ssize_t)len;
+}
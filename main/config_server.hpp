@@ -1,8 +1,11 @@
 #pragma once
 
+#include <esp_event.h>
 #include <esp_http_server.h>
 
+#include "api_schema.hpp"
 #include "nvs.h"
+#include "sched_manager.hpp"
 
 class config_server
 {
@@ -10,18 +13,115 @@ public:
     esp_err_t init();
     esp_err_t stop();
 
+    using schedule_doc = api_schema::schedule_doc;
+    using pump_run_doc = api_schema::pump_run_doc;
+
 private:
+    static esp_err_t dispatch(httpd_req_t *req);
+    static bool is_authorized(httpd_req_t *req);
+    static esp_err_t send_unauthorized(httpd_req_t *req);
+    static esp_err_t pair_handler(httpd_req_t *req);
+    static esp_err_t get_route_stats_handler(httpd_req_t *req);
     static esp_err_t get_schedule_handler(httpd_req_t *req);
     static esp_err_t add_schedule_handler(httpd_req_t *req);
+    static esp_err_t update_schedule_handler(httpd_req_t *req);
+    static esp_err_t schedule_json_body(httpd_req_t *req, bool update);
+    static esp_err_t commit_schedule(httpd_req_t *req, const char *name, const sched_manager::cron_store_entry &entry, bool update = false);
     static esp_err_t remove_schedule_handler(httpd_req_t *req);
+    static esp_err_t export_schedules_handler(httpd_req_t *req);
+    static esp_err_t import_schedules_handler(httpd_req_t *req);
     static esp_err_t set_wifi_config_handler(httpd_req_t *req);
     static esp_err_t get_wifi_config_handler(httpd_req_t *req);
     static esp_err_t get_firmware_info_handler(httpd_req_t *req);
+    static esp_err_t get_status_handler(httpd_req_t *req);
+    static esp_err_t get_history_handler(httpd_req_t *req);
     static esp_err_t set_time_handler(httpd_req_t *req);
-    static esp_err_t index_handler(httpd_req_t *req);
+    static esp_err_t run_pump_handler(httpd_req_t *req);
+    static esp_err_t asset_handler(httpd_req_t *req);
     static esp_err_t ota_update_handler(httpd_req_t *req);
+    static esp_err_t get_ota_status_handler(httpd_req_t *req);
+    static esp_err_t send_ota_status(httpd_req_t *req, const char *status);
+    static esp_err_t get_pm_stats_handler(httpd_req_t *req);
+    static esp_err_t get_heap_stats_handler(httpd_req_t *req);
+    static esp_err_t get_wifi_stats_handler(httpd_req_t *req);
+    static esp_err_t get_trace_handler(httpd_req_t *req);
+    static esp_err_t flush_trace_handler(httpd_req_t *req);
+    static esp_err_t send_flash_trace(httpd_req_t *req);
+    static esp_err_t get_water_log_handler(httpd_req_t *req);
+    static esp_err_t live_handler(httpd_req_t *req);
+    static void live_event_handler(void *_ctx, esp_event_base_t evt_base, int32_t evt_id, void *evt_data);
+    static void live_broadcast(void *_msg);
+    static ssize_t chunk_stream_write(void *_req, const char *buf, size_t len);
+
+    // Embedded file served straight out of the memory-mapped flash
+    struct web_asset
+    {
+        const uint8_t *start;
+        const uint8_t *end;
+        const char *type;
+        const char *encoding; // nullptr if stored as-is
+        char etag[12]; // Quoted CRC32 of the stored bytes, filled in by init()
+    };
+
+    // mjson print sink, stages small writes and passes them on as whole HTTP chunks
+    struct chunk_writer
+    {
+        httpd_req_t *req;
+        esp_err_t err;
+        int len;
+        char buf[128];
+
+        static int print(const char *data, int data_len, void *_ctx);
+        esp_err_t finish();
+    };
+
+    static constexpr size_t LIVE_MSG_MAX_LEN = 128;
+
+    // One formatted live event on its way from the event loop to the httpd task
+    struct live_msg
+    {
+        httpd_handle_t httpd;
+        size_t len;
+        char buf[LIVE_MSG_MAX_LEN];
+    };
+
+    struct route
+    {
+        const char *uri;
+        httpd_method_t method;
+        esp_err_t (*handler)(httpd_req_t *req);
+        void *ctx = nullptr; // Handed to the handler as req->user_ctx
+        bool auth = false; // Changes device state, needs "Authorization: Bearer <pairing token>"
+        bool websocket = false;
+    };
+
+    // Per route, only ever updated from the httpd task
+    struct route_stats
+    {
+        uint32_t count;
+        uint32_t errors; // Handler returned anything but ESP_OK, i.e. the socket got closed
+        uint64_t total_us;
+        uint32_t max_us;
+    };
+
+    static web_asset assets[];
+    static const route routes[];
+    static route_stats stats[];
+    static constexpr size_t SCRATCH_LEN = 256;
+    static char scratch[SCRATCH_LEN]; // Handlers all run on the httpd task one at a time, so they share this instead of stack buffers
+    static esp_err_t send_asset_chunked(httpd_req_t *req, const web_asset &asset);
+
     httpd_handle_t httpd = nullptr;
     nvs_handle_t nvs = 0; // Not to be confused with scheduler's NVS - this is for misc configs (e.g. WiFi)
+    esp_event_handler_instance_t live_evt_handle = nullptr;
 
+    static constexpr size_t HTTPD_STACK_SIZE = 16384; // Unmeasured, so kept as it was - lower it only from /api/stats/heap readings taken after an import, a delta OTA and a waterlog dump
+    static constexpr uint16_t HTTPD_MAX_SOCKETS = 4; // One page load plus the live channel, LRU purge makes room for more
+    static constexpr size_t SCHEDULE_JSON_MAX_LEN = 256;
+    static constexpr size_t PUMP_JSON_MAX_LEN = 96;
+    static constexpr size_t SCHEDULE_IMPORT_MAX_LEN = 2048; // Enough for a full set with some whitespace
+    static constexpr size_t ASSET_CHUNK_SIZE = 1436; // One TCP segment at the default 1500 MTU
+    static constexpr char BEARER_PREFIX[] = "Bearer ";
+    static constexpr uint32_t OTA_RECV_MAX_TIMEOUTS = 3; // In a row, each one is httpd's recv_wait_timeout
     static constexpr char TAG[] = "cfg_server";
 };
@@ -98,6 +98,24 @@ esp_err_t hdc2080::reset() const
     return ret;
 }
 
+esp_err_t hdc2080::probe() const
+{
+    uint8_t id_low = 0, id_high = 0;
+    esp_err_t ret = read_reg(DEVICE_ID_LOW, &id_low, 1000);
+    ret = ret ?: read_reg(DEVICE_ID_HIGH, &id_high, 1000);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+
+    const uint16_t id = (uint16_t)((id_high << 8) | id_low);
+    if (id != DEVICE_ID) {
+        ESP_LOGE(TAG, "probe: unexpected device ID 0x%04x", id);
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    return ESP_OK;
+}
+
 esp_err_t hdc2080::set_measure_config(bool trigger, bool temperature_only, resolution humidity_res, resolution temp_res) const
 {
     uint8_t val = trigger ? 1 : 0;
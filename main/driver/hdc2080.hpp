@@ -42,6 +42,7 @@ public:
     esp_err_t read_humidity(float &rh_out) const;
     esp_err_t read_temperature(float &degc_out) const;
     esp_err_t reset() const;
+    esp_err_t probe() const;
     esp_err_t set_measure_config(bool trigger, bool temperature_only = false, resolution humidity_res = RES_14BIT, resolution temp_res = RES_14BIT) const;
 
 private:
@@ -52,5 +53,6 @@ private:
     i2c_master_dev_handle_t i2c_dev = nullptr;
 
     static constexpr uint8_t DEV_ADDR = 0x40;
+    static constexpr uint16_t DEVICE_ID = 0x07D0;
     static constexpr char TAG[] = "hdc2080";
 };
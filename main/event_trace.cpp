@@ -0,0 +1,117 @@
+#include <esp_attr.h>
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <spi_flash_mmap.h>
+
+#include "event_trace.hpp"
+
+void IRAM_ATTR event_trace::add(event_id event, uint16_t arg0, uint32_t arg1, uint32_t arg2)
+{
+    const auto now = (uint32_t)esp_timer_get_time();
+
+    portENTER_CRITICAL_SAFE(&lock);
+    auto &rec = records[write_seq % RECORD_COUNT];
+    rec.timestamp_us = now;
+    rec.event = event;
+    rec.arg0 = arg0;
+    rec.arg1 = arg1;
+    rec.arg2 = arg2;
+    write_seq += 1;
+    portEXIT_CRITICAL_SAFE(&lock);
+}
+
+size_t event_trace::read(uint32_t& seq, uint32_t end_seq, record* out, size_t max_cnt) const
+{
+    if (out == nullptr || max_cnt == 0) {
+        return 0;
+    }
+
+    size_t cnt = 0;
+    portENTER_CRITICAL(&lock);
+
+    // Anything older than one full ring has been overwritten already, skip ahead
+    if (write_seq - seq > RECORD_COUNT) {
+        seq = write_seq - RECORD_COUNT;
+    }
+
+    while (seq != end_seq && seq != write_seq && cnt < max_cnt) {
+        out[cnt] = records[seq % RECORD_COUNT];
+        seq += 1;
+        cnt += 1;
+    }
+
+    portEXIT_CRITICAL(&lock);
+    return cnt;
+}
+
+void event_trace::snapshot_range(uint32_t& first, uint32_t& end) const
+{
+    portENTER_CRITICAL(&lock);
+    end = write_seq;
+    first = write_seq > RECORD_COUNT ? write_seq - RECORD_COUNT : 0;
+    portEXIT_CRITICAL(&lock);
+}
+
+esp_err_t event_trace::flush_to_flash() const
+{
+    const esp_partition_t *part = flash_partition();
+    if (part == nullptr) {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    constexpr size_t snapshot_size = sizeof(dump_header) + sizeof(record) * RECORD_COUNT;
+    static_assert(snapshot_size <= 2 * SPI_FLASH_SEC_SIZE);
+    if (part->size < snapshot_size) {
+        ESP_LOGE(TAG, "flush: partition too small, %lu < %u", part->size, snapshot_size);
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    uint32_t seq = 0, end_seq = 0;
+    snapshot_range(seq, end_seq);
+
+    dump_header header = {};
+    header.magic = DUMP_MAGIC;
+    header.version = DUMP_VERSION;
+    header.record_size = sizeof(record);
+    header.record_count = end_seq - seq;
+    header.first_seq = seq;
+    header.now_us = (uint32_t)esp_timer_get_time();
+
+    esp_err_t ret = esp_partition_erase_range(part, 0, (snapshot_size + SPI_FLASH_SEC_SIZE - 1) & ~(SPI_FLASH_SEC_SIZE - 1));
+    ret = ret ?: esp_partition_write(part, 0, &header, sizeof(header));
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "flush: can't write header: 0x%x", ret);
+        return ret;
+    }
+
+    size_t offset = sizeof(header);
+    record batch[16];
+    size_t cnt = 0;
+    while ((cnt = read(seq, end_seq, batch, sizeof(batch) / sizeof(batch[0]))) > 0) {
+        ret = esp_partition_write(part, offset, batch, cnt * sizeof(record));
+        if (ret != ESP_OK) {
+            ESP_LOGE(TAG, "flush: can't write records: 0x%x", ret);
+            return ret;
+        }
+
+        offset += cnt * sizeof(record);
+    }
+
+    return ESP_OK;
+}
+
+esp_err_t event_trace::read_flash(size_t offset, void* out, size_t len) const
+{
+    const esp_partition_t *part = flash_partition();
+    if (part == nullptr) {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    return esp_partition_read(part, offset, out, len);
+}
+
+const esp_partition_t* event_trace::flash_partition()
+{
+    static const esp_partition_t *part = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, PARTITION_LABEL);
+    return part;
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <esp_err.h>
+#include <esp_partition.h>
+#include <freertos/FreeRTOS.h>
+
+class event_trace
+{
+public:
+    static event_trace &instance()
+    {
+        static event_trace _instance;
+        return _instance;
+    }
+
+    void operator=(event_trace const &) = delete;
+    event_trace(event_trace const &) = delete;
+
+    // Keep in sync with EVENTS in tools/trace_decode.py
+    enum event_id : uint16_t
+    {
+        TRACE_NONE = 0,
+        TRACE_SCHED_TRIGGER = 1, // arg0 = schedule index, arg1 = fire ID
+        TRACE_SCHED_ENQUEUED = 2, // arg0 = schedule index, arg1 = fire ID
+        TRACE_DISPATCH_DEQUEUED = 3, // arg0 = schedule index, arg1 = fire ID
+        TRACE_DISPATCH_PROFILE = 4, // arg0 = schedule index, arg1 = fire ID, arg2 = duration profile
+        TRACE_PUMP_RUN_BEGIN = 5, // arg0 = pump index, arg1 = duration in ms
+        TRACE_PUMP_TIMER_ARMED = 6, // arg0 = pump index, arg1 = duration in ms
+        TRACE_PUMP_MOTOR_ON = 7, // arg0 = pump index, arg1 = duration in ms, arg2 = esp_err_t
+        TRACE_DISPATCH_DONE = 8, // arg0 = schedule index, arg1 = fire ID
+        TRACE_PUMP_MOTOR_OFF = 9, // arg0 = pump index
+        TRACE_SENSE_SAMPLE = 10, // arg0 = accumulated reading count, arg1 = temperature in 0.01degC (signed), arg2 = RH in 0.01%
+        TRACE_SENSE_SLOT_COMMIT = 11, // arg0 = history slot index, arg1 = slot temperature in 0.01degC (signed), arg2 = slot RH in 0.01%
+        TRACE_SENSE_AVERAGE = 12, // arg0 = valid slot count, arg1 = average temperature in 0.01degC (signed), arg2 = average RH in 0.01%
+        TRACE_SCHED_PARSED = 13, // arg0 = schedule type, arg1 = pumps | DoW << 8 | hour << 16 | minute << 24 (or offset << 16), arg2 = moderate duration in ms
+        TRACE_SCHED_SET = 14, // arg0 = 1 if inserted, arg2 = esp_err_t
+        TRACE_SCHED_LOADED = 15, // arg0 = schedule count
+        TRACE_SCHED_LIST = 16, // arg0 = bytes written
+        TRACE_PUMP_TEST_MODE = 17, // arg0 = 1 if enabled
+        TRACE_SENSE_RESTORED = 18, // arg0 = valid slot count, arg1 = checkpoint age in seconds, arg2 = slots dropped as missed
+        TRACE_SCHED_REPLACED = 19, // arg0 = new schedule count, arg1 = old (loaded) schedule count, arg2 = esp_err_t
+        TRACE_OTA_SELF_TEST = 20, // arg0 = 1 if the image was pending verification, arg1 = self-test duration in ms, arg2 = esp_err_t
+        TRACE_SCHED_REJECTED = 21, // arg0 = 1 if found at load time (0 for API input), arg1 = blob size, arg2 = esp_err_t of the read
+        TRACE_NET_CONNECTED = 22, // arg0 = 1 if cached BSSID used | 2 if cached lease used, arg1 = radio start to IP in ms, arg2 = retries
+    };
+
+    struct __attribute__((packed)) record
+    {
+        uint32_t timestamp_us; // Lower 32 bits of esp_timer_get_time(), wraps every ~71 minutes
+        event_id event;
+        uint16_t arg0;
+        uint32_t arg1;
+        uint32_t arg2;
+    };
+
+    // Prepended to both the HTTP dump and the flash snapshot so the decoder doesn't have to guess the layout
+    struct __attribute__((packed)) dump_header
+    {
+        uint32_t magic;
+        uint8_t version;
+        uint8_t record_size;
+        uint16_t record_count; // The HTTP dump may end early if the ring overran while sending
+        uint32_t first_seq; // Sequence number of the first record, i.e. how many got overwritten before it
+        uint32_t now_us;
+    };
+
+    static constexpr uint32_t DUMP_MAGIC = 0x4352544d; // "MTRC"
+    static constexpr uint8_t DUMP_VERSION = 2; // 1 had the record_count bytes reserved (always 0)
+    static constexpr size_t RECORD_COUNT = 128;
+
+    void add(event_id event, uint16_t arg0 = 0, uint32_t arg1 = 0, uint32_t arg2 = 0);
+    size_t read(uint32_t &seq, uint32_t end_seq, record *out, size_t max_cnt) const;
+    void snapshot_range(uint32_t &first, uint32_t &end) const;
+
+    // Optional - only works if the partition table has a "trace" partition
+    esp_err_t flush_to_flash() const;
+    esp_err_t read_flash(size_t offset, void *out, size_t len) const;
+    static const esp_partition_t *flash_partition();
+
+private:
+    event_trace() = default;
+
+    mutable portMUX_TYPE lock = portMUX_INITIALIZER_UNLOCKED;
+    uint32_t write_seq = 0; // Total records ever written, the ring slot is write_seq % RECORD_COUNT
+    std::array<record, RECORD_COUNT> records = {};
+
+    static constexpr char PARTITION_LABEL[] = "trace";
+    static constexpr char TAG[] = "evt_trace";
+};
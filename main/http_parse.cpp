@@ -0,0 +1,105 @@
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <strings.h>
+
+#include "http_parse.hpp"
+
+namespace http_parse
+{
+    static bool is_space(char c)
+    {
+        return c == ' ' || c == '\t';
+    }
+
+    // Any non-zero digit in the weight makes it acceptable, "q=0", "q=0.0" and so on rule it out
+    static bool weight_nonzero(const char *pos, const char *end)
+    {
+        for (; pos < end; pos += 1) {
+            if (*pos >= '1' && *pos <= '9') {
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    bool accepts_encoding(const char *header, const char *coding)
+    {
+        if (header == nullptr) {
+            return true; // No header means any coding is fine
+        }
+
+        int explicit_ok = -1, wildcard_ok = -1;
+        const char *pos = header;
+        while (*pos != '\0') {
+            while (is_space(*pos) || *pos == ',') {
+                pos += 1;
+            }
+
+            const char *name = pos;
+            while (*pos != '\0' && *pos != ',' && *pos != ';' && !is_space(*pos)) {
+                pos += 1;
+            }
+
+            const size_t name_len = pos - name;
+            bool ok = true;
+            while (*pos != '\0' && *pos != ',') {
+                // Parameters, the only one defined is the q weight
+                if (*pos == ';') {
+                    pos += 1;
+                    while (is_space(*pos)) {
+                        pos += 1;
+                    }
+
+                    if ((*pos == 'q' || *pos == 'Q') && pos[1] == '=') {
+                        const char *weight = pos + 2;
+                        while (*pos != '\0' && *pos != ',' && *pos != ';') {
+                            pos += 1;
+                        }
+
+                        ok = weight_nonzero(weight, pos);
+                        continue;
+                    }
+                }
+
+                if (*pos != '\0' && *pos != ',') {
+                    pos += 1;
+                }
+            }
+
+            if (name_len == 1 && *name == '*') {
+                wildcard_ok = ok;
+            } else if (name_len > 0 && strncasecmp(name, coding, name_len) == 0 && coding[name_len] == '\0') {
+                explicit_ok = ok;
+            }
+        }
+
+        return explicit_ok >= 0 ? explicit_ok != 0 : wildcard_ok > 0;
+    }
+
+    // Parsed by hand since the scanf family is one of the deepest stack users on the httpd task
+    bool parse_content_range(const char *str, unsigned long &first, unsigned long &last, unsigned long &total)
+    {
+        if (strncmp(str, "bytes ", 6) != 0) {
+            return false;
+        }
+
+        char *end = nullptr;
+        const char *pos = str + 6;
+        first = strtoul(pos, &end, 10);
+        if (end == pos || *end != '-') {
+            return false;
+        }
+
+        pos = end + 1;
+        last = strtoul(pos, &end, 10);
+        if (end == pos || *end != '/') {
+            return false;
+        }
+
+        pos = end + 1;
+        total = strtoul(pos, &end, 10);
+        return end != pos && *end == '\0';
+    }
+}
@@ -0,0 +1,11 @@
+#pragma once
+
+// Request header parsing with no esp_http_server dependency, so it can be built and fuzzed on the host too
+namespace http_parse
+{
+    // Whether an Accept-Encoding value allows the given content coding, nullptr meaning the header wasn't sent
+    bool accepts_encoding(const char *header, const char *coding);
+
+    // "bytes <first>-<last>/<total>" as sent with each OTA chunk, without checking the numbers against each other
+    bool parse_content_range(const char *str, unsigned long &first, unsigned long &last, unsigned long &total);
+}
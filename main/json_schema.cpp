@@ -0,0 +1,260 @@
+#include <cstdlib>
+#include <cstring>
+
+#include "json_schema.hpp"
+
+namespace json_schema
+{
+    static constexpr size_t MAX_FIELDS = 32;
+
+    struct parse_ctx
+    {
+        const field *fields;
+        size_t field_cnt;
+        uint8_t *obj;
+        int depth;
+        int field_idx; // Field of the key just seen, -1 if unknown
+        uint8_t elem_idx;
+        uint32_t seen;
+        const char *error;
+    };
+
+    static int64_t load_int(const field &f, const uint8_t *ptr)
+    {
+        // Go through memcpy, most of the described structs are packed
+        switch (f.size) {
+            case 1: {
+                uint8_t val = 0;
+                memcpy(&val, ptr, sizeof(val));
+                return f.type == TYPE_INT ? (int64_t)(int8_t)val : (int64_t)val;
+            }
+            case 2: {
+                uint16_t val = 0;
+                memcpy(&val, ptr, sizeof(val));
+                return f.type == TYPE_INT ? (int64_t)(int16_t)val : (int64_t)val;
+            }
+            default: {
+                uint32_t val = 0;
+                memcpy(&val, ptr, sizeof(val));
+                return f.type == TYPE_INT ? (int64_t)(int32_t)val : (int64_t)val;
+            }
+        }
+    }
+
+    static void store_int(const field &f, uint8_t *ptr, int64_t val)
+    {
+        if (f.size == 1) {
+            const auto raw = (uint8_t)val;
+            memcpy(ptr, &raw, sizeof(raw));
+        } else if (f.size == 2) {
+            const auto raw = (uint16_t)val;
+            memcpy(ptr, &raw, sizeof(raw));
+        } else {
+            const auto raw = (uint32_t)val;
+            memcpy(ptr, &raw, sizeof(raw));
+        }
+    }
+
+    static int print_int(mjson_print_fn_t fn, void *fn_data, const field &f, const uint8_t *ptr)
+    {
+        const int64_t val = load_int(f, ptr);
+        return f.type == TYPE_INT ? mjson_printf(fn, fn_data, "%ld", (long)val) : mjson_printf(fn, fn_data, "%lu", (unsigned long)val);
+    }
+
+    int print_object(mjson_print_fn_t fn, void *fn_data, const field *fields, size_t field_cnt, const void *obj)
+    {
+        const auto *base = (const uint8_t *)obj;
+        int len = fn("{", 1, fn_data);
+        bool first = true;
+        for (size_t idx = 0; idx < field_cnt; idx += 1) {
+            const auto &f = fields[idx];
+            if (f.present != nullptr && !f.present(obj)) {
+                continue;
+            }
+
+            len += mjson_printf(fn, fn_data, first ? "%Q:" : ",%Q:", f.key);
+            first = false;
+
+            const uint8_t *ptr = base + f.offset;
+            if (f.type == TYPE_STRING) {
+                len += mjson_printf(fn, fn_data, "%.*Q", (int)strnlen((const char *)ptr, f.size), (const char *)ptr);
+            } else if (f.count == 1) {
+                len += print_int(fn, fn_data, f, ptr);
+            } else {
+                len += fn("[", 1, fn_data);
+                for (size_t elem = 0; elem < f.count; elem += 1) {
+                    len += elem == 0 ? 0 : fn(",", 1, fn_data);
+                    len += print_int(fn, fn_data, f, ptr + elem * f.size);
+                }
+                len += fn("]", 1, fn_data);
+            }
+        }
+
+        len += fn("}", 1, fn_data);
+        return len;
+    }
+
+    static const char *apply_value(parse_ctx *ctx, const field &f, int event, const char *tok, int len)
+    {
+        uint8_t *ptr = ctx->obj + f.offset;
+        if (f.type == TYPE_STRING) {
+            const int str_len = len - 2;
+            if (event != MJSON_TOK_STRING || str_len < f.min || str_len >= f.size || memchr(tok + 1, '\\', str_len) != nullptr) {
+                return "Invalid string";
+            }
+
+            memcpy(ptr, tok + 1, str_len);
+            ptr[str_len] = '\0';
+            return nullptr;
+        }
+
+        int64_t val = 0;
+        if (event == MJSON_TOK_NUMBER) {
+            // Copied out for strtoll, a number can be the last thing in the buffer with no delimiter after it
+            char num[24] = { 0 };
+            if (len >= (int)sizeof(num)) {
+                return "Value out of range";
+            }
+
+            memcpy(num, tok, len);
+            char *end = nullptr;
+            val = strtoll(num, &end, 10);
+            if (end != num + len) {
+                return "Integers only";
+            }
+        } else if (event == MJSON_TOK_STRING && f.aliases != nullptr) {
+            size_t idx = 0;
+            for (; idx < f.alias_cnt; idx += 1) {
+                if (strlen(f.aliases[idx].name) == (size_t)len - 2 && memcmp(tok + 1, f.aliases[idx].name, len - 2) == 0) {
+                    break;
+                }
+            }
+
+            if (idx >= f.alias_cnt) {
+                return "Unknown value";
+            }
+
+            val = f.aliases[idx].value;
+        } else {
+            return "Expecting a number";
+        }
+
+        if (val < f.min || val > f.max || (f.allowed != 0 && (val < 0 || val >= 32 || (f.allowed & (1UL << val)) == 0))) {
+            return "Value out of range";
+        }
+
+        store_int(f, ptr + ctx->elem_idx * f.size, val);
+        return nullptr;
+    }
+
+    static int parse_cb(int event, const char *buf, int offset, int len, void *_ctx)
+    {
+        auto *ctx = (parse_ctx *)_ctx;
+        const char *tok = buf + offset;
+        const field *f = ctx->field_idx < 0 ? nullptr : &ctx->fields[ctx->field_idx];
+
+        switch (event) {
+            case '{':
+            case '[': {
+                ctx->depth += 1;
+                if (f != nullptr && ctx->depth == 2 && (event == '{' || f->count == 1)) {
+                    ctx->error = "Unexpected nesting";
+                    return 1;
+                }
+                return 0;
+            }
+            case '}':
+            case ']': {
+                ctx->depth -= 1;
+                if (f != nullptr && ctx->depth == 1 && event == ']' && ctx->elem_idx != f->count) {
+                    ctx->error = "Wrong array length";
+                    return 1;
+                }
+                return 0;
+            }
+            case MJSON_TOK_KEY: {
+                // Only top level keys matter, anything nested under an unknown key gets skipped
+                ctx->field_idx = -1;
+                ctx->elem_idx = 0;
+                if (ctx->depth != 1) {
+                    return 0;
+                }
+
+                for (size_t idx = 0; idx < ctx->field_cnt; idx += 1) {
+                    const size_t key_len = strlen(ctx->fields[idx].key);
+                    if (key_len == (size_t)len - 2 && memcmp(tok + 1, ctx->fields[idx].key, key_len) == 0) {
+                        if ((ctx->seen & (1UL << idx)) != 0) {
+                            ctx->error = "Duplicate field";
+                            return 1;
+                        }
+
+                        ctx->field_idx = (int)idx;
+                        ctx->seen |= 1UL << idx;
+                        break;
+                    }
+                }
+                return 0;
+            }
+            default: {
+                break;
+            }
+        }
+
+        if (!MJSON_TOK_IS_VALUE(event) || f == nullptr) {
+            return 0;
+        }
+
+        if (f->count > 1) {
+            if (ctx->depth != 2) {
+                ctx->error = ctx->depth == 1 ? "Expecting an array" : nullptr;
+                return ctx->error != nullptr;
+            }
+
+            if (ctx->elem_idx >= f->count) {
+                ctx->error = "Wrong array length";
+                return 1;
+            }
+        } else if (ctx->depth != 1) {
+            return 0;
+        }
+
+        ctx->error = apply_value(ctx, *f, event, tok, len);
+        ctx->elem_idx += 1;
+        return ctx->error != nullptr;
+    }
+
+    const char *parse_object(const char *buf, int len, const field *fields, size_t field_cnt, void *obj)
+    {
+        if (field_cnt > MAX_FIELDS) {
+            return "Schema too large";
+        }
+
+        parse_ctx ctx = {};
+        ctx.fields = fields;
+        ctx.field_cnt = field_cnt;
+        ctx.obj = (uint8_t *)obj;
+        ctx.field_idx = -1;
+
+        if (mjson(buf, len, parse_cb, &ctx) < 0 && ctx.error == nullptr) {
+            return "Invalid JSON";
+        }
+
+        if (ctx.error != nullptr) {
+            return ctx.error;
+        }
+
+        // Which fields apply may depend on other fields (e.g. the schedule type), so only check once everything is in
+        for (size_t idx = 0; idx < field_cnt; idx += 1) {
+            const auto &f = fields[idx];
+            const bool present = f.present == nullptr || f.present(obj);
+            const bool seen = (ctx.seen & (1UL << idx)) != 0;
+            if (seen && !present) {
+                return "Unexpected field";
+            } else if (!seen && present && f.required) {
+                return "Missing field";
+            }
+        }
+
+        return nullptr;
+    }
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "mjson.h"
+
+// Constexpr field tables describing a struct's JSON shape, used both to print it and to parse it back in place
+namespace json_schema
+{
+    enum field_type : uint8_t
+    {
+        TYPE_UINT = 0, // size is 1, 2 or 4 bytes per element
+        TYPE_INT = 1,
+        TYPE_STRING = 2, // size is the char array capacity including the terminator
+    };
+
+    // Lets a string stand in for an integer on input, e.g. "dow" for ESP_SCHEDULE_TYPE_DAYS_OF_WEEK
+    struct alias
+    {
+        const char *name;
+        int32_t value;
+    };
+
+    struct field
+    {
+        const char *key;
+        field_type type;
+        uint8_t size;
+        uint8_t count = 1; // More than 1 makes it a fixed length JSON array
+        uint16_t offset;
+        int64_t min = 0; // Minimum length for strings
+        int64_t max = 0;
+        uint32_t allowed = 0; // Bit per allowed value for small enums, 0 to only check min/max
+        bool required = false;
+        bool (*present)(const void *obj) = nullptr; // Whether the field applies to this object, nullptr for always
+        const alias *aliases = nullptr;
+        uint8_t alias_cnt = 0;
+    };
+
+    int print_object(mjson_print_fn_t fn, void *fn_data, const field *fields, size_t field_cnt, const void *obj);
+
+    // Returns nullptr on success, or a short reason fit for an HTTP 400 body
+    const char *parse_object(const char *buf, int len, const field *fields, size_t field_cnt, void *obj);
+}
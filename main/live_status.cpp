@@ -0,0 +1,12 @@
+#include "live_status.hpp"
+
+ESP_EVENT_DEFINE_BASE(MISTY_STATUS_EVENTS);
+
+namespace live_status
+{
+    void post(event_id id, const void *data, size_t len)
+    {
+        // Never wait: posters include handlers on the default loop itself, and a dropped update only costs the UI a refresh
+        esp_event_post(MISTY_STATUS_EVENTS, id, data, len, 0);
+    }
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <esp_event.h>
+#include <nvs.h>
+
+ESP_EVENT_DECLARE_BASE(MISTY_STATUS_EVENTS);
+
+// State changes worth pushing to the web UI, posted on the default event loop and fanned out by config_server
+namespace live_status
+{
+    enum event_id : int32_t
+    {
+        STATUS_PUMP = 0, // pump_state
+        STATUS_AIR = 1, // air_state
+        STATUS_SCHEDULE_FIRED = 2, // schedule_fired
+    };
+
+    struct pump_state
+    {
+        uint8_t pumps; // Same bits as sched_manager::pump_bits
+        bool running;
+        uint32_t duration_ms; // Planned run time when starting, actual run time when stopping
+    };
+
+    struct air_state
+    {
+        float temperature;
+        float humidity;
+        uint16_t valid_slots;
+    };
+
+    struct schedule_fired
+    {
+        char name[NVS_KEY_NAME_MAX_SIZE];
+        uint8_t pumps;
+        uint8_t profile; // sched_manager::duration_profile
+        uint32_t duration_ms;
+    };
+
+    void post(event_id id, const void *data, size_t len);
+}
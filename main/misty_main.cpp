@@ -1,17 +1,32 @@
 #include "esp_log.h"
 #include <esp_err.h>
+#include <esp_timer.h>
 #include <nvs.h>
 #include <nvs_flash.h>
 #include <hal/gpio_ll.h>
 
 #include "air_sensor.hpp"
+#include "auth_token.hpp"
 #include "net_configurator.hpp"
+#include "ota_manager.hpp"
+#include "power_stats.hpp"
 #include "pump_manager.hpp"
 #include "sched_manager.hpp"
+#include "water_log.hpp"
 #include "pin_defs.hpp"
 
 #define TAG "main"
 
+// On a new image's first boot, roll back straight away instead of crash looping until the bootloader gives up on it
+static void self_test_step(esp_err_t ret, const char *step)
+{
+    if (ret != ESP_OK) {
+        ota_manager::instance().fail_self_test(ret, step);
+    }
+
+    ESP_ERROR_CHECK(ret);
+}
+
 extern "C" void app_main(void)
 {
     if (gpio_ll_get_level(&GPIO, misty::PUMP_TRIG_BTN_PIN) == 0 && gpio_ll_get_level(&GPIO, misty::CONFIG_BTN_PIN) == 0) {
@@ -35,16 +50,25 @@ extern "C" void app_main(void)
     ESP_ERROR_CHECK(ret);
     ESP_LOGI(TAG, "Config loaded");
 
-    ESP_ERROR_CHECK(air_sensor::instance().init());
+    // Everything from here on is the post-OTA self-test, it has to pass before a new image is kept
+    const int64_t self_test_start_us = esp_timer_get_time();
+    self_test_step(power_stats::instance().init(), "power stats");
+    self_test_step(water_log::instance().init(), "water log");
+
+    self_test_step(air_sensor::instance().init(), "sensor");
     ESP_LOGI(TAG, "Sensor loaded");
 
-    ESP_ERROR_CHECK(net_configurator::instance().init());
+    // The AP password is derived from the pairing token, so it has to be ready before the network comes up
+    self_test_step(auth_token::instance().init(), "pairing token");
+    self_test_step(net_configurator::instance().init(), "network");
     ESP_LOGI(TAG, "Net config loaded");
 
-    ESP_ERROR_CHECK(misty::setup_input_interrupts());
-    ESP_ERROR_CHECK(pump_manager::instance().init());
+    self_test_step(misty::setup_input_interrupts(), "inputs");
+    self_test_step(pump_manager::instance().init(), "pump");
     ESP_LOGI(TAG, "Pump loaded");
 
-    ESP_ERROR_CHECK(sched_manager::instance().init());
+    self_test_step(sched_manager::instance().init(), "schedules");
     ESP_LOGI(TAG, "Schedule manager loaded");
+
+    ota_manager::instance().confirm_boot(self_test_start_us);
 }
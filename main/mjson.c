@@ -34,7 +34,7 @@
 #define isnan(x) _isnan(x)
 #endif
 
-static double mystrtod(const char *str, const char **end);
+static double mystrtod(const char *str, int len, const char **end);
 
 static int mjson_esc(int c, int esc) {
   const char *p, *esc1 = "\b\f\n\r\t\\\"", *esc2 = "bfnrt\\\"";
@@ -111,7 +111,7 @@ int mjson(const char *s, int len, mjson_cb_t cb, void *ud) {
           tok = MJSON_TOK_FALSE;
         } else if (c == '-' || ((c >= '0' && c <= '9'))) {
           const char *end = NULL;
-          mystrtod(&s[i], &end);
+          mystrtod(&s[i], len - i, &end);
           if (end != NULL) i += (int) (end - &s[i] - 1);
           tok = MJSON_TOK_NUMBER;
         } else if (c == '"') {
@@ -222,7 +222,7 @@ static int mjson_get_cb(int tok, const char *s, int off, int len, void *ud) {
     if (d->d1 == d->d2) d->obj = off;
     if (d->d1 == d->d2 && tok == '[' && d->path[d->pos] == '[') {
       d->i1 = 0;
-      d->i2 = (int) mystrtod(&d->path[d->pos + 1], NULL);
+      d->i2 = (int) mystrtod(&d->path[d->pos + 1], (int) strlen(&d->path[d->pos + 1]), NULL);
       if (d->i1 == d->i2) {
         while (d->path[d->pos] && d->path[d->pos] != ']') d->pos++;
         if (d->path[d->pos] == ']') d->pos++;
@@ -285,7 +285,7 @@ int mjson_get_number(const char *s, int len, const char *path, double *v) {
   const char *p;
   int tok, n;
   if ((tok = mjson_find(s, len, path, &p, &n)) == MJSON_TOK_NUMBER) {
-    if (v != NULL) *v = mystrtod(p, NULL);
+    if (v != NULL) *v = mystrtod(p, n, NULL);
   }
   return tok == MJSON_TOK_NUMBER ? 1 : 0;
 }
@@ -738,39 +738,42 @@ static int is_digit(int c) {
 }
 
 /* NOTE: strtod() implementation by Yasuhiro Matsumoto. */
-static double mystrtod(const char *str, const char **end) {
+/* Reads at most len bytes, mjson() is handed buffers with no terminator. */
+#define MYSTRTOD_AT(q) ((q) < lim ? *(q) : '\0')
+static double mystrtod(const char *str, int len, const char **end) {
+  const char *lim = str + len;
   double d = 0.0;
   int sign = 1, n = 0;
   const char *p = str, *a = str;
 
   /* decimal part */
-  if (*p == '-') {
+  if (MYSTRTOD_AT(p) == '-') {
     sign = -1;
     ++p;
-  } else if (*p == '+') {
+  } else if (MYSTRTOD_AT(p) == '+') {
     ++p;
   }
-  if (is_digit(*p)) {
+  if (is_digit(MYSTRTOD_AT(p))) {
     d = (double) (*p++ - '0');
-    while (*p && is_digit(*p)) {
+    while (is_digit(MYSTRTOD_AT(p))) {
       d = d * 10.0 + (double) (*p - '0');
       ++p;
       ++n;
     }
     a = p;
-  } else if (*p != '.') {
+  } else if (MYSTRTOD_AT(p) != '.') {
     goto done;
   }
   d *= sign;
 
   /* fraction part */
-  if (*p == '.') {
+  if (MYSTRTOD_AT(p) == '.') {
     double f = 0.0;
     double base = 0.1;
     ++p;
 
-    if (is_digit(*p)) {
-      while (*p && is_digit(*p)) {
+    if (is_digit(MYSTRTOD_AT(p))) {
+      while (is_digit(MYSTRTOD_AT(p))) {
         f += base * (*p - '0');
         base /= 10.0;
         ++p;
@@ -782,12 +785,12 @@ static double mystrtod(const char *str, const char **end) {
   }
 
   /* exponential part */
-  if ((*p == 'E') || (*p == 'e')) {
+  if ((MYSTRTOD_AT(p) == 'E') || (MYSTRTOD_AT(p) == 'e')) {
     int i, e = 0, neg = 0;
     p++;
-    if (*p == '-') p++, neg++;
-    if (*p == '+') p++;
-    while (is_digit(*p)) e = e * 10 + *p++ - '0';
+    if (MYSTRTOD_AT(p) == '-') p++, neg++;
+    if (MYSTRTOD_AT(p) == '+') p++;
+    while (is_digit(MYSTRTOD_AT(p))) e = e * 10 + *p++ - '0';
     if (neg) e = -e;
 #if 0
     if (d == 2.2250738585072011 && e == -308) {
@@ -813,6 +816,7 @@ done:
   if (end) *end = a;
   return d;
 }
+#undef MYSTRTOD_AT
 
 #if MJSON_ENABLE_MERGE
 int mjson_merge(const char *s, int n, const char *s2, int n2,
@@ -3,9 +3,17 @@
 #include <esp_netif_sntp.h>
 #include "net_configurator.hpp"
 
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <esp_attr.h>
 #include <esp_mac.h>
+#include <esp_rom_crc.h>
+#include <esp_timer.h>
 
+#include "auth_token.hpp"
 #include "config_server.hpp"
+#include "event_trace.hpp"
 #include "esp_log.h"
 #include "esp_wifi.h"
 #include "nvs_flash.h"
@@ -13,6 +21,8 @@
 
 ESP_EVENT_DEFINE_BASE(NET_CFG_EVENTS);
 
+RTC_NOINIT_ATTR net_configurator::link_cache net_configurator::rtc_cache;
+
 esp_err_t net_configurator::init()
 {
     net_events = xEventGroupCreate();
@@ -33,10 +43,42 @@ esp_err_t net_configurator::init()
         return ESP_ERR_NO_MEM;
     }
 
+    lease_timer = xTimerCreate("net_lease", LEASE_CHECK_TICKS, pdFALSE, this, lease_timer_cb);
+    if (lease_timer == nullptr) {
+        ESP_LOGE(TAG, "Failed to create lease check timer");
+        return ESP_ERR_NO_MEM;
+    }
+
+    ap_secure_timer = xTimerCreate("net_ap_secure", pdMS_TO_TICKS(auth_token::PAIR_WINDOW_MS), pdFALSE, this, ap_secure_timer_cb);
+    if (ap_secure_timer == nullptr) {
+        ESP_LOGE(TAG, "Failed to create AP secure timer");
+        return ESP_ERR_NO_MEM;
+    }
+
+    if (nvs_open(NVS_NAMESPACE, NVS_READWRITE, &nvs) != ESP_OK) {
+        ESP_LOGW(TAG, "init: can't open NVS, link cache won't survive power loss");
+        nvs = 0;
+    }
+
+    // RTC memory is the freshest copy, NVS is the fallback after a power loss
+    if (link_cache_valid(rtc_cache)) {
+        cache = rtc_cache;
+    } else if (nvs != 0) {
+        size_t len = sizeof(cache);
+        if (nvs_get_blob(nvs, NVS_LINK_KEY, &cache, &len) != ESP_OK || len != sizeof(cache) || !link_cache_valid(cache)) {
+            cache = {};
+        }
+    }
+
+    uint8_t static_flag = 0;
+    if (nvs != 0 && nvs_get_u8(nvs, NVS_STATIC_IP_KEY, &static_flag) == ESP_OK) {
+        static_ip = static_flag != 0;
+    }
+
     esp_netif_init();
     esp_event_loop_create_default();
     esp_netif_create_default_wifi_ap();
-    esp_netif_create_default_wifi_sta();
+    sta_netif = esp_netif_create_default_wifi_sta();
 
     wifi_init_config_t init_cfg = WIFI_INIT_CONFIG_DEFAULT();
     esp_err_t ret = esp_wifi_init(&init_cfg);
@@ -77,33 +119,31 @@ esp_err_t net_configurator::load_wifi()
     if (strnlen((char *)wifi_cfg.sta.ssid, sizeof(wifi_config_t::sta.ssid)) == 0) {
         ESP_LOGW(TAG, "load_wifi: invalid STA, starting AP now");
 
-        uint8_t mac_addr[6] = { 0 };
-        esp_read_mac(mac_addr, ESP_MAC_WIFI_STA);
-        int len = snprintf((char *)wifi_cfg.ap.ssid, sizeof(wifi_cfg.ap.ssid), "misty-%02x%02x%02x", mac_addr[3], mac_addr[4], mac_addr[5]);
-        if (len < 5) {
-            ESP_LOGW(TAG, "load_wifi: failed to concat WiFi AP SSID (might be bug?)");
-            strlcpy((char *)wifi_cfg.ap.ssid, "misty", 32);
-        } else {
-            wifi_cfg.ap.ssid_len = (uint8_t)len;
-        }
-
-        wifi_cfg.ap.authmode = WIFI_AUTH_OPEN;
-        wifi_cfg.ap.ssid_hidden = 0;
-
+        const bool open = ap_open_pending;
+        ap_open_pending = false;
         ret = esp_wifi_set_mode(WIFI_MODE_APSTA);
-        ret = ret ?: esp_wifi_set_config(WIFI_IF_AP, &wifi_cfg);
+        ret = ret ?: apply_ap_config(open);
         ret = ret ?: esp_wifi_start();
         if (ret != ESP_OK) {
             ESP_LOGE(TAG, "load_wifi: can't start WiFi AP: 0x%x", ret);
             return ret;
         }
 
-        ESP_LOGI(TAG, "load_wifi: WiFi AP started");
+        if (open && xTimerReset(ap_secure_timer, pdMS_TO_TICKS(1000)) == pdFAIL) {
+            ESP_LOGE(TAG, "load_wifi: can't arm AP secure timer, securing AP now");
+            apply_ap_config(false);
+        }
+
+        auth_token::instance().open_pairing();
         server.init();
         xEventGroupSetBits(net_events, NET_CFG_STATE_WIFI_AP_ENABLED);
     } else {
         ESP_LOGI(TAG, "load_wifi: has valid config for SSID %s", wifi_cfg.sta.ssid);
+        retry_cnt = 0;
+        connect_pending = true;
+        radio_start_us = esp_timer_get_time();
         ret = esp_wifi_set_mode(WIFI_MODE_STA);
+        ret = ret ?: apply_link_cache(wifi_cfg);
         ret = ret ?: esp_wifi_start();
         ret = ret ?: esp_wifi_set_inactive_time(WIFI_IF_STA, 6); // Might tune this later, see https://github.com/espressif/esp-idf/blob/v5.5.1/examples/wifi/power_save/main/Kconfig.projbuild#L35
         ret = ret ?: esp_wifi_set_ps(WIFI_PS_MAX_MODEM);
@@ -120,9 +160,20 @@ esp_err_t net_configurator::load_wifi()
     return ret;
 }
 
-esp_err_t net_configurator::set_wifi_config(wifi_config_t* config)
+esp_err_t net_configurator::set_wifi_config(wifi_config_t* config, bool _static_ip)
 {
     ESP_LOGI(TAG, "Got new WiFi config!");
+    if (nvs != 0 && _static_ip != static_ip) {
+        esp_err_t ret = nvs_set_u8(nvs, NVS_STATIC_IP_KEY, _static_ip ? 1 : 0);
+        ret = ret ?: nvs_commit(nvs);
+        if (ret != ESP_OK) {
+            ESP_LOGW(TAG, "set_wifi: can't save static IP flag: 0x%x", ret);
+        }
+    }
+
+    static_ip = _static_ip;
+    drop_link_cache(); // Whatever we knew belongs to the old network
+
     auto ret = esp_wifi_set_config(WIFI_IF_STA, config);
     ret = ret ?: esp_wifi_stop();
     ret = ret ?: load_wifi();
@@ -130,6 +181,161 @@ esp_err_t net_configurator::set_wifi_config(wifi_config_t* config)
     return ret;
 }
 
+esp_err_t net_configurator::apply_ap_config(bool open)
+{
+    wifi_config_t wifi_cfg = {};
+    uint8_t mac_addr[6] = { 0 };
+    esp_read_mac(mac_addr, ESP_MAC_WIFI_STA);
+    int len = snprintf((char *)wifi_cfg.ap.ssid, sizeof(wifi_cfg.ap.ssid), "misty-%02x%02x%02x", mac_addr[3], mac_addr[4], mac_addr[5]);
+    if (len < 5) {
+        ESP_LOGW(TAG, "ap_config: failed to concat WiFi AP SSID (might be bug?)");
+        strlcpy((char *)wifi_cfg.ap.ssid, "misty", 32);
+    } else {
+        wifi_cfg.ap.ssid_len = (uint8_t)len;
+    }
+
+    // Open only for the pairing window after a config button press, which is how a client without serial access
+    // gets the token and the WPA2 password. The rest of the time anyone in range could reconfigure the device.
+    if (open) {
+        wifi_cfg.ap.authmode = WIFI_AUTH_OPEN;
+    } else {
+        strlcpy((char *)wifi_cfg.ap.password, auth_token::instance().ap_password(), sizeof(wifi_cfg.ap.password));
+        wifi_cfg.ap.authmode = WIFI_AUTH_WPA2_PSK;
+    }
+
+    wifi_cfg.ap.pmf_cfg.required = false;
+    wifi_cfg.ap.ssid_hidden = 0;
+
+    esp_err_t ret = esp_wifi_set_config(WIFI_IF_AP, &wifi_cfg);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "ap_config: can't set AP config: 0x%x", ret);
+        return ret;
+    }
+
+    ESP_LOGI(TAG, "ap_config: WiFi AP %s is %s", wifi_cfg.ap.ssid, open ? "open for pairing" : "WPA2");
+    return ESP_OK;
+}
+
+esp_err_t net_configurator::apply_link_cache(wifi_config_t& wifi_cfg)
+{
+    // The driver may still hold the BSSID from the last fast connect, so this always rewrites the lot
+    const bool fast = link_cache_valid(cache);
+    wifi_cfg.sta.bssid_set = fast;
+    memcpy(wifi_cfg.sta.bssid, cache.bssid, sizeof(wifi_cfg.sta.bssid));
+    wifi_cfg.sta.channel = cache.channel;
+    wifi_cfg.sta.scan_method = fast ? WIFI_FAST_SCAN : WIFI_ALL_CHANNEL_SCAN;
+
+    // RAM only, so the flash copy stays plain credentials and a stale BSSID can't outlive a reboot
+    esp_err_t ret = esp_wifi_set_storage(WIFI_STORAGE_RAM);
+    ret = ret ?: esp_wifi_set_config(WIFI_IF_STA, &wifi_cfg);
+    esp_wifi_set_storage(WIFI_STORAGE_FLASH);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "apply_cache: can't set STA config: 0x%x", ret);
+        return ret;
+    }
+
+    connecting_fast = fast;
+    lease_reused = fast && static_ip && cache.ip != 0;
+    if (fast) {
+        ESP_LOGI(TAG, "apply_cache: fast connect to " MACSTR " on channel %u%s", MAC2STR(cache.bssid), cache.channel,
+            lease_reused ? ", reusing lease" : "");
+    }
+
+    return ESP_OK;
+}
+
+esp_err_t net_configurator::set_cached_ip()
+{
+    esp_netif_dhcp_status_t status = ESP_NETIF_DHCP_INIT;
+    esp_netif_ip_info_t ip_info = {};
+    esp_err_t ret = esp_netif_dhcpc_get_status(sta_netif, &status);
+    ret = ret ?: esp_netif_get_ip_info(sta_netif, &ip_info);
+    if (ret == ESP_OK && status == ESP_NETIF_DHCP_STOPPED && ip_info.ip.addr == cache.ip
+        && ip_info.netmask.addr == cache.netmask && ip_info.gw.addr == cache.gw) {
+        return ESP_OK; // Still set from the last sync, and the netif already announced it on connect
+    }
+
+    ip_info.ip.addr = cache.ip;
+    ip_info.netmask.addr = cache.netmask;
+    ip_info.gw.addr = cache.gw;
+
+    esp_netif_dns_info_t dns = {};
+    dns.ip.type = ESP_IPADDR_TYPE_V4;
+    dns.ip.u_addr.ip4.addr = cache.dns;
+
+    // With the DHCP client stopped, setting the address is what posts IP_EVENT_STA_GOT_IP
+    ret = esp_netif_dhcpc_stop(sta_netif);
+    ret = ret == ESP_ERR_ESP_NETIF_DHCP_ALREADY_STOPPED ? ESP_OK : ret;
+    ret = ret ?: esp_netif_set_ip_info(sta_netif, &ip_info);
+    ret = ret ?: (cache.dns != 0 ? esp_netif_set_dns_info(sta_netif, ESP_NETIF_DNS_MAIN, &dns) : ESP_OK);
+    return ret;
+}
+
+void net_configurator::drop_link_cache()
+{
+    cache = {};
+    rtc_cache = {};
+    connecting_fast = false;
+    lease_reused = false;
+    if (nvs == 0) {
+        return;
+    }
+
+    esp_err_t ret = nvs_erase_key(nvs, NVS_LINK_KEY);
+    ret = ret == ESP_ERR_NVS_NOT_FOUND ? ESP_OK : (ret ?: nvs_commit(nvs));
+    if (ret != ESP_OK) {
+        ESP_LOGW(TAG, "drop_cache: can't erase NVS copy: 0x%x", ret);
+    }
+}
+
+void net_configurator::save_link_cache(const esp_netif_ip_info_t& ip_info)
+{
+    wifi_ap_record_t ap = {};
+    if (esp_wifi_sta_get_ap_info(&ap) != ESP_OK) {
+        return;
+    }
+
+    esp_netif_dns_info_t dns = {};
+    esp_netif_get_dns_info(sta_netif, ESP_NETIF_DNS_MAIN, &dns);
+
+    link_cache fresh = {};
+    fresh.magic = LINK_CACHE_MAGIC;
+    memcpy(fresh.bssid, ap.bssid, sizeof(fresh.bssid));
+    fresh.channel = ap.primary;
+    fresh.ip = ip_info.ip.addr;
+    fresh.netmask = ip_info.netmask.addr;
+    fresh.gw = ip_info.gw.addr;
+    fresh.dns = dns.ip.u_addr.ip4.addr;
+    fresh.crc = link_cache_crc(fresh);
+    rtc_cache = fresh;
+
+    // Same AP, same lease: nothing to write, which is every sync on a quiet network
+    if (memcmp(&fresh, &cache, sizeof(fresh)) == 0) {
+        return;
+    }
+
+    cache = fresh;
+    if (nvs == 0) {
+        return;
+    }
+
+    esp_err_t ret = nvs_set_blob(nvs, NVS_LINK_KEY, &fresh, sizeof(fresh));
+    ret = ret ?: nvs_commit(nvs);
+    if (ret != ESP_OK) {
+        ESP_LOGW(TAG, "save_cache: can't write NVS: 0x%x", ret);
+    }
+}
+
+bool net_configurator::link_cache_valid(const link_cache& entry)
+{
+    return entry.magic == LINK_CACHE_MAGIC && entry.channel != 0 && entry.crc == link_cache_crc(entry);
+}
+
+uint32_t net_configurator::link_cache_crc(const link_cache& entry)
+{
+    return esp_rom_crc32_le(0, (const uint8_t *)&entry, offsetof(link_cache, crc));
+}
+
 bool net_configurator::wifi_has_station_config()
 {
     wifi_config_t wifi_cfg = {};
@@ -161,6 +367,20 @@ void net_configurator::wifi_evt_handler(void* _ctx, esp_event_base_t evt_base, i
             case WIFI_EVENT_STA_DISCONNECTED:
             case WIFI_EVENT_STA_START: {
                 xEventGroupClearBits(ctx->net_events, NET_CFG_STATE_GOT_IP);
+                if (evt_id == WIFI_EVENT_STA_DISCONNECTED && ctx->connecting_fast) {
+                    // AP moved or went away - forget it and do the full scan (and DHCP) on the remaining retries
+                    ESP_LOGW(TAG, "Fast connect failed, falling back to scan");
+                    ctx->stats.fallbacks += 1;
+                    ctx->drop_link_cache();
+
+                    wifi_config_t wifi_cfg = {};
+                    ret = esp_wifi_get_config(WIFI_IF_STA, &wifi_cfg);
+                    ret = ret ?: ctx->apply_link_cache(wifi_cfg);
+                    if (ret != ESP_OK) {
+                        ESP_LOGE(TAG, "Can't reset STA config: 0x%x", ret);
+                    }
+                }
+
                 if (ctx->retry_cnt < MAX_RETRY_COUNT) {
                     esp_wifi_connect();
                 }
@@ -170,6 +390,10 @@ void net_configurator::wifi_evt_handler(void* _ctx, esp_event_base_t evt_base, i
 
             case WIFI_EVENT_STA_CONNECTED: {
                 ESP_LOGI(TAG, "WiFi connected");
+                ret = ctx->lease_reused ? ctx->set_cached_ip() : esp_netif_dhcpc_start(ctx->sta_netif);
+                if (ret != ESP_OK && ret != ESP_ERR_ESP_NETIF_DHCP_ALREADY_STARTED) {
+                    ESP_LOGE(TAG, "Can't set up IP: 0x%x", ret);
+                }
                 break;
             }
 
@@ -200,6 +424,31 @@ void net_configurator::wifi_evt_handler(void* _ctx, esp_event_base_t evt_base, i
         ESP_LOGI(TAG, "Got IP: " IPSTR, IP2STR(&event->ip_info.ip));
         ESP_LOGI(TAG, "Got IP Gateway: " IPSTR, IP2STR(&event->ip_info.gw));
 
+        if (ctx->connect_pending) {
+            const auto took_ms = (uint32_t)((esp_timer_get_time() - ctx->radio_start_us) / 1000);
+            auto &stats = ctx->stats;
+            stats.last_ms = took_ms;
+            stats.min_ms = stats.connects == 0 ? took_ms : std::min(stats.min_ms, took_ms);
+            stats.max_ms = std::max(stats.max_ms, took_ms);
+            stats.connects += 1;
+            stats.fast_connects += ctx->connecting_fast ? 1 : 0;
+            stats.last_fast = ctx->connecting_fast;
+            stats.last_static = ctx->lease_reused;
+            ESP_LOGI(TAG, "Connected in %lu ms (%s)", took_ms, ctx->connecting_fast ? "fast" : "scan");
+            event_trace::instance().add(event_trace::TRACE_NET_CONNECTED,
+                (ctx->connecting_fast ? 1 : 0) | (ctx->lease_reused ? 2 : 0), took_ms, ctx->retry_cnt);
+
+            ctx->connect_pending = false;
+            ctx->connecting_fast = false;
+            ctx->retry_cnt = 0;
+        }
+
+        // A reused lease is only trusted once SNTP gets through, see NET_CFG_EVENT_LEASE_STALE
+        ctx->save_link_cache(event->ip_info);
+        if (ctx->lease_reused && xTimerReset(ctx->lease_timer, pdMS_TO_TICKS(1000)) == pdFAIL) {
+            ESP_LOGE(TAG, "wifi_evt: can't start lease timer");
+        }
+
         xEventGroupSetBits(ctx->net_events, NET_CFG_STATE_GOT_IP);
         esp_netif_tcpip_exec(lwip_sntp_stop_cb, nullptr);
         esp_netif_sntp_deinit();
@@ -223,6 +472,10 @@ void net_configurator::net_cfg_evt_handler(void* _ctx, esp_event_base_t evt_base
     switch (evt_id) {
         case NET_CFG_EVENT_FORCE_WIFI_STOP: {
             ESP_LOGI(TAG, "WiFi stop requested");
+            xTimerStop(ctx->lease_timer, 0);
+            xTimerStop(ctx->ap_secure_timer, 0);
+            ctx->connect_pending = false;
+            ctx->connecting_fast = false; // Being cut off isn't the cached AP's fault
             esp_wifi_stop();
 
             esp_netif_tcpip_exec(lwip_sntp_stop_cb, nullptr);
@@ -247,6 +500,8 @@ void net_configurator::net_cfg_evt_handler(void* _ctx, esp_event_base_t evt_base
             }
 
             ctx->manual_config = true;
+            ctx->ap_open_pending = !wifi_has_station_config(); // The setup AP goes without a password for the pairing window
+            auth_token::instance().open_pairing(); // The button press is the proof of physical access
             ret = ctx->load_wifi();
             if (ret != ESP_OK) {
                 ESP_LOGI(TAG, "WiFi start failed: 0x%x", ret);
@@ -273,11 +528,38 @@ void net_configurator::net_cfg_evt_handler(void* _ctx, esp_event_base_t evt_base
         }
         case NET_CFG_EVENT_WIFI_SYNC_DONE: {
             ESP_LOGW(TAG, "WIFI Sync done");
+            xTimerStop(ctx->lease_timer, 0);
             xEventGroupSetBits(ctx->net_events, NET_CFG_STATE_SYNC_DONE);
             esp_netif_tcpip_exec(lwip_sntp_stop_cb, nullptr);
             esp_netif_sntp_deinit();
             if (!ctx->manual_config) {
                 esp_wifi_stop(); // Just stop for now
+                ctx->stats.last_sync_ms = (uint32_t)((esp_timer_get_time() - ctx->radio_start_us) / 1000);
+                ESP_LOGI(TAG, "Sync took %lu ms of radio time", ctx->stats.last_sync_ms);
+            }
+
+            break;
+        }
+        case NET_CFG_EVENT_LEASE_STALE: {
+            // Most likely the lease went to someone else while we were off, so ask DHCP properly this time
+            ESP_LOGW(TAG, "No time sync on the reused lease, back to DHCP");
+            ctx->stats.fallbacks += 1;
+            ctx->drop_link_cache();
+            xEventGroupClearBits(ctx->net_events, NET_CFG_STATE_GOT_IP);
+            ret = esp_netif_dhcpc_start(ctx->sta_netif);
+            if (ret != ESP_OK && ret != ESP_ERR_ESP_NETIF_DHCP_ALREADY_STARTED) {
+                ESP_LOGE(TAG, "Can't restart DHCP: 0x%x", ret);
+                esp_event_post(NET_CFG_EVENTS, NET_CFG_EVENT_FORCE_WIFI_STOP, nullptr, 0, pdMS_TO_TICKS(3000));
+            }
+
+            break;
+        }
+        case NET_CFG_EVENT_AP_SECURE: {
+            // Nothing to do if the client already set up a network and the AP went away with it
+            wifi_mode_t mode = WIFI_MODE_NULL;
+            if (esp_wifi_get_mode(&mode) == ESP_OK && mode == WIFI_MODE_APSTA) {
+                ESP_LOGI(TAG, "Pairing window over, setup AP back to WPA2");
+                ctx->apply_ap_config(false);
             }
 
             break;
@@ -299,6 +581,16 @@ void net_configurator::wifi_sync_timer_cb(TimerHandle_t timer)
     esp_event_post(NET_CFG_EVENTS, NET_CFG_EVENT_WIFI_START_SYNC, nullptr, 0, pdMS_TO_TICKS(1000));
 }
 
+void net_configurator::lease_timer_cb(TimerHandle_t timer)
+{
+    esp_event_post(NET_CFG_EVENTS, NET_CFG_EVENT_LEASE_STALE, nullptr, 0, pdMS_TO_TICKS(1000));
+}
+
+void net_configurator::ap_secure_timer_cb(TimerHandle_t timer)
+{
+    esp_event_post(NET_CFG_EVENTS, NET_CFG_EVENT_AP_SECURE, nullptr, 0, pdMS_TO_TICKS(1000));
+}
+
 void net_configurator::sntp_sync_cb(timeval* tv)
 {
     ESP_LOGI(TAG, "Got time: %lld", tv->tv_sec);
@@ -6,7 +6,7 @@
 #include <freertos/timers.h>
 
 #include <esp_err.h>
-
+#include <esp_netif.h>
 
 #include "config_server.hpp"
 #include "esp_wifi_types_generic.h"
@@ -32,6 +32,8 @@ public:
         NET_CFG_EVENT_WIFI_START_MANUAL = 1, // Turn on WiFi for 10 minutes for user to modify configurations - after factory reset it's in AP mode, otherwise STA mode
         NET_CFG_EVENT_WIFI_START_SYNC = 2, // Turn on WiFi in STA mode, get NTP time and weather info synced and then turn off WiFi
         NET_CFG_EVENT_WIFI_SYNC_DONE = 3,
+        NET_CFG_EVENT_LEASE_STALE = 4, // Reused lease got no time sync through, go back to DHCP
+        NET_CFG_EVENT_AP_SECURE = 5, // Pairing window over, the setup AP goes back to WPA2
     };
 
     enum net_states : uint32_t
@@ -43,14 +45,50 @@ public:
         NET_CFG_STATE_SYNC_DONE = BIT(3),
     };
 
+    // Latest association and DHCP lease, so the next sync can skip the scan (and with static_ip, DHCP too)
+    struct __attribute__((packed)) link_cache
+    {
+        uint32_t magic;
+        uint8_t bssid[6];
+        uint8_t channel;
+        uint8_t reserved;
+        uint32_t ip;
+        uint32_t netmask;
+        uint32_t gw;
+        uint32_t dns;
+        uint32_t crc;
+    };
+
+    struct connect_stats
+    {
+        uint32_t last_ms; // Radio start to IP of the latest connect, 0 if none yet
+        uint32_t min_ms;
+        uint32_t max_ms;
+        uint32_t last_sync_ms; // Radio start to radio stop of the latest background sync
+        uint32_t connects;
+        uint32_t fast_connects; // Skipped the scan
+        uint32_t fallbacks; // Cached BSSID or lease didn't work out, went back to scan/DHCP
+        bool last_fast;
+        bool last_static;
+    };
+
 public:
     esp_err_t init();
     esp_err_t load_wifi();
-    esp_err_t set_wifi_config(wifi_config_t *config);
+    esp_err_t set_wifi_config(wifi_config_t *config, bool static_ip);
     esp_err_t nuke_config();
+    const connect_stats &get_connect_stats() const { return stats; }
+    bool static_ip_enabled() const { return static_ip; }
 
 private:
     net_configurator() = default;
+    esp_err_t apply_ap_config(bool open);
+    esp_err_t apply_link_cache(wifi_config_t &wifi_cfg);
+    esp_err_t set_cached_ip();
+    void drop_link_cache();
+    void save_link_cache(const esp_netif_ip_info_t &ip_info);
+    static bool link_cache_valid(const link_cache &entry);
+    static uint32_t link_cache_crc(const link_cache &entry);
     static bool wifi_has_station_config();
     static esp_err_t lwip_sntp_stop_cb(void *ctx); // Run in LwIP thread ONLY
     static void wifi_evt_handler(void *_ctx, esp_event_base_t evt_base, int32_t evt_id, void *evt_data);
@@ -59,14 +97,34 @@ private:
     static void wifi_sync_timer_cb(TimerHandle_t timer);
     static void sntp_sync_cb(timeval *tv);
 
+    static void lease_timer_cb(TimerHandle_t timer);
+    static void ap_secure_timer_cb(TimerHandle_t timer);
+
     bool manual_config = false;
+    bool ap_open_pending = false; // Config button pressed with no STA config, the next AP start is open for pairing
     nvs_handle_t nvs = 0; // Not to be confused with scheduler's NVS - this is for WiFi and network
     uint32_t retry_cnt = 0;
     EventGroupHandle_t net_events = nullptr;
     TimerHandle_t wifi_off_timer = nullptr;
     TimerHandle_t wifi_sync_timer = nullptr;
+    TimerHandle_t lease_timer = nullptr;
+    TimerHandle_t ap_secure_timer = nullptr;
+    esp_netif_t *sta_netif = nullptr;
     config_server server = {};
+    link_cache cache = {}; // Working copy, all zero when there's nothing to reuse
+    bool static_ip = false;
+    bool connecting_fast = false; // Until the first IP, a failure means the cached BSSID/channel went stale
+    bool lease_reused = false;
+    bool connect_pending = false; // Radio is up, first IP not in yet
+    int64_t radio_start_us = 0;
+    connect_stats stats = {};
+    static link_cache rtc_cache; // Survives soft resets, NVS only gets rewritten when the link actually changed
+    static constexpr uint32_t LINK_CACHE_MAGIC = 0x4b4e4c4d; // "MLNK"
+    static constexpr char NVS_NAMESPACE[] = "net";
+    static constexpr char NVS_LINK_KEY[] = "link";
+    static constexpr char NVS_STATIC_IP_KEY[] = "static_ip";
     static constexpr uint32_t MAX_RETRY_COUNT = 5;
+    static constexpr uint32_t LEASE_CHECK_TICKS = pdMS_TO_TICKS(10 * 1000); // SNTP normally answers within a couple of seconds
     static constexpr uint32_t WIFI_MANUAL_ENABLE_TIMEOUT_TICKS = pdMS_TO_TICKS(600*1000); // 10 minutes
     static constexpr uint32_t WIFI_SYNC_PERIOD_TICKS = pdMS_TO_TICKS(7200*1000); // 120 minutes
     static constexpr char TAG[] = "net_config";
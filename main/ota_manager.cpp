@@ -0,0 +1,417 @@
+#include <cstdlib>
+#include <cstring>
+#include <esp_log.h>
+#include <esp_partition.h>
+#include <esp_timer.h>
+#include <freertos/task.h>
+
+#include "event_trace.hpp"
+#include "ota_manager.hpp"
+
+esp_err_t ota_manager::begin(size_t image_size, const uint8_t* expected_sha256_in)
+{
+    if (update_handle != 0) {
+        ESP_LOGE(TAG, "begin: update already in progress");
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    update_part = esp_ota_get_next_update_partition(nullptr);
+    if (update_part == nullptr) {
+        ESP_LOGE(TAG, "begin: no OTA partition found");
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    if (image_size > update_part->size) {
+        ESP_LOGE(TAG, "begin: image too large, %u > %lu", image_size, update_part->size);
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    ESP_LOGI(TAG, "begin: writing %u bytes to partition subtype %d at offset 0x%lx",
+             image_size, update_part->subtype, update_part->address);
+
+    free_queue = xQueueCreate(BUF_COUNT, sizeof(uint8_t));
+    full_queue = xQueueCreate(BUF_COUNT + 1, sizeof(uint8_t)); // Room for the stop marker on top of every buffer
+    writer_done = xSemaphoreCreateBinary();
+    for (size_t idx = 0; idx < BUF_COUNT; idx += 1) {
+        bufs[idx] = (uint8_t *)malloc(BUF_SIZE);
+    }
+
+    bool alloc_ok = free_queue != nullptr && full_queue != nullptr && writer_done != nullptr;
+    for (size_t idx = 0; idx < BUF_COUNT; idx += 1) {
+        alloc_ok = alloc_ok && bufs[idx] != nullptr;
+    }
+
+    if (!alloc_ok) {
+        ESP_LOGE(TAG, "begin: out of memory");
+        cleanup();
+        return ESP_ERR_NO_MEM;
+    }
+
+    for (uint8_t idx = 0; idx < BUF_COUNT; idx += 1) {
+        xQueueSend(free_queue, &idx, 0);
+    }
+
+    // Sequential mode erases sector by sector inside esp_ota_write(), so erasing moves off the receive path into the writer too
+    esp_err_t ret = esp_ota_begin(update_part, OTA_WITH_SEQUENTIAL_WRITES, &update_handle);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "begin: esp_ota_begin failed: %s", esp_err_to_name(ret));
+        update_handle = 0;
+        cleanup();
+        return ret;
+    }
+
+    check_sha256 = expected_sha256_in != nullptr;
+    if (check_sha256) {
+        memcpy(expected_sha256, expected_sha256_in, SHA256_LEN);
+    }
+
+    mbedtls_sha256_init(&sha_ctx);
+    mbedtls_sha256_starts(&sha_ctx, 0);
+    write_err = ESP_OK;
+    received = 0;
+    upload_size = image_size;
+    suspended_us = 0;
+    written = 0;
+    start_us = esp_timer_get_time();
+
+    // Below httpd's priority: receiving always wins, flash gets written whenever the socket has nothing for us
+    if (xTaskCreate(writer_task, "ota_writer", 6144, this, tskIDLE_PRIORITY + 4, nullptr) != pdPASS) {
+        ESP_LOGE(TAG, "begin: can't create writer task");
+        esp_ota_abort(update_handle);
+        update_handle = 0;
+        mbedtls_sha256_free(&sha_ctx);
+        cleanup();
+        return ESP_ERR_NO_MEM;
+    }
+
+    return ESP_OK;
+}
+
+esp_err_t ota_manager::begin_delta(const delta_header& header, size_t upload_size_in)
+{
+    if (header.magic != DELTA_MAGIC || header.version != DELTA_VERSION) {
+        ESP_LOGE(TAG, "begin_delta: bad header, magic 0x%08lx version %u", header.magic, header.version);
+        return ESP_ERR_INVALID_VERSION;
+    }
+
+    // A patch only rebuilds the right image on top of the exact image it was made from
+    uint8_t running_sha256[SHA256_LEN] = {};
+    esp_err_t ret = esp_partition_get_sha256(esp_ota_get_running_partition(), running_sha256);
+    if (ret != ESP_OK || memcmp(running_sha256, header.base_sha256, SHA256_LEN) != 0) {
+        ESP_LOGE(TAG, "begin_delta: patch base doesn't match the running image");
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+
+    // The rebuilt image is always hashed against the header, no need for the caller to supply one
+    ret = begin(header.image_size, header.image_sha256);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+
+    esp_delta_ota_cfg_t cfg = {};
+    cfg.user_data = this;
+    cfg.read_cb = delta_read_cb;
+    cfg.write_cb_with_user_data = delta_write_cb;
+    delta_handle = esp_delta_ota_init(&cfg);
+    if (delta_handle == nullptr) {
+        ESP_LOGE(TAG, "begin_delta: can't init patcher");
+        abort();
+        return ESP_ERR_NO_MEM;
+    }
+
+    // The header never reaches the writer, but it is part of the upload as far as resuming goes
+    received = sizeof(header);
+    upload_size = upload_size_in;
+
+    ESP_LOGI(TAG, "begin_delta: patching running image into %lu bytes", header.image_size);
+    return ESP_OK;
+}
+
+uint8_t* ota_manager::acquire()
+{
+    uint8_t idx = 0;
+    if (write_err != ESP_OK || xQueueReceive(free_queue, &idx, pdMS_TO_TICKS(ACQUIRE_TIMEOUT_MS)) != pdTRUE) {
+        return nullptr;
+    }
+
+    buf_lens[idx] = 0;
+    return bufs[idx];
+}
+
+esp_err_t ota_manager::submit(uint8_t* buf, size_t len)
+{
+    for (uint8_t idx = 0; idx < BUF_COUNT; idx += 1) {
+        if (bufs[idx] == buf) {
+            buf_lens[idx] = len;
+            received += len;
+            xQueueSend(full_queue, &idx, portMAX_DELAY);
+            return write_err;
+        }
+    }
+
+    return ESP_ERR_INVALID_ARG;
+}
+
+void ota_manager::release(uint8_t* buf)
+{
+    for (uint8_t idx = 0; idx < BUF_COUNT; idx += 1) {
+        if (bufs[idx] == buf) {
+            xQueueSend(free_queue, &idx, portMAX_DELAY);
+            return;
+        }
+    }
+}
+
+void ota_manager::suspend()
+{
+    if (update_handle == 0) {
+        return;
+    }
+
+    suspended_us = esp_timer_get_time();
+    ESP_LOGW(TAG, "suspend: upload paused at %u of %u bytes", received, upload_size);
+}
+
+esp_err_t ota_manager::resume(size_t offset_in, size_t upload_size_in)
+{
+    expire_suspended();
+    if (update_handle == 0 || suspended_us == 0) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    if (offset_in != received || upload_size_in != upload_size) {
+        ESP_LOGW(TAG, "resume: asked for %u of %u, have %u of %u", offset_in, upload_size_in, received, upload_size);
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    suspended_us = 0;
+    ESP_LOGI(TAG, "resume: continuing at %u of %u bytes", received, upload_size);
+    return ESP_OK;
+}
+
+void ota_manager::expire_suspended()
+{
+    // Checked lazily on the next OTA request, the buffers stay allocated until then
+    if (suspended_us != 0 && esp_timer_get_time() - suspended_us > RESUME_WINDOW_US) {
+        ESP_LOGW(TAG, "expire: upload suspended for too long, dropping it");
+        abort();
+    }
+}
+
+esp_err_t ota_manager::finish(result& out)
+{
+    esp_err_t ret = stop_writer();
+    if (delta_handle != nullptr) {
+        // Flushes whatever the patcher still holds through delta_write_cb(), so it has to come before the hash
+        ret = ret ?: esp_delta_ota_finalize(delta_handle);
+        esp_delta_ota_deinit(delta_handle);
+        delta_handle = nullptr;
+    }
+
+    out.received = received;
+    out.bytes = written;
+    out.elapsed_ms = (uint32_t)((esp_timer_get_time() - start_us) / 1000);
+    mbedtls_sha256_finish(&sha_ctx, out.sha256);
+    mbedtls_sha256_free(&sha_ctx);
+
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "finish: write failed: %s", esp_err_to_name(ret));
+        esp_ota_abort(update_handle);
+        update_handle = 0;
+        cleanup();
+        return ret;
+    }
+
+    if (check_sha256 && memcmp(out.sha256, expected_sha256, SHA256_LEN) != 0) {
+        ESP_LOGE(TAG, "finish: SHA-256 mismatch, image rejected");
+        esp_ota_abort(update_handle);
+        update_handle = 0;
+        cleanup();
+        return ESP_ERR_INVALID_CRC;
+    }
+
+    // esp_ota_end() still checks the image's own header and appended digest on top of ours
+    ret = esp_ota_end(update_handle);
+    update_handle = 0;
+    ret = ret ?: esp_ota_set_boot_partition(update_part);
+    cleanup();
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "finish: can't activate image: %s", esp_err_to_name(ret));
+        return ret;
+    }
+
+    ESP_LOGI(TAG, "finish: %u bytes from %u received in %lu ms", out.bytes, out.received, out.elapsed_ms);
+    return ESP_OK;
+}
+
+void ota_manager::abort()
+{
+    if (update_handle == 0) {
+        return;
+    }
+
+    stop_writer();
+    if (delta_handle != nullptr) {
+        esp_delta_ota_deinit(delta_handle);
+        delta_handle = nullptr;
+    }
+
+    mbedtls_sha256_free(&sha_ctx);
+    esp_ota_abort(update_handle);
+    update_handle = 0;
+    suspended_us = 0;
+    cleanup();
+}
+
+bool ota_manager::parse_sha256_hex(const char* hex, uint8_t* out)
+{
+    if (hex == nullptr || strnlen(hex, SHA256_LEN * 2 + 1) != SHA256_LEN * 2) {
+        return false;
+    }
+
+    for (size_t idx = 0; idx < SHA256_LEN; idx += 1) {
+        char byte_str[3] = { hex[idx * 2], hex[idx * 2 + 1], '\0' };
+        char *end = nullptr;
+        out[idx] = (uint8_t)strtoul(byte_str, &end, 16);
+        if (end != byte_str + 2) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+esp_err_t ota_manager::confirm_boot(int64_t self_test_start_us)
+{
+    const bool pending = boot_pending_verify();
+    const auto self_test_ms = (uint32_t)((esp_timer_get_time() - self_test_start_us) / 1000);
+    event_trace::instance().add(event_trace::TRACE_OTA_SELF_TEST, pending, self_test_ms, ESP_OK);
+
+    // Runs on every boot, not just after an update, so keep an eye on it
+    if (self_test_ms > SELF_TEST_BUDGET_MS) {
+        ESP_LOGW(TAG, "confirm_boot: self-test took %lu ms, over the %lu ms budget", self_test_ms, SELF_TEST_BUDGET_MS);
+    }
+
+    if (!pending) {
+        return ESP_OK;
+    }
+
+    esp_err_t ret = esp_ota_mark_app_valid_cancel_rollback();
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "confirm_boot: can't mark image valid: %s", esp_err_to_name(ret));
+        return ret;
+    }
+
+    ESP_LOGI(TAG, "confirm_boot: self-test passed in %lu ms, new image confirmed", self_test_ms);
+    return ESP_OK;
+}
+
+void ota_manager::fail_self_test(esp_err_t err, const char* step)
+{
+    if (!boot_pending_verify()) {
+        return;
+    }
+
+    ESP_LOGE(TAG, "fail_self_test: %s failed: %s, rolling back", step, esp_err_to_name(err));
+    event_trace::instance().add(event_trace::TRACE_OTA_SELF_TEST, 1, 0, err);
+    event_trace::instance().flush_to_flash();
+
+    // Only comes back if there's no previous image to go back to
+    esp_err_t ret = esp_ota_mark_app_invalid_rollback_and_reboot();
+    ESP_LOGE(TAG, "fail_self_test: rollback failed: %s", esp_err_to_name(ret));
+}
+
+bool ota_manager::boot_pending_verify()
+{
+    esp_ota_img_states_t state = ESP_OTA_IMG_UNDEFINED;
+    return esp_ota_get_state_partition(esp_ota_get_running_partition(), &state) == ESP_OK && state == ESP_OTA_IMG_PENDING_VERIFY;
+}
+
+esp_err_t ota_manager::write_image(const uint8_t* buf, size_t len)
+{
+    mbedtls_sha256_update(&sha_ctx, buf, len);
+    esp_err_t ret = esp_ota_write(update_handle, buf, len);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "write_image: esp_ota_write failed: %s", esp_err_to_name(ret));
+        return ret;
+    }
+
+    written += len;
+    return ESP_OK;
+}
+
+esp_err_t ota_manager::delta_read_cb(uint8_t* buf, size_t size, int src_offset)
+{
+    // No user data for reads, the patch source is always the running partition anyway
+    return esp_partition_read(esp_ota_get_running_partition(), src_offset, buf, size);
+}
+
+esp_err_t ota_manager::delta_write_cb(const uint8_t* buf, size_t size, void* _ctx)
+{
+    auto *ctx = (ota_manager *)_ctx;
+    return ctx->write_image(buf, size);
+}
+
+esp_err_t ota_manager::stop_writer()
+{
+    const uint8_t stop = STOP_IDX;
+    xQueueSend(full_queue, &stop, portMAX_DELAY);
+    xSemaphoreTake(writer_done, portMAX_DELAY);
+    return write_err;
+}
+
+void ota_manager::cleanup()
+{
+    for (size_t idx = 0; idx < BUF_COUNT; idx += 1) {
+        free(bufs[idx]);
+        bufs[idx] = nullptr;
+    }
+
+    if (free_queue != nullptr) {
+        vQueueDelete(free_queue);
+        free_queue = nullptr;
+    }
+
+    if (full_queue != nullptr) {
+        vQueueDelete(full_queue);
+        full_queue = nullptr;
+    }
+
+    if (writer_done != nullptr) {
+        vSemaphoreDelete(writer_done);
+        writer_done = nullptr;
+    }
+}
+
+void ota_manager::writer_task(void* _ctx)
+{
+    auto *ctx = (ota_manager *)_ctx;
+    while (true) {
+        uint8_t idx = 0;
+        xQueueReceive(ctx->full_queue, &idx, portMAX_DELAY);
+        if (idx == STOP_IDX) {
+            break;
+        }
+
+        // After a failure keep draining so the receiver never blocks on a full queue, just stop writing
+        if (ctx->write_err == ESP_OK) {
+            esp_err_t ret = ESP_OK;
+            if (ctx->delta_handle != nullptr) {
+                // Patched output comes back through delta_write_cb(), still on this task
+                ret = esp_delta_ota_feed_patch(ctx->delta_handle, ctx->bufs[idx], (int)ctx->buf_lens[idx]);
+                if (ret != ESP_OK) {
+                    ESP_LOGE(TAG, "writer: patch failed: %s", esp_err_to_name(ret));
+                }
+            } else {
+                ret = ctx->write_image(ctx->bufs[idx], ctx->buf_lens[idx]);
+            }
+
+            ctx->write_err = ret;
+        }
+
+        xQueueSend(ctx->free_queue, &idx, portMAX_DELAY);
+    }
+
+    xSemaphoreGive(ctx->writer_done);
+    vTaskDelete(nullptr);
+}
@@ -0,0 +1,112 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <esp_delta_ota.h>
+#include <esp_err.h>
+#include <esp_ota_ops.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/semphr.h>
+#include <mbedtls/sha256.h>
+
+class ota_manager
+{
+public:
+    static ota_manager &instance()
+    {
+        static ota_manager _instance;
+        return _instance;
+    }
+
+    void operator=(ota_manager const &) = delete;
+    ota_manager(ota_manager const &) = delete;
+
+    static constexpr size_t SHA256_LEN = 32;
+    static constexpr size_t BUF_SIZE = 4096; // One flash sector per esp_ota_write()
+    static constexpr size_t BUF_COUNT = 2; // Receive into one while the other is being written
+
+    static constexpr uint32_t DELTA_MAGIC = 0x544C444D; // "MDLT"
+    static constexpr uint8_t DELTA_VERSION = 1;
+
+    // Written by tools/ota_delta.py in front of the detools patch (sequential, heatshrink compressed)
+    struct __attribute__((packed)) delta_header
+    {
+        uint32_t magic;
+        uint8_t version;
+        uint8_t reserved[3];
+        uint32_t image_size; // Size of the rebuilt image
+        uint8_t base_sha256[SHA256_LEN]; // Digest appended to the image the patch applies to
+        uint8_t image_sha256[SHA256_LEN]; // Hash of the whole rebuilt image
+    };
+
+    struct result
+    {
+        size_t received; // Bytes handed to submit(), smaller than bytes for a delta
+        size_t bytes;
+        uint32_t elapsed_ms;
+        uint8_t sha256[SHA256_LEN];
+    };
+
+    // Caller is the receiving side: begin(), then acquire()/submit() per filled buffer, then finish() or abort()
+    esp_err_t begin(size_t image_size, const uint8_t *expected_sha256);
+    // Same as begin(), but submitted buffers are a patch against the running image and get rebuilt on the fly
+    esp_err_t begin_delta(const delta_header &header, size_t upload_size);
+    uint8_t *acquire();
+    esp_err_t submit(uint8_t *buf, size_t len);
+    void release(uint8_t *buf);
+    esp_err_t finish(result &out);
+    void abort();
+
+    // An upload may span several requests: a dropped connection suspends the update with the writer, handle and
+    // running hash kept as-is, and the next request continues from offset() as if nothing happened
+    void suspend();
+    esp_err_t resume(size_t offset, size_t upload_size);
+    void expire_suspended();
+    bool active() const { return update_handle != 0; }
+    bool is_delta() const { return delta_handle != nullptr; }
+    bool verifying() const { return check_sha256; }
+    size_t offset() const { return received; }
+    size_t size() const { return upload_size; }
+
+    static bool parse_sha256_hex(const char *hex, uint8_t *out);
+
+    // The first boot of a new image runs pending verification: the boot-time inits double as its self-test,
+    // confirm_boot() keeps the image once they all passed, fail_self_test() rolls back to the previous one
+    esp_err_t confirm_boot(int64_t self_test_start_us);
+    void fail_self_test(esp_err_t err, const char *step);
+
+private:
+    ota_manager() = default;
+    esp_err_t stop_writer();
+    void cleanup();
+    static void writer_task(void *_ctx);
+    static esp_err_t delta_read_cb(uint8_t *buf, size_t size, int src_offset);
+    static esp_err_t delta_write_cb(const uint8_t *buf, size_t size, void *_ctx);
+    static bool boot_pending_verify();
+    esp_err_t write_image(const uint8_t *buf, size_t len);
+
+    const esp_partition_t *update_part = nullptr;
+    esp_ota_handle_t update_handle = 0;
+    esp_delta_ota_handle_t delta_handle = nullptr;
+    QueueHandle_t free_queue = nullptr; // Buffer indexes ready to be filled
+    QueueHandle_t full_queue = nullptr; // Buffer indexes ready to be written, STOP_IDX to end
+    SemaphoreHandle_t writer_done = nullptr;
+    uint8_t *bufs[BUF_COUNT] = {};
+    size_t buf_lens[BUF_COUNT] = {};
+    mbedtls_sha256_context sha_ctx = {};
+    volatile esp_err_t write_err = ESP_OK; // Set by the writer task, checked by the receiver
+    size_t received = 0; // Upload bytes so far, including the delta header
+    size_t upload_size = 0;
+    int64_t suspended_us = 0; // 0 while a request is feeding us
+    size_t written = 0;
+    int64_t start_us = 0;
+    bool check_sha256 = false;
+    uint8_t expected_sha256[SHA256_LEN] = {};
+
+    static constexpr uint8_t STOP_IDX = UINT8_MAX;
+    static constexpr uint32_t ACQUIRE_TIMEOUT_MS = 10000;
+    static constexpr uint32_t SELF_TEST_BUDGET_MS = 1500;
+    static constexpr int64_t RESUME_WINDOW_US = 10 * 60 * 1000000LL; // Long enough to get back onto WiFi
+    static constexpr char TAG[] = "ota_mgr";
+};
@@ -37,6 +37,16 @@ esp_err_t misty::setup_input_interrupts()
     return ESP_OK;
 }
 
+misty::charge_state misty::get_charge_state()
+{
+    // Both charger outputs are open drain, active low
+    if (gpio_ll_get_level(&GPIO, N_CHARGING_PIN) == 0) {
+        return CHARGE_ACTIVE;
+    }
+
+    return gpio_ll_get_level(&GPIO, N_CHG_DONE_PIN) == 0 ? CHARGE_DONE : CHARGE_NONE;
+}
+
 void IRAM_ATTR misty::charging_handler(void* _ctx)
 {
     esp_event_isr_post(MISTY_IO_EVENTS, gpio_ll_get_level(&GPIO, N_CHARGING_PIN) == 0 ? CHARGING_ACTIVE : CHARGING_INACTIVE, nullptr, 0, nullptr);
@@ -34,7 +34,15 @@ namespace misty
         PUMP_TRIG_BUTTON_PRESSED,
     };
 
+    enum charge_state : uint8_t
+    {
+        CHARGE_NONE = 0, // On battery, or no battery fitted
+        CHARGE_ACTIVE,
+        CHARGE_DONE,
+    };
+
     esp_err_t setup_input_interrupts();
+    charge_state get_charge_state();
     void IRAM_ATTR charging_handler(void *_ctx);
     void IRAM_ATTR chg_done_handler(void *_ctx);
     void IRAM_ATTR config_btn_handler(void *_ctx);
@@ -0,0 +1,111 @@
+#include <cinttypes>
+#include <esp_attr.h>
+#include <esp_log.h>
+#include <esp_pm.h>
+#include <esp_timer.h>
+#include <esp_private/esp_clk.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+#include "power_stats.hpp"
+
+esp_err_t power_stats::init()
+{
+#if CONFIG_PM_LIGHT_SLEEP_CALLBACKS
+    esp_pm_sleep_cbs_register_config_t cbs_cfg = {};
+    cbs_cfg.enter_cb = light_sleep_enter_cb;
+    cbs_cfg.exit_cb = light_sleep_exit_cb;
+    cbs_cfg.enter_cb_user_arg = this;
+    cbs_cfg.exit_cb_user_arg = this;
+
+    esp_err_t ret = esp_pm_light_sleep_register_cbs(&cbs_cfg);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "init: can't register light sleep callbacks: 0x%x", ret);
+        return ret;
+    }
+#else
+    ESP_LOGW(TAG, "init: CONFIG_PM_LIGHT_SLEEP_CALLBACKS disabled, no light sleep counters");
+#endif
+
+    return ESP_OK;
+}
+
+esp_err_t power_stats::dump(FILE* out) const
+{
+    if (out == nullptr) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    esp_err_t ret = dump_pm(out);
+    ret = ret ?: dump_tasks(out);
+    return ret;
+}
+
+esp_err_t power_stats::dump_pm(FILE* out) const
+{
+    esp_pm_config_t pm_cfg = {};
+    esp_err_t ret = esp_pm_get_configuration(&pm_cfg);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "dump: can't get PM config: 0x%x", ret);
+        return ret;
+    }
+
+    fprintf(out, "uptime_us: %lld\n", esp_timer_get_time());
+    fprintf(out, "cpu_freq_mhz: %d (min %d, max %d)\n", esp_clk_cpu_freq() / 1000000, pm_cfg.min_freq_mhz, pm_cfg.max_freq_mhz);
+    fprintf(out, "light_sleep_enabled: %d\n", pm_cfg.light_sleep_enable ? 1 : 0);
+    fprintf(out, "light_sleep_count: %" PRIu32 "\n", light_sleep_count);
+    fprintf(out, "light_sleep_requested_us: %lld\n", (long long)light_sleep_requested_us);
+    fprintf(out, "light_sleep_actual_us: %lld\n", (long long)light_sleep_actual_us);
+
+    // With CONFIG_PM_PROFILING this also prints the time spent holding each lock and the time spent in each
+    // PM mode (i.e. the CPU/APB frequency residency)
+    fprintf(out, "\n");
+    return esp_pm_dump_locks(out);
+}
+
+esp_err_t power_stats::dump_tasks(FILE* out)
+{
+#if CONFIG_FREERTOS_USE_TRACE_FACILITY && CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS
+    // A few spare slots in case something gets spawned between the two calls below
+    UBaseType_t task_cnt = uxTaskGetNumberOfTasks() + 2;
+    auto *tasks = (TaskStatus_t *)calloc(task_cnt, sizeof(TaskStatus_t));
+    if (tasks == nullptr) {
+        ESP_LOGE(TAG, "dump: can't allocate task list");
+        return ESP_ERR_NO_MEM;
+    }
+
+    configRUN_TIME_COUNTER_TYPE total_runtime = 0;
+    task_cnt = uxTaskGetSystemState(tasks, task_cnt, &total_runtime);
+    if (total_runtime == 0) {
+        total_runtime = 1;
+    }
+
+    fprintf(out, "\nTask stats:\n%-16s %12s %6s %5s %6s\n", "Name", "Runtime", "%", "Prio", "HWM");
+    for (UBaseType_t idx = 0; idx < task_cnt; idx += 1) {
+        fprintf(out, "%-16s %12" PRIu64 " %6.2f %5u %6" PRIu32 "\n", tasks[idx].pcTaskName, (uint64_t)tasks[idx].ulRunTimeCounter,
+                (double)tasks[idx].ulRunTimeCounter * 100.0 / (double)total_runtime,
+                (unsigned)tasks[idx].uxCurrentPriority, (uint32_t)tasks[idx].usStackHighWaterMark);
+    }
+
+    free(tasks);
+    return ESP_OK;
+#else
+    fprintf(out, "\nTask stats: disabled, need CONFIG_FREERTOS_USE_TRACE_FACILITY and CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS\n");
+    return ESP_OK;
+#endif
+}
+
+esp_err_t IRAM_ATTR power_stats::light_sleep_enter_cb(int64_t sleep_time_us, void* _ctx)
+{
+    auto *ctx = (power_stats *)_ctx;
+    ctx->light_sleep_count = ctx->light_sleep_count + 1;
+    ctx->light_sleep_requested_us = ctx->light_sleep_requested_us + sleep_time_us;
+    return ESP_OK;
+}
+
+esp_err_t IRAM_ATTR power_stats::light_sleep_exit_cb(int64_t sleep_time_us, void* _ctx)
+{
+    auto *ctx = (power_stats *)_ctx;
+    ctx->light_sleep_actual_us = ctx->light_sleep_actual_us + sleep_time_us;
+    return ESP_OK;
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstdio>
+#include <esp_err.h>
+
+class power_stats
+{
+public:
+    static power_stats &instance()
+    {
+        static power_stats _instance;
+        return _instance;
+    }
+
+    void operator=(power_stats const &) = delete;
+    power_stats(power_stats const &) = delete;
+
+    esp_err_t init();
+    esp_err_t dump(FILE *out) const;
+
+private:
+    power_stats() = default;
+    esp_err_t dump_pm(FILE *out) const;
+    static esp_err_t dump_tasks(FILE *out);
+    static esp_err_t light_sleep_enter_cb(int64_t sleep_time_us, void *_ctx);
+    static esp_err_t light_sleep_exit_cb(int64_t sleep_time_us, void *_ctx);
+
+    // Only written from the light sleep hooks (IRAM, interrupts off) - a torn read in dump() is harmless
+    volatile uint32_t light_sleep_count = 0;
+    volatile int64_t light_sleep_requested_us = 0;
+    volatile int64_t light_sleep_actual_us = 0;
+
+    static constexpr char TAG[] = "power_stats";
+};
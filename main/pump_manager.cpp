@@ -1,10 +1,15 @@
+#include <algorithm>
 #include <bdc_motor.h>
 #include "pump_manager.hpp"
 
 #include "esp_log.h"
+#include "event_trace.hpp"
+#include "esp_timer.h"
+#include "live_status.hpp"
 #include "pin_defs.hpp"
 #include "hal/gpio_ll.h"
 #include "soc/gpio_struct.h"
+#include "water_log.hpp"
 
 ESP_EVENT_DEFINE_BASE(MISTY_PUMP_EVENTS);
 
@@ -52,6 +57,12 @@ esp_err_t pump_manager::init()
         return ESP_ERR_NO_MEM;
     }
 
+    test_mode_timer = xTimerCreate("pump_test", pdMS_TO_TICKS(TEST_MODE_MAX_MS), pdFALSE, this, test_mode_timer_cb);
+    if (test_mode_timer == nullptr) {
+        ESP_LOGE(TAG, "Failed to create test mode timer");
+        return ESP_ERR_NO_MEM;
+    }
+
     gpio_config_t pump_fault_cfg = {
         .pin_bit_mask = (1ULL << misty::PUMP_FAULT_PIN),
         .mode = GPIO_MODE_INPUT,
@@ -87,45 +98,102 @@ esp_err_t pump_manager::init()
     return ret;
 }
 
-esp_err_t pump_manager::run_a(uint32_t duration_ms)
+esp_err_t pump_manager::run_a(uint32_t duration_ms, uint8_t duty)
 {
+    if (pdMS_TO_TICKS(duration_ms) == 0) {
+        ESP_LOGE(TAG, "run_a: duration %lu ms is under one tick", duration_ms);
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    event_trace::instance().add(event_trace::TRACE_PUMP_RUN_BEGIN, 0, duration_ms);
     gpio_ll_set_level(&GPIO, misty::PUMP_SLEEP_PIN, 1);
     motor_a_running = true;
+    motor_a_start_us = esp_timer_get_time();
 
+    // xTimerChangePeriod() also starts a dormant timer, so no extra xTimerStart() round trip to the timer task
     if (xTimerChangePeriod(motor_a_off_timer, pdMS_TO_TICKS(duration_ms), pdMS_TO_TICKS(10000)) == pdFAIL) {
         ESP_LOGE(TAG, "Can't configure timer A!");
         return ESP_ERR_TIMEOUT;
     }
 
-    if (xTimerStart(motor_a_off_timer, pdMS_TO_TICKS(10000)) == pdFAIL) {
-        ESP_LOGE(TAG, "Can't start timer A!");
-        return ESP_ERR_TIMEOUT;
-    }
+    event_trace::instance().add(event_trace::TRACE_PUMP_TIMER_ARMED, 0, duration_ms);
 
     esp_err_t ret = bdc_motor_enable(motor_a);
     ret = ret ?: bdc_motor_forward(motor_a);
-    ret = ret ?: bdc_motor_set_speed(motor_a, 100);
+    ret = ret ?: bdc_motor_set_speed(motor_a, std::min(duty, DUTY_MAX));
+    event_trace::instance().add(event_trace::TRACE_PUMP_MOTOR_ON, 0, duration_ms, ret);
+    post_state(0b01, true, duration_ms);
     return ret;
 }
 
-esp_err_t pump_manager::run_b(uint32_t duration_ms)
+esp_err_t pump_manager::run_b(uint32_t duration_ms, uint8_t duty)
 {
+    if (pdMS_TO_TICKS(duration_ms) == 0) {
+        ESP_LOGE(TAG, "run_b: duration %lu ms is under one tick", duration_ms);
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    event_trace::instance().add(event_trace::TRACE_PUMP_RUN_BEGIN, 1, duration_ms);
     gpio_ll_set_level(&GPIO, misty::PUMP_SLEEP_PIN, 1);
     motor_b_running = true;
+    motor_b_start_us = esp_timer_get_time();
 
+    // xTimerChangePeriod() also starts a dormant timer, so no extra xTimerStart() round trip to the timer task
     if (xTimerChangePeriod(motor_b_off_timer, pdMS_TO_TICKS(duration_ms), pdMS_TO_TICKS(10000)) == pdFAIL) {
-        ESP_LOGE(TAG, "Can't configure timer!");
+        ESP_LOGE(TAG, "Can't configure timer B!");
         return ESP_ERR_TIMEOUT;
     }
 
-    if (xTimerStart(motor_b_off_timer, pdMS_TO_TICKS(10000)) == pdFAIL) {
-        ESP_LOGE(TAG, "Can't start timer B!");
-        return ESP_ERR_TIMEOUT;
-    }
+    event_trace::instance().add(event_trace::TRACE_PUMP_TIMER_ARMED, 1, duration_ms);
 
     esp_err_t ret = bdc_motor_enable(motor_b);
     ret = ret ?: bdc_motor_forward(motor_b);
-    ret = ret ?: bdc_motor_set_speed(motor_b, 100);
+    ret = ret ?: bdc_motor_set_speed(motor_b, std::min(duty, DUTY_MAX));
+    event_trace::instance().add(event_trace::TRACE_PUMP_MOTOR_ON, 1, duration_ms, ret);
+    post_state(0b10, true, duration_ms);
+    return ret;
+}
+
+esp_err_t pump_manager::run_manual(uint8_t pumps, uint32_t duration_ms, uint8_t duty)
+{
+    if (pumps == 0 || pumps > 0b11 || duration_ms < RUN_MIN_MS || duration_ms > RUN_MAX_MS || duty == 0 || duty > DUTY_MAX) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    // Test mode owns both motors with no timer, a timed run would cut it short when it ends
+    if (motor_trig_enabled) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    water_log::instance().append(water_log::make_entry(water_log::KIND_API, pumps, duration_ms));
+
+    esp_err_t ret = ESP_OK;
+    if ((pumps & 0b01) != 0) {
+        ret = run_a(duration_ms, duty);
+    }
+
+    if ((pumps & 0b10) != 0) {
+        ret = ret ?: run_b(duration_ms, duty);
+    }
+
+    return ret;
+}
+
+esp_err_t pump_manager::stop(uint8_t pumps)
+{
+    if (motor_trig_enabled) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    esp_err_t ret = ESP_OK;
+    if ((pumps & 0b01) != 0 && motor_a_running && xTimerStop(motor_a_off_timer, pdMS_TO_TICKS(1000)) == pdPASS) {
+        ret = esp_event_post(MISTY_PUMP_EVENTS, PUMP_A_OFF_TIMER_TRIGGERED, nullptr, 0, pdMS_TO_TICKS(1000));
+    }
+
+    if ((pumps & 0b10) != 0 && motor_b_running && xTimerStop(motor_b_off_timer, pdMS_TO_TICKS(1000)) == pdPASS) {
+        ret = ret ?: esp_event_post(MISTY_PUMP_EVENTS, PUMP_B_OFF_TIMER_TRIGGERED, nullptr, 0, pdMS_TO_TICKS(1000));
+    }
+
     return ret;
 }
 
@@ -139,36 +207,123 @@ void pump_manager::motor_b_off_timer_cb(TimerHandle_t timer)
     esp_event_post(MISTY_PUMP_EVENTS, PUMP_B_OFF_TIMER_TRIGGERED, nullptr, 0, portMAX_DELAY);
 }
 
+void pump_manager::test_mode_timer_cb(TimerHandle_t timer)
+{
+    esp_event_post(MISTY_PUMP_EVENTS, PUMP_TEST_MODE_TIMEOUT, nullptr, 0, portMAX_DELAY);
+}
+
+void pump_manager::start_test_mode()
+{
+    ESP_LOGW(TAG, "Pump test enabled");
+    motor_trig_enabled = true;
+    event_trace::instance().add(event_trace::TRACE_PUMP_TEST_MODE, 1);
+    motor_trig_start_us = esp_timer_get_time();
+    motor_a_running = true;
+    motor_b_running = true;
+    gpio_ll_set_level(&GPIO, misty::PUMP_SLEEP_PIN, 1);
+    bdc_motor_enable(motor_a);
+    bdc_motor_forward(motor_a);
+    bdc_motor_set_speed(motor_a, DUTY_MAX);
+
+    bdc_motor_enable(motor_b);
+    bdc_motor_forward(motor_b);
+    bdc_motor_set_speed(motor_b, DUTY_MAX);
+
+    // A forgotten test run would otherwise go on until the battery is flat
+    if (xTimerReset(test_mode_timer, pdMS_TO_TICKS(1000)) == pdFAIL) {
+        ESP_LOGE(TAG, "Can't arm test mode timer!");
+    }
+
+    post_state(0b11, true, 0);
+}
+
+void pump_manager::stop_test_mode()
+{
+    ESP_LOGW(TAG, "Pump test disabled");
+    motor_trig_enabled = false;
+    event_trace::instance().add(event_trace::TRACE_PUMP_TEST_MODE, 0);
+    xTimerStop(test_mode_timer, 0);
+    bdc_motor_brake(motor_a);
+    bdc_motor_disable(motor_a);
+
+    bdc_motor_brake(motor_b);
+    bdc_motor_disable(motor_b);
+
+    motor_a_running = false;
+    motor_b_running = false;
+    gpio_ll_set_level(&GPIO, misty::PUMP_SLEEP_PIN, 0);
+    water_log::instance().append(water_log::make_entry(water_log::KIND_MANUAL, 0b11, elapsed_ms(motor_trig_start_us)));
+    post_state(0b11, false, elapsed_ms(motor_trig_start_us));
+}
+
+uint8_t pump_manager::running_pumps() const
+{
+    return (motor_a_running ? 0b01 : 0) | (motor_b_running ? 0b10 : 0);
+}
+
+uint32_t pump_manager::remaining_ms(uint8_t pump_bit) const
+{
+    TimerHandle_t timer = pump_bit == 0b01 ? motor_a_off_timer : motor_b_off_timer;
+    if ((running_pumps() & pump_bit) == 0 || motor_trig_enabled || timer == nullptr || xTimerIsTimerActive(timer) == pdFALSE) {
+        return 0;
+    }
+
+    // Tick count wraps, so go through the unsigned difference
+    const TickType_t left = xTimerGetExpiryTime(timer) - xTaskGetTickCount();
+    return pdTICKS_TO_MS(left);
+}
+
+void pump_manager::post_state(uint8_t pumps, bool running, uint32_t duration_ms)
+{
+    const live_status::pump_state state = { .pumps = pumps, .running = running, .duration_ms = duration_ms };
+    live_status::post(live_status::STATUS_PUMP, &state, sizeof(state));
+}
+
+uint32_t pump_manager::elapsed_ms(int64_t since_us)
+{
+    return (uint32_t)((esp_timer_get_time() - since_us) / 1000);
+}
+
 void pump_manager::pump_event_handler(void* _ctx, esp_event_base_t evt_base, int32_t evt_id, void* evt_data)
 {
     auto &pump = instance();
     if (evt_base == MISTY_PUMP_EVENTS) {
         switch (evt_id) {
             case PUMP_A_OFF_TIMER_TRIGGERED: {
-                ESP_LOGI(TAG, "Pump A stop timer triggered, stopping");
+                // stop() may race a timer that already fired, and test mode has no timed run to end
+                if (!pump.motor_a_running || pump.motor_trig_enabled) {
+                    break;
+                }
+
                 bdc_motor_brake(pump.motor_a);
                 bdc_motor_disable(pump.motor_a);
                 pump.motor_a_running = false;
+                event_trace::instance().add(event_trace::TRACE_PUMP_MOTOR_OFF, 0);
+                water_log::instance().append(water_log::make_entry(water_log::KIND_STOPPED, 0b01, elapsed_ms(pump.motor_a_start_us)));
+                post_state(0b01, false, elapsed_ms(pump.motor_a_start_us));
 
                 if (!pump.motor_a_running && !pump.motor_b_running) {
                     gpio_ll_set_level(&GPIO, misty::PUMP_SLEEP_PIN, 0);
                 }
-
-                ESP_LOGI(TAG, "Pump A stopped");
                 break;
             }
 
             case PUMP_B_OFF_TIMER_TRIGGERED: {
-                ESP_LOGI(TAG, "Pump B stop timer triggered, stopping");
+                // stop() may race a timer that already fired, and test mode has no timed run to end
+                if (!pump.motor_b_running || pump.motor_trig_enabled) {
+                    break;
+                }
+
                 bdc_motor_brake(pump.motor_b);
                 bdc_motor_disable(pump.motor_b);
                 pump.motor_b_running = false;
+                event_trace::instance().add(event_trace::TRACE_PUMP_MOTOR_OFF, 1);
+                water_log::instance().append(water_log::make_entry(water_log::KIND_STOPPED, 0b10, elapsed_ms(pump.motor_b_start_us)));
+                post_state(0b10, false, elapsed_ms(pump.motor_b_start_us));
 
                 if (!pump.motor_a_running && !pump.motor_b_running) {
                     gpio_ll_set_level(&GPIO, misty::PUMP_SLEEP_PIN, 0);
                 }
-
-                ESP_LOGI(TAG, "Pump A stopped");
                 break;
             }
 
@@ -179,6 +334,42 @@ void pump_manager::pump_event_handler(void* _ctx, esp_event_base_t evt_base, int
 
                 bdc_motor_brake(pump.motor_b);
                 bdc_motor_disable(pump.motor_b);
+
+                // An off timer firing later would log the run a second time as stopped
+                xTimerStop(pump.motor_a_off_timer, 0);
+                xTimerStop(pump.motor_b_off_timer, 0);
+
+                if (pump.motor_trig_enabled) {
+                    // Test mode ends here, logged as the fault instead of a manual run
+                    pump.motor_trig_enabled = false;
+                    xTimerStop(pump.test_mode_timer, 0);
+                    event_trace::instance().add(event_trace::TRACE_PUMP_TEST_MODE, 0);
+                    water_log::instance().append(water_log::make_entry(water_log::KIND_FAULT, 0b11, elapsed_ms(pump.motor_trig_start_us)));
+                } else {
+                    if (pump.motor_a_running) {
+                        water_log::instance().append(water_log::make_entry(water_log::KIND_FAULT, 0b01, elapsed_ms(pump.motor_a_start_us)));
+                    }
+
+                    if (pump.motor_b_running) {
+                        water_log::instance().append(water_log::make_entry(water_log::KIND_FAULT, 0b10, elapsed_ms(pump.motor_b_start_us)));
+                    }
+                }
+
+                pump.motor_a_running = false;
+                pump.motor_b_running = false;
+                gpio_ll_set_level(&GPIO, misty::PUMP_SLEEP_PIN, 0);
+                post_state(0b11, false, 0); // Both are stopped now, whichever was running
+
+                // Keep whatever led up to the fault for post-mortem, a no-op if there's no trace partition
+                event_trace::instance().flush_to_flash();
+                break;
+            }
+
+            case PUMP_TEST_MODE_TIMEOUT: {
+                if (pump.motor_trig_enabled) {
+                    ESP_LOGW(TAG, "Pump test timed out after %lu ms", TEST_MODE_MAX_MS);
+                    pump.stop_test_mode();
+                }
                 break;
             }
 
@@ -189,30 +380,10 @@ void pump_manager::pump_event_handler(void* _ctx, esp_event_base_t evt_base, int
         }
     } else if (evt_base == MISTY_IO_EVENTS) {
         if (evt_id == misty::PUMP_TRIG_BUTTON_PRESSED) {
-            pump.motor_trig_enabled = !pump.motor_trig_enabled;
             if (pump.motor_trig_enabled) {
-                ESP_LOGW(TAG, "Pump test enabled");
-                pump.motor_a_running = true;
-                pump.motor_b_running = true;
-                gpio_ll_set_level(&GPIO, misty::PUMP_SLEEP_PIN, 1);
-                bdc_motor_enable(pump.motor_a);
-                bdc_motor_forward(pump.motor_a);
-                bdc_motor_set_speed(pump.motor_a, 100);
-
-                bdc_motor_enable(pump.motor_b);
-                bdc_motor_forward(pump.motor_b);
-                bdc_motor_set_speed(pump.motor_b, 100);
+                pump.stop_test_mode();
             } else {
-                ESP_LOGW(TAG, "Pump test disabled");
-                bdc_motor_brake(pump.motor_a);
-                bdc_motor_disable(pump.motor_a);
-
-                bdc_motor_brake(pump.motor_b);
-                bdc_motor_disable(pump.motor_b);
-
-                pump.motor_a_running = false;
-                pump.motor_b_running = false;
-                gpio_ll_set_level(&GPIO, misty::PUMP_SLEEP_PIN, 0);
+                pump.start_test_mode();
             }
         }
     }
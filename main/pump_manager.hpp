@@ -25,27 +25,47 @@ public:
     {
         PUMP_A_OFF_TIMER_TRIGGERED = 0,
         PUMP_B_OFF_TIMER_TRIGGERED,
-        PUMP_FAULT_TRIGGERED
+        PUMP_FAULT_TRIGGERED,
+        PUMP_TEST_MODE_TIMEOUT,
     };
 
+    static constexpr uint8_t DUTY_MAX = 100; // MCPWM resolution / PWM frequency, so duty is in percent
+    static constexpr uint32_t RUN_MAX_MS = 3600 * 1000;
+    static constexpr uint32_t RUN_MIN_MS = (1000 + configTICK_RATE_HZ - 1) / configTICK_RATE_HZ; // One tick, anything shorter is a zero timer period
+    static constexpr uint32_t TEST_MODE_MAX_MS = 3 * 60 * 1000; // Button test mode turns itself off after this
+
 private:
     pump_manager() = default;
 
 public:
     esp_err_t init();
-    esp_err_t run_a(uint32_t duration_ms);
-    esp_err_t run_b(uint32_t duration_ms);
+    esp_err_t run_a(uint32_t duration_ms, uint8_t duty = DUTY_MAX); // ESP_ERR_INVALID_ARG under RUN_MIN_MS
+    esp_err_t run_b(uint32_t duration_ms, uint8_t duty = DUTY_MAX);
+    esp_err_t run_manual(uint8_t pumps, uint32_t duration_ms, uint8_t duty); // ESP_ERR_INVALID_STATE in test mode
+    esp_err_t stop(uint8_t pumps); // Ends timed runs early through the same path as their off timers
+    uint8_t running_pumps() const; // Bit 0 for A, bit 1 for B
+    uint32_t remaining_ms(uint8_t pump_bit) const; // 0 when stopped or running without a timer (test mode)
+    bool test_mode() const { return motor_trig_enabled; }
 
 private:
     bool motor_trig_enabled = false;
     std::atomic_bool motor_a_running = false;
     std::atomic_bool motor_b_running = false;
+    int64_t motor_a_start_us = 0;
+    int64_t motor_b_start_us = 0;
+    int64_t motor_trig_start_us = 0;
     bdc_motor_handle_t motor_a = nullptr;
     bdc_motor_handle_t motor_b = nullptr;
     TimerHandle_t motor_a_off_timer = nullptr;
     TimerHandle_t motor_b_off_timer = nullptr;
+    TimerHandle_t test_mode_timer = nullptr;
+    void start_test_mode();
+    void stop_test_mode();
     static void motor_a_off_timer_cb(TimerHandle_t timer);
     static void motor_b_off_timer_cb(TimerHandle_t timer);
+    static void test_mode_timer_cb(TimerHandle_t timer);
+    static uint32_t elapsed_ms(int64_t since_us);
+    static void post_state(uint8_t pumps, bool running, uint32_t duration_ms);
     static void pump_event_handler(void *_ctx, esp_event_base_t evt_base, int32_t evt_id, void *evt_data);
     static constexpr char TAG[] = "pump";
 };
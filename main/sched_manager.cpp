@@ -1,12 +1,25 @@
 #include "sched_manager.hpp"
 
+#include <cstdlib>
+#include <cstring>
+
 #include "air_sensor.hpp"
 #include "esp_log.h"
+#include "event_trace.hpp"
+#include "live_status.hpp"
 #include "pump_manager.hpp"
+#include "water_log.hpp"
 
 esp_err_t sched_manager::init()
 {
-    esp_err_t ret = nvs_open("cron", NVS_READWRITE, &nvs);
+    // No marker yet means the set has never been replaced and is still in the first namespace
+    esp_err_t ret = nvs_open(NVS_META_NAMESPACE, NVS_READWRITE, &meta_nvs);
+    uint8_t active = 0;
+    if (ret == ESP_OK && nvs_get_u8(meta_nvs, NVS_ACTIVE_SET_KEY, &active) == ESP_OK && active < std::size(NVS_SET_NAMESPACES)) {
+        active_set = active;
+    }
+
+    ret = ret ?: nvs_open(NVS_SET_NAMESPACES[active_set], NVS_READWRITE, &nvs);
     if (ret != ESP_OK) {
         ESP_LOGE(TAG, "init: can't open NVS: 0x%x", ret);
         return ret;
@@ -15,7 +28,13 @@ esp_err_t sched_manager::init()
     // We don't use NVS functionality provided by ESP schedule because it can't save additional info
     // Instead we do it on our on, so that we can save whatever we want!
     esp_schedule_init(false, nullptr, nullptr);
-    dispatch_queue = xQueueCreate(3, sizeof(uint32_t));
+    items_lock = xSemaphoreCreateMutex();
+    if (items_lock == nullptr) {
+        ESP_LOGE(TAG, "init: can't create lock");
+        return ESP_ERR_NO_MEM;
+    }
+
+    dispatch_queue = xQueueCreate(3, sizeof(dispatch_request));
     if (dispatch_queue == nullptr) {
         ESP_LOGE(TAG, "init: can't create dispatch queue");
         return ESP_ERR_NO_MEM;
@@ -30,6 +49,14 @@ esp_err_t sched_manager::init()
 }
 
 esp_err_t sched_manager::load_schedules()
+{
+    xSemaphoreTake(items_lock, portMAX_DELAY);
+    esp_err_t ret = reload_items();
+    xSemaphoreGive(items_lock);
+    return ret;
+}
+
+esp_err_t sched_manager::reload_items()
 {
     nvs_iterator_t nvs_it = nullptr;
     esp_err_t ret = nvs_entry_find_in_handle(nvs, NVS_TYPE_BLOB, &nvs_it);
@@ -65,30 +92,29 @@ esp_err_t sched_manager::load_schedules()
 
     xQueueReset(dispatch_queue);
 
-    size_t item_idx = 0;
-    while (nvs_it != nullptr && item_idx < task_items.size()) {
+    // One bad blob only costs that schedule, the rest still get loaded
+    size_t item_idx = 0, skipped = 0;
+    esp_err_t next_ret = ESP_OK;
+    for (; nvs_it != nullptr && next_ret == ESP_OK && item_idx < task_items.size(); next_ret = nvs_entry_next(&nvs_it)) {
         nvs_entry_info_t entry = {};
         ret = nvs_entry_info(nvs_it, &entry);
         if (ret != ESP_OK) {
             ESP_LOGW(TAG, "load_sched: can't load NVS entry: 0x%x", ret);
+            nvs_release_iterator(nvs_it);
             return ret;
         }
 
+        // A blob longer than expected fails the read with ESP_ERR_NVS_INVALID_LENGTH, a shorter one reads fine but short
         cron_store_entry item = {};
         size_t item_size = sizeof(cron_store_entry);
         ret = nvs_get_blob(nvs, entry.key, &item, &item_size);
-        if (ret != ESP_OK) {
-            ESP_LOGE(TAG, "load_sched: Can't read item %s, returned 0x%x", entry.key, ret);
-            return ret;
-        }
-
-        if (item_size < sizeof(item)) {
-            ESP_LOGE(TAG, "load_sched: corrupted item with wrong size %u want %u", item_size, sizeof(item));
-
-            ret = nvs_entry_next(&nvs_it);
-            if (ret != ESP_OK) {
-                break;
-            }
+        const char *error = ret != ESP_OK ? "unreadable" : (item_size != sizeof(item) ? "wrong size" : validate_name(entry.key));
+        error = error ?: validate_entry(item);
+        if (error != nullptr) {
+            ESP_LOGE(TAG, "load_sched: skipping %s: %s (0x%x, %u bytes)", entry.key, error, ret, item_size);
+            event_trace::instance().add(event_trace::TRACE_SCHED_REJECTED, 1, item_size, ret);
+            skipped += 1;
+            continue;
         }
 
         strncpy(task_items[item_idx].name, entry.key, sizeof(cron_task_item::name) - 1);
@@ -97,65 +123,49 @@ esp_err_t sched_manager::load_schedules()
         memcpy(&task_items[item_idx].sched_info, &item, sizeof(item));
 
         esp_schedule_config_t sched_cfg = {};
-        strncpy(sched_cfg.name, entry.key, sizeof(cron_task_item::name) - 1);
-        sched_cfg.name[sizeof(cron_task_item::name) - 1] = '\0';
-
-        sched_cfg.priv_data = (void *)item_idx;
-        sched_cfg.validity.end_time = 0;
-        sched_cfg.validity.start_time = 0;
-        sched_cfg.trigger_cb = schedule_trigger_callback;
-        sched_cfg.trigger.day.repeat_days = task_items[item_idx].sched_info.day_of_week;
-        sched_cfg.trigger.type = task_items[item_idx].sched_info.schedule_type;
-        if (sched_cfg.trigger.type == ESP_SCHEDULE_TYPE_DAYS_OF_WEEK) {
-            sched_cfg.trigger.hours = task_items[item_idx].sched_info.dow.hour;
-            sched_cfg.trigger.minutes = task_items[item_idx].sched_info.dow.minute;
-        } else if (sched_cfg.trigger.type == ESP_SCHEDULE_TYPE_SUNRISE || sched_cfg.trigger.type == ESP_SCHEDULE_TYPE_SUNSET) {
-            sched_cfg.trigger.solar.offset_minutes = task_items[item_idx].sched_info.offset_minute;
-        } else {
+        if (!make_schedule_config(item_idx, sched_cfg)) {
             ESP_LOGE(TAG, "Unsupported schedule type %u", sched_cfg.trigger.type);
-
-            ret = nvs_entry_next(&nvs_it);
-            if (ret != ESP_OK) {
-                break;
-            }
-
+            memset(&task_items[item_idx], 0, sizeof(cron_task_item));
+            skipped += 1;
             continue;
         }
 
         task_items[item_idx].scheduler = esp_schedule_create(&sched_cfg);
         if (!task_items[item_idx].scheduler) {
             ESP_LOGE(TAG, "load: can't create scheduler");
+            nvs_release_iterator(nvs_it);
             return ESP_ERR_NO_MEM; // Maybe reboot instead??
         }
         esp_schedule_enable(task_items[item_idx].scheduler);
-        ESP_LOGI(TAG, "load: inserted item %s, type=%u", task_items[item_idx].name, task_items[item_idx].sched_info.schedule_type);
-
-        ret = nvs_entry_next(&nvs_it);
         item_idx += 1;
-        if (ret != ESP_OK || nvs_it == nullptr || item_idx >= task_items.size()) {
-            break;
-        }
     }
 
+    nvs_release_iterator(nvs_it); // Still set if we stopped at MAX_SCHEDULES, a no-op otherwise
+    if (skipped > 0) {
+        ESP_LOGW(TAG, "load_sched: skipped %u bad entries", skipped);
+    }
+
+    event_trace::instance().add(event_trace::TRACE_SCHED_LOADED, item_idx);
     ESP_LOGI(TAG, "load_sched: done, got %u schedules", item_idx);
     return ESP_OK;
 }
 
 esp_err_t sched_manager::set_schedule(const char* name, const cron_store_entry* entry)
 {
-    ESP_LOGI(TAG, "set: begin");
+    if (entry == nullptr || validate_name(name) != nullptr || validate_entry(*entry) != nullptr) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
     nvs_type_t nvs_type = NVS_TYPE_ANY;
     esp_err_t ret = nvs_find_key(nvs, name, &nvs_type);
     if (ret == ESP_ERR_NVS_NOT_FOUND || ret == ESP_ERR_NOT_FOUND) {
-        ESP_LOGI(TAG, "set: item %s inserting", name);
         ret = nvs_set_blob(nvs, name, entry, sizeof(cron_store_entry));
+        event_trace::instance().add(event_trace::TRACE_SCHED_SET, 1, 0, ret);
         if (ret != ESP_OK) {
             ESP_LOGE(TAG, "set: failed to insert: 0x%x", ret);
             return ret;
         }
 
-
-        ESP_LOGI(TAG, "set: OK, reloading");
         return load_schedules();
     }
 
@@ -169,6 +179,77 @@ esp_err_t sched_manager::set_schedule(const char* name, const cron_store_entry*
     return ret;
 }
 
+esp_err_t sched_manager::update_schedule(const char* name, const cron_store_entry* entry, bool* changed_out)
+{
+    if (changed_out != nullptr) {
+        *changed_out = false;
+    }
+
+    if (entry == nullptr || validate_name(name) != nullptr || validate_entry(*entry) != nullptr) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    cron_store_entry stored = {};
+    size_t len = sizeof(stored);
+    esp_err_t ret = nvs_get_blob(nvs, name, &stored, &len);
+    if (ret == ESP_ERR_NVS_NOT_FOUND) {
+        return ESP_ERR_NOT_FOUND;
+    } else if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "update: NVS error 0x%x", ret);
+        return ret;
+    }
+
+    // Saving an unchanged form is common, don't spend a flash write on it
+    if (len == sizeof(stored) && memcmp(&stored, entry, sizeof(stored)) == 0) {
+        return ESP_OK;
+    }
+
+    ret = nvs_set_blob(nvs, name, entry, sizeof(cron_store_entry));
+    ret = ret ?: nvs_commit(nvs);
+    event_trace::instance().add(event_trace::TRACE_SCHED_SET, 0, 0, ret);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "update: failed to write: 0x%x", ret);
+        return ret;
+    }
+
+    if (changed_out != nullptr) {
+        *changed_out = true;
+    }
+
+    // Patch the live trigger, the other schedules keep their timers and queued fires.
+    // Under the lock so a fire dispatched meanwhile sees either the old entry or the new one, never half of each
+    xSemaphoreTake(items_lock, portMAX_DELAY);
+    ret = ESP_ERR_NOT_FOUND; // Not running (e.g. skipped at load time), a full reload picks it up
+    for (size_t idx = 0; idx < task_items.size(); idx += 1) {
+        auto &item = task_items[idx];
+        if (item.scheduler == nullptr || strncmp(item.name, name, sizeof(item.name)) != 0) {
+            continue;
+        }
+
+        const cron_store_entry prev = item.sched_info;
+        item.sched_info = *entry;
+
+        esp_schedule_config_t sched_cfg = {};
+        if (!make_schedule_config(idx, sched_cfg)) {
+            item.sched_info = prev;
+            xSemaphoreGive(items_lock);
+            return ESP_ERR_INVALID_ARG;
+        }
+
+        esp_schedule_disable(item.scheduler);
+        ret = esp_schedule_edit(item.scheduler, &sched_cfg);
+        esp_schedule_enable(item.scheduler);
+        if (ret != ESP_OK) {
+            ESP_LOGW(TAG, "update: can't edit live schedule, reloading all: 0x%x", ret);
+        }
+        break;
+    }
+
+    ret = ret == ESP_OK ? ESP_OK : reload_items();
+    xSemaphoreGive(items_lock);
+    return ret;
+}
+
 esp_err_t sched_manager::get_schedule(const char* name, cron_store_entry* entry_out) const
 {
     size_t len = sizeof(cron_store_entry);
@@ -196,36 +277,39 @@ esp_err_t sched_manager::list_all_schedule_names_to_json(char* name_out, size_t
     out[out_idx++] = '[';
 
     size_t item_idx = 0;
-    while (nvs_it != nullptr && item_idx < task_items.size() && out_idx + 2 < len) {
-        out[out_idx++] = '"';
+    while (nvs_it != nullptr && item_idx < task_items.size()) {
         nvs_entry_info_t entry = {};
         ret = nvs_entry_info(nvs_it, &entry);
         if (ret != ESP_OK) {
             ESP_LOGW(TAG, "load_sched: can't load NVS entry: 0x%x", ret);
+            nvs_release_iterator(nvs_it);
             return ret;
         }
 
-        size_t copy_len = strnlen(entry.key, sizeof(nvs_entry_info_t::key));
-        memcpy(out + out_idx, entry.key, copy_len);
-        out_idx += copy_len;
-        out[out_idx++] = '"';
+        // Same names load_schedules() takes, which also keeps quotes and backslashes out of the JSON
+        if (validate_name(entry.key) == nullptr) {
+            if (item_idx > 0) {
+                out[out_idx++] = ',';
+            }
 
-        ret = nvs_entry_next(&nvs_it);
-        if (ret != ESP_OK) {
-            break;
+            out[out_idx++] = '"';
+            size_t copy_len = strnlen(entry.key, sizeof(nvs_entry_info_t::key));
+            memcpy(out + out_idx, entry.key, copy_len);
+            out_idx += copy_len;
+            out[out_idx++] = '"';
+            item_idx += 1;
         }
 
-        if (nvs_it != nullptr) {
-            out[out_idx++] = ',';
-        } else {
+        if (nvs_entry_next(&nvs_it) != ESP_OK) {
             break;
         }
     }
 
+    nvs_release_iterator(nvs_it);
 
     out[out_idx++] = ']';
     out[out_idx++] = '\0';
-    ESP_LOGI(TAG, "list_all_name: written %u bytes", out_idx);
+    event_trace::instance().add(event_trace::TRACE_SCHED_LIST, out_idx);
 
     return ESP_OK;
 }
@@ -235,7 +319,127 @@ esp_err_t sched_manager::delete_schedule(const char* name) const
     return nvs_erase_key(nvs, name);
 }
 
-void sched_manager::schedule_dispatcher(size_t idx)
+bool sched_manager::next_fire(time_t& when_out, char* name_out, size_t name_len) const
+{
+    // Straight from the loaded schedulers, esp_schedule already worked out each one's next trigger
+    bool found = false;
+    for (const auto &item : task_items) {
+        esp_schedule_config_t cfg = {};
+        if (item.scheduler == nullptr || esp_schedule_get(item.scheduler, &cfg) != ESP_OK || cfg.trigger.next_scheduled_time_utc <= 0) {
+            continue;
+        }
+
+        if (!found || cfg.trigger.next_scheduled_time_utc < when_out) {
+            when_out = cfg.trigger.next_scheduled_time_utc;
+            strlcpy(name_out, item.name, name_len);
+            found = true;
+        }
+    }
+
+    return found;
+}
+
+size_t sched_manager::get_all_schedules(named_entry* out, size_t max_cnt) const
+{
+    nvs_iterator_t nvs_it = nullptr;
+    esp_err_t ret = nvs_entry_find_in_handle(nvs, NVS_TYPE_BLOB, &nvs_it);
+    size_t cnt = 0;
+    while (ret == ESP_OK && nvs_it != nullptr && cnt < max_cnt) {
+        nvs_entry_info_t info = {};
+        ret = nvs_entry_info(nvs_it, &info);
+        if (ret != ESP_OK) {
+            break;
+        }
+
+        size_t item_size = sizeof(cron_store_entry);
+        if (nvs_get_blob(nvs, info.key, &out[cnt].entry, &item_size) == ESP_OK && item_size == sizeof(cron_store_entry)) {
+            strncpy(out[cnt].name, info.key, sizeof(named_entry::name) - 1);
+            out[cnt].name[sizeof(named_entry::name) - 1] = '\0';
+            cnt += 1;
+        }
+
+        ret = nvs_entry_next(&nvs_it);
+    }
+
+    nvs_release_iterator(nvs_it);
+    return cnt;
+}
+
+esp_err_t sched_manager::replace_all_schedules(const named_entry* items, size_t cnt)
+{
+    if (items == nullptr || cnt > task_items.size()) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    for (size_t idx = 0; idx < cnt; idx += 1) {
+        if (validate_name(items[idx].name) != nullptr || validate_entry(items[idx].entry) != nullptr) {
+            return ESP_ERR_INVALID_ARG;
+        }
+    }
+
+    size_t old_cnt = 0;
+    xSemaphoreTake(items_lock, portMAX_DELAY);
+    for (const auto &item : task_items) {
+        old_cnt += item.scheduler != nullptr ? 1 : 0;
+    }
+    xSemaphoreGive(items_lock);
+
+    // NVS has no transactions, so the new set goes into the other namespace and only the marker write switches over.
+    // That is a single key, so a power cut anywhere in here leaves either the old set or the new one.
+    const uint8_t staged_set = active_set ^ 1;
+    nvs_handle_t staged = 0;
+    esp_err_t ret = nvs_open(NVS_SET_NAMESPACES[staged_set], NVS_READWRITE, &staged);
+    ret = ret ?: nvs_erase_all(staged); // Whatever an earlier cut off import left there
+    for (size_t idx = 0; ret == ESP_OK && idx < cnt; idx += 1) {
+        ret = nvs_set_blob(staged, items[idx].name, &items[idx].entry, sizeof(cron_store_entry));
+    }
+
+    ret = ret ?: nvs_commit(staged);
+    ret = ret ?: nvs_set_u8(meta_nvs, NVS_ACTIVE_SET_KEY, staged_set);
+    ret = ret ?: nvs_commit(meta_nvs);
+    event_trace::instance().add(event_trace::TRACE_SCHED_REPLACED, cnt, old_cnt, ret);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "replace: can't stage the new set, keeping %u old schedules: 0x%x", old_cnt, ret);
+        nvs_close(staged);
+        return ret;
+    }
+
+    // Only space to give back now, the marker already points away from the old set
+    nvs_erase_all(nvs);
+    nvs_commit(nvs);
+    nvs_close(nvs);
+    nvs = staged;
+    active_set = staged_set;
+
+    // One rebuild for the whole set
+    return load_schedules();
+}
+
+bool sched_manager::make_schedule_config(size_t idx, esp_schedule_config_t& cfg) const
+{
+    const auto &item = task_items[idx];
+    strncpy(cfg.name, item.name, sizeof(cron_task_item::name) - 1);
+    cfg.name[sizeof(cron_task_item::name) - 1] = '\0';
+
+    cfg.priv_data = (void *)idx;
+    cfg.validity.end_time = 0;
+    cfg.validity.start_time = 0;
+    cfg.trigger_cb = schedule_trigger_callback;
+    cfg.trigger.day.repeat_days = item.sched_info.day_of_week;
+    cfg.trigger.type = item.sched_info.schedule_type;
+    if (cfg.trigger.type == ESP_SCHEDULE_TYPE_DAYS_OF_WEEK) {
+        cfg.trigger.hours = item.sched_info.dow.hour;
+        cfg.trigger.minutes = item.sched_info.dow.minute;
+    } else if (cfg.trigger.type == ESP_SCHEDULE_TYPE_SUNRISE || cfg.trigger.type == ESP_SCHEDULE_TYPE_SUNSET) {
+        cfg.trigger.solar.offset_minutes = item.sched_info.offset_minute;
+    } else {
+        return false;
+    }
+
+    return true;
+}
+
+void sched_manager::schedule_dispatcher(size_t idx, uint16_t fire_id)
 {
     auto &sensor = air_sensor::instance();
     bool sensor_has_reading = sensor.has_valid_reading();
@@ -244,31 +448,53 @@ void sched_manager::schedule_dispatcher(size_t idx)
 
     if (!sensor_has_reading) {
         profile = PROFILE_MODERATE;
-        ESP_LOGI(TAG, "dispatch: no reading, profile set to MODERATE");
     } else {
         if (humidity <= air_sensor::HUMID_DRY_THRESH) {
             profile = PROFILE_DRY;
-            ESP_LOGI(TAG, "dispatch: profile set to DRY");
         } else if (humidity <= air_sensor::HUMID_MODERATE_THRESH && humidity > air_sensor::HUMID_DRY_THRESH) {
             profile = PROFILE_MODERATE;
-            ESP_LOGI(TAG, "dispatch: profile set to MODERATE");
         } else {
             profile = PROFILE_WET;
-            ESP_LOGI(TAG, "dispatch: profile set to WET");
         }
     }
 
-    uint32_t duration_ms = task_items[idx].sched_info.duration_ms[profile];
+    event_trace::instance().add(event_trace::TRACE_DISPATCH_PROFILE, idx, fire_id, profile);
+
+    // Work from a copy, an API update may rewrite the slot while the pumps are being started
+    xSemaphoreTake(items_lock, portMAX_DELAY);
+    const cron_task_item item = task_items[idx];
+    xSemaphoreGive(items_lock);
+    if (item.scheduler == nullptr) {
+        ESP_LOGW(TAG, "dispatch: schedule %u went away before it ran", idx);
+        return;
+    }
+
+    uint32_t duration_ms = item.sched_info.duration_ms[profile];
     if (duration_ms > 3600*1000) {
         ESP_LOGW(TAG, "Duration is too long, set back to 1 hour");
         duration_ms = 3600*1000;
     }
 
-    if ((task_items[idx].sched_info.select_pumps & 0b01) != 0) {
+    water_log::instance().append(water_log::make_entry(water_log::KIND_SCHEDULED, item.sched_info.select_pumps,
+        duration_ms, item.name, profile));
+
+    live_status::schedule_fired fired = {};
+    strlcpy(fired.name, item.name, sizeof(fired.name));
+    fired.pumps = item.sched_info.select_pumps;
+    fired.profile = profile;
+    fired.duration_ms = duration_ms;
+    live_status::post(live_status::STATUS_SCHEDULE_FIRED, &fired, sizeof(fired));
+
+    if (duration_ms == 0) {
+        ESP_LOGI(TAG, "dispatch: %s has no run for profile %u", item.name, profile);
+        return;
+    }
+
+    if ((item.sched_info.select_pumps & 0b01) != 0) {
         pump_manager::instance().run_a(duration_ms);
     }
 
-    if ((task_items[idx].sched_info.select_pumps & 0b10) != 0) {
+    if ((item.sched_info.select_pumps & 0b10) != 0) {
         pump_manager::instance().run_b(duration_ms);
     }
 }
@@ -278,28 +504,33 @@ void sched_manager::schedule_dispatch_task(void* _ctx)
     auto &mgr = instance();
 
     while (true) {
-        size_t idx = SIZE_MAX;
-        if (xQueueReceive(mgr.dispatch_queue, &idx, portMAX_DELAY) != pdTRUE) {
+        dispatch_request req = {};
+        if (xQueueReceive(mgr.dispatch_queue, &req, portMAX_DELAY) != pdTRUE) {
             ESP_LOGW(TAG, "dispatch_task: nothing to receive??");
             vTaskDelay(1);
             return;
         }
 
-        if (idx < 0 || idx > mgr.task_items.size()) {
+        event_trace::instance().add(event_trace::TRACE_DISPATCH_DEQUEUED, req.idx, req.fire_id);
+        if (req.idx >= mgr.task_items.size()) {
             ESP_LOGW(TAG, "Invalid index value, skipping");
-            return;
+            continue;
         }
 
-        ESP_LOGI(TAG, "dispatch_task: got %u", idx);
-        mgr.schedule_dispatcher(idx);
-        vTaskDelay(1);
+        mgr.schedule_dispatcher(req.idx, req.fire_id);
+        event_trace::instance().add(event_trace::TRACE_DISPATCH_DONE, req.idx, req.fire_id);
+
+        // No vTaskDelay() here - xQueueReceive() blocks anyway, and a back-to-back fire shouldn't wait another tick
     }
 }
 
 void sched_manager::schedule_trigger_callback(esp_schedule_handle_t handle, void* ctx) // ctx is the item!!
 {
     auto &mgr = instance();
-    auto idx = reinterpret_cast<size_t>(ctx);
-    ESP_LOGI(TAG, "trigger: enqueue %p %u", ctx, idx);
-    xQueueSend(mgr.dispatch_queue, &idx, portMAX_DELAY);
+    dispatch_request req = {};
+    req.idx = (uint16_t)reinterpret_cast<size_t>(ctx);
+    req.fire_id = mgr.next_fire_id.fetch_add(1);
+    event_trace::instance().add(event_trace::TRACE_SCHED_TRIGGER, req.idx, req.fire_id);
+    xQueueSend(mgr.dispatch_queue, &req, portMAX_DELAY);
+    event_trace::instance().add(event_trace::TRACE_SCHED_ENQUEUED, req.idx, req.fire_id);
 }
@@ -1,15 +1,16 @@
 #pragma once
 
+#include <array>
+#include <atomic>
 #include <freertos/FreeRTOS.h>
 #include <freertos/queue.h>
+#include <freertos/semphr.h>
+#include <esp_err.h>
 #include <esp_schedule.h>
 
-#include "nvs_flash.h"
 #include "nvs.h"
-#include "nvs_handle.hpp"
 
 #include "esp_bit_defs.h"
-#include "pin_defs.hpp"
 
 class sched_manager
 {
@@ -55,6 +56,19 @@ public:
         esp_schedule_type_t schedule_type;
     };
 
+    struct dispatch_request
+    {
+        uint16_t idx;
+        uint16_t fire_id; // Only for correlating trace records
+    };
+
+    // A stored schedule together with its NVS key
+    struct named_entry
+    {
+        char name[NVS_KEY_NAME_MAX_SIZE];
+        cron_store_entry entry;
+    };
+
     struct cron_task_item
     {
         esp_schedule_handle_t scheduler;
@@ -65,22 +79,42 @@ public:
     esp_err_t init();
     esp_err_t load_schedules();
     esp_err_t set_schedule(const char *name, const cron_store_entry *entry);
+    esp_err_t update_schedule(const char *name, const cron_store_entry *entry, bool *changed_out = nullptr);
     esp_err_t get_schedule(const char *name, cron_store_entry *entry_out) const;
     esp_err_t list_all_schedule_names_to_json(char *name_out, size_t len) const;
     esp_err_t delete_schedule(const char *name) const;
+    size_t get_all_schedules(named_entry *out, size_t max_cnt) const;
+    esp_err_t replace_all_schedules(const named_entry *items, size_t cnt);
+    bool next_fire(time_t &when_out, char *name_out, size_t name_len) const;
+
+    // Shared by the API and the NVS load path: nullptr if usable as-is, otherwise a short reason fit for an HTTP 400 body
+    static const char *validate_entry(const cron_store_entry &entry);
+    static const char *validate_name(const char *name);
+
+    static constexpr size_t MAX_SCHEDULES = 10;
+    static constexpr int16_t MAX_SUN_OFFSET_MIN = 24 * 60 - 1;
 
 private:
     sched_manager() = default;
-    void schedule_dispatcher(size_t idx);
+    esp_err_t reload_items(); // Caller holds items_lock
+    bool make_schedule_config(size_t idx, esp_schedule_config_t &cfg) const;
+    void schedule_dispatcher(size_t idx, uint16_t fire_id);
     static void schedule_dispatch_task(void *_ctx);
     static void schedule_trigger_callback(esp_schedule_handle_t handle, void *ctx);
 
-    nvs_handle_t nvs = 0;
+    nvs_handle_t nvs = 0; // Namespace of the active set
+    nvs_handle_t meta_nvs = 0;
+    uint8_t active_set = 0; // Index into NVS_SET_NAMESPACES, replace_all_schedules() flips it
     QueueHandle_t dispatch_queue = nullptr;
+    SemaphoreHandle_t items_lock = nullptr; // task_items is written by API calls and read by the dispatch task
+    std::atomic<uint16_t> next_fire_id = 0;
 
     // Because I'm targeting ESP32-C6 so better off use array instead of vector/deque to save heap
-    std::array<cron_task_item, 10> task_items = {};
+    std::array<cron_task_item, MAX_SCHEDULES> task_items = {};
 
 
+    static constexpr const char *NVS_SET_NAMESPACES[] = { "cron", "cron_b" };
+    static constexpr char NVS_META_NAMESPACE[] = "cron_meta";
+    static constexpr char NVS_ACTIVE_SET_KEY[] = "active";
     static const constexpr char TAG[] = "cronman";
 };
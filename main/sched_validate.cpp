@@ -0,0 +1,67 @@
+#include <cstring>
+#include <type_traits>
+
+#include "pump_manager.hpp"
+#include "sched_manager.hpp"
+
+// Entry and name checks, apart from sched_manager.cpp so the host fuzz harness in test/host can build them without NVS or esp_schedule
+
+const char* sched_manager::validate_name(const char* name)
+{
+    const size_t len = name == nullptr ? 0 : strnlen(name, NVS_KEY_NAME_MAX_SIZE);
+    if (len == 0 || len >= NVS_KEY_NAME_MAX_SIZE) {
+        return "Invalid name";
+    }
+
+    for (size_t idx = 0; idx < len; idx += 1) {
+        if (name[idx] < 0x20 || name[idx] > 0x7e || name[idx] == '"' || name[idx] == '\\') {
+            return "Invalid name";
+        }
+    }
+
+    return nullptr;
+}
+
+const char* sched_manager::validate_entry(const cron_store_entry& entry)
+{
+    if (entry.select_pumps < PUMP_0 || entry.select_pumps > PUMP_ALL) {
+        return "Invalid pump selection";
+    }
+
+    if (entry.day_of_week < 1 || entry.day_of_week > 0x7f) {
+        return "Invalid day of week selection";
+    }
+
+    // 0 leaves that profile without a run
+    for (size_t idx = 0; idx < PROFILE_COUNT; idx += 1) {
+        if (entry.duration_ms[idx] != 0 && entry.duration_ms[idx] < pump_manager::RUN_MIN_MS) {
+            return "Invalid duration";
+        }
+    }
+
+    // A blob read back from NVS can hold any bit pattern here, so look at it as a number before trusting it as the enum
+    std::underlying_type_t<esp_schedule_type_t> type = 0;
+    memcpy(&type, &entry.schedule_type, sizeof(type));
+    switch (type) {
+        case ESP_SCHEDULE_TYPE_DAYS_OF_WEEK: {
+            if (entry.dow.hour >= 24 || entry.dow.minute >= 60) {
+                return "Invalid time of day";
+            }
+            break;
+        }
+
+        case ESP_SCHEDULE_TYPE_SUNRISE:
+        case ESP_SCHEDULE_TYPE_SUNSET: {
+            if (entry.offset_minute < -MAX_SUN_OFFSET_MIN || entry.offset_minute > MAX_SUN_OFFSET_MIN) {
+                return "Invalid offset";
+            }
+            break;
+        }
+
+        default: {
+            return "Invalid schedule type";
+        }
+    }
+
+    return nullptr;
+}
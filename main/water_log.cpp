@@ -0,0 +1,288 @@
+#include <cstddef>
+#include <cstring>
+#include <ctime>
+#include <esp_log.h>
+
+#include "water_log.hpp"
+#include "air_sensor.hpp"
+
+ESP_EVENT_DEFINE_BASE(MISTY_WATER_LOG_EVENTS);
+
+esp_err_t water_log::init()
+{
+    part = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, PARTITION_LABEL);
+    if (part == nullptr) {
+        ESP_LOGW(TAG, "init: no %s partition, watering history disabled", PARTITION_LABEL);
+        return ESP_OK;
+    }
+
+    slot_cnt = (part->size / 4096) * ENTRIES_PER_SECTOR;
+    if (slot_cnt < 2 * ENTRIES_PER_SECTOR) {
+        ESP_LOGE(TAG, "init: partition too small, need at least 2 sectors");
+        part = nullptr;
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    lock = xSemaphoreCreateMutex();
+    if (lock == nullptr) {
+        ESP_LOGE(TAG, "init: can't create lock");
+        return ESP_ERR_NO_MEM;
+    }
+
+    flush_timer = xTimerCreate("water_log", pdMS_TO_TICKS(FLUSH_DELAY_MS), pdFALSE, this, flush_timer_cb);
+    if (flush_timer == nullptr) {
+        ESP_LOGE(TAG, "init: can't create flush timer");
+        return ESP_ERR_NO_MEM;
+    }
+
+    // Runs before the network brings up the default loop, so create it here if nobody did yet
+    esp_err_t ret = esp_event_loop_create_default();
+    ret = ret == ESP_ERR_INVALID_STATE ? ESP_OK : ret;
+    ret = ret ?: esp_event_handler_register(MISTY_WATER_LOG_EVENTS, ESP_EVENT_ANY_ID, water_log_event_handler, this);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "init: can't register event handler: 0x%x", ret);
+        return ret;
+    }
+
+    ret = find_head();
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "init: can't find log head: 0x%x", ret);
+        return ret;
+    }
+
+    ESP_LOGI(TAG, "init: head at slot %u/%u, next seq %lu", write_slot, slot_cnt, next_seq);
+    return ESP_OK;
+}
+
+water_log::entry water_log::make_entry(entry_kind kind, uint8_t pumps, uint32_t duration_ms, const char* name, uint8_t profile)
+{
+    entry item = {};
+    item.timestamp = (uint32_t)time(nullptr);
+    if (name != nullptr) {
+        strncpy(item.name, name, sizeof(entry::name) - 1);
+    }
+
+    item.duration_ms = duration_ms;
+    item.profile = profile;
+    item.pumps = pumps & 0b11;
+    item.kind = kind;
+
+    auto &sensor = air_sensor::instance();
+    item.humidity_centi = sensor.has_valid_reading() ? (uint16_t)(sensor.average_humidity() * 100.0f) : UINT16_MAX;
+    return item;
+}
+
+esp_err_t water_log::append(const entry& item)
+{
+    if (part == nullptr) {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    esp_err_t ret = ESP_OK;
+    xSemaphoreTake(lock, portMAX_DELAY);
+    if (pending_cnt >= pending.size()) {
+        ret = write_pending();
+        if (ret != ESP_OK) {
+            xSemaphoreGive(lock);
+            return ret;
+        }
+    }
+
+    pending[pending_cnt] = item;
+    pending[pending_cnt].seq = next_seq;
+    pending[pending_cnt].reserved = 0;
+    pending_cnt += 1;
+    next_seq += 1;
+
+    // Batch up to a full buffer so a handful of entries costs one flash write instead of several
+    if (pending_cnt >= pending.size()) {
+        ret = write_pending();
+    } else if (xTimerIsTimerActive(flush_timer) == pdFALSE) {
+        xTimerStart(flush_timer, 0);
+    }
+
+    xSemaphoreGive(lock);
+    return ret;
+}
+
+esp_err_t water_log::flush()
+{
+    if (part == nullptr) {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    xSemaphoreTake(lock, portMAX_DELAY);
+    esp_err_t ret = write_pending();
+    xSemaphoreGive(lock);
+    return ret;
+}
+
+size_t water_log::read(uint32_t& cursor, entry* out, size_t max_cnt)
+{
+    if (part == nullptr || out == nullptr || max_cnt == 0) {
+        return 0;
+    }
+
+    xSemaphoreTake(lock, portMAX_DELAY);
+
+    size_t slot = 0;
+    size_t remaining = 0; // Slots between the start and the head
+    if (cursor == 0) {
+        // Once the log has wrapped, the oldest entries are in the first sector past the head. That is the head's own
+        // sector when the head sits on a sector start, as it's only erased once the next entry goes in.
+        uint32_t seq = UINT32_MAX;
+        size_t oldest_slot = write_slot % ENTRIES_PER_SECTOR == 0 ? write_slot
+            : ((write_slot / ENTRIES_PER_SECTOR + 1) * ENTRIES_PER_SECTOR) % slot_cnt;
+        esp_partition_read(part, oldest_slot * sizeof(entry) + offsetof(entry, seq), &seq, sizeof(seq));
+        slot = (seq == UINT32_MAX) ? 0 : oldest_slot;
+        remaining = (write_slot + slot_cnt - slot) % slot_cnt;
+        remaining = (remaining == 0 && seq != UINT32_MAX) ? slot_cnt : remaining;
+    } else {
+        slot = (cursor - 1) % slot_cnt;
+        remaining = (write_slot + slot_cnt - slot) % slot_cnt;
+    }
+
+    size_t cnt = 0;
+    while (cnt < max_cnt && remaining > 0) {
+        // Read straight into the caller's buffer, as far as the sector end or the head allows
+        size_t batch = max_cnt - cnt;
+        const size_t sector_left = ENTRIES_PER_SECTOR - (slot % ENTRIES_PER_SECTOR);
+        batch = batch < sector_left ? batch : sector_left;
+        batch = batch < remaining ? batch : remaining;
+
+        if (esp_partition_read(part, slot * sizeof(entry), &out[cnt], batch * sizeof(entry)) != ESP_OK) {
+            break;
+        }
+
+        // Drop free or torn slots in place
+        const size_t base = cnt;
+        for (size_t idx = 0; idx < batch; idx += 1) {
+            if (out[base + idx].seq != UINT32_MAX) {
+                out[cnt] = out[base + idx];
+                cnt += 1;
+            }
+        }
+
+        slot = (slot + batch) % slot_cnt;
+        remaining -= batch;
+    }
+
+    cursor = slot + 1;
+    xSemaphoreGive(lock);
+    return cnt;
+}
+
+esp_err_t water_log::find_head()
+{
+    const size_t sector_cnt = slot_cnt / ENTRIES_PER_SECTOR;
+
+    // The sector whose first entry has the highest sequence number is the one being appended to
+    size_t head_sector = 0;
+    uint32_t head_seq = 0;
+    bool found = false;
+    for (size_t sector = 0; sector < sector_cnt; sector += 1) {
+        uint32_t seq = UINT32_MAX;
+        esp_err_t ret = esp_partition_read(part, sector * 4096 + offsetof(entry, seq), &seq, sizeof(seq));
+        if (ret != ESP_OK) {
+            return ret;
+        }
+
+        if (seq != UINT32_MAX && (!found || seq > head_seq)) {
+            head_sector = sector;
+            head_seq = seq;
+            found = true;
+        }
+    }
+
+    if (!found) {
+        write_slot = 0;
+        next_seq = 0;
+        return ESP_OK;
+    }
+
+    // Then the first fully erased slot in there is where the next entry goes
+    next_seq = head_seq + 1;
+    write_slot = (head_sector + 1) * ENTRIES_PER_SECTOR;
+    for (size_t slot = head_sector * ENTRIES_PER_SECTOR; slot < (head_sector + 1) * ENTRIES_PER_SECTOR; slot += 1) {
+        entry item = {};
+        esp_err_t ret = esp_partition_read(part, slot * sizeof(entry), &item, sizeof(item));
+        if (ret != ESP_OK) {
+            return ret;
+        }
+
+        const auto *raw = (const uint8_t *)&item;
+        bool erased = true;
+        for (size_t idx = 0; idx < sizeof(item); idx += 1) {
+            erased = erased && raw[idx] == 0xff;
+        }
+
+        if (erased) {
+            write_slot = slot;
+            break;
+        }
+
+        if (item.seq != UINT32_MAX && item.seq >= next_seq) {
+            next_seq = item.seq + 1;
+        }
+    }
+
+    write_slot %= slot_cnt;
+    return ESP_OK;
+}
+
+esp_err_t water_log::write_pending()
+{
+    esp_err_t ret = ESP_OK;
+    size_t written = 0;
+    while (written < pending_cnt) {
+        // Erase lazily when entering a sector, so at most one sector is erased per batch and wear is spread evenly
+        if (write_slot % ENTRIES_PER_SECTOR == 0) {
+            ret = esp_partition_erase_range(part, write_slot * sizeof(entry), 4096);
+            if (ret != ESP_OK) {
+                ESP_LOGE(TAG, "write: can't erase sector at slot %u: 0x%x", write_slot, ret);
+                break;
+            }
+        }
+
+        size_t batch = pending_cnt - written;
+        const size_t sector_left = ENTRIES_PER_SECTOR - (write_slot % ENTRIES_PER_SECTOR);
+        batch = batch < sector_left ? batch : sector_left;
+
+        ret = esp_partition_write(part, write_slot * sizeof(entry), &pending[written], batch * sizeof(entry));
+        if (ret != ESP_OK) {
+            ESP_LOGE(TAG, "write: can't write %u entries at slot %u: 0x%x", batch, write_slot, ret);
+            break;
+        }
+
+        written += batch;
+        write_slot = (write_slot + batch) % slot_cnt;
+    }
+
+    // Keep whatever didn't make it for the next attempt
+    for (size_t idx = written; idx < pending_cnt; idx += 1) {
+        pending[idx - written] = pending[idx];
+    }
+
+    pending_cnt -= written;
+    if (pending_cnt == 0) {
+        xTimerStop(flush_timer, 0);
+    }
+
+    return ret;
+}
+
+void water_log::flush_timer_cb(TimerHandle_t timer)
+{
+    // A sector erase here would hold up every other software timer, pump off timers included
+    if (esp_event_post(MISTY_WATER_LOG_EVENTS, WATER_LOG_FLUSH_DUE, nullptr, 0, 0) != ESP_OK) {
+        xTimerStart(timer, 0); // Event queue full, try again a flush period later
+    }
+}
+
+void water_log::water_log_event_handler(void* _ctx, esp_event_base_t evt_base, int32_t evt_id, void* evt_data)
+{
+    auto *ctx = (water_log *)_ctx;
+    if (evt_id == WATER_LOG_FLUSH_DUE) {
+        ctx->flush();
+    }
+}
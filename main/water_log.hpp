@@ -0,0 +1,84 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <esp_err.h>
+#include <esp_event.h>
+#include <esp_partition.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <freertos/timers.h>
+#include <nvs.h>
+
+ESP_EVENT_DECLARE_BASE(MISTY_WATER_LOG_EVENTS);
+
+class water_log
+{
+public:
+    static water_log &instance()
+    {
+        static water_log _instance;
+        return _instance;
+    }
+
+    void operator=(water_log const &) = delete;
+    water_log(water_log const &) = delete;
+
+    enum water_log_events : uint32_t
+    {
+        WATER_LOG_FLUSH_DUE = 0,
+    };
+
+    enum entry_kind : uint8_t
+    {
+        KIND_SCHEDULED = 0, // Schedule dispatched, duration is the planned run time
+        KIND_STOPPED = 1, // Pump stopped by its off timer, duration is the actual run time
+        KIND_MANUAL = 2, // Button test mode ended, duration is the actual run time
+        KIND_FAULT = 3, // Driver fault cut the pumps off, duration is the actual run time
+        KIND_API = 4, // Run started by POST /api/pump, duration is the planned run time
+    };
+
+    struct __attribute__((packed)) entry
+    {
+        uint32_t timestamp; // UNIX time in seconds, not meaningful before the first time sync
+        char name[NVS_KEY_NAME_MAX_SIZE]; // Schedule name, empty for pump-side entries
+        uint32_t duration_ms;
+        uint16_t humidity_centi; // Average RH in 0.01%, 0xffff if there was no valid reading
+        uint8_t profile;
+        uint8_t pumps : 2;
+        entry_kind kind : 3; // Was 2 bits with the next one reserved (always 0), so older entries read back the same
+        uint8_t reserved : 3;
+        uint32_t seq; // Written last in flash order, so an erased seq means a free (or torn) slot
+    };
+
+    static_assert(sizeof(entry) == 32);
+
+    esp_err_t init();
+    static entry make_entry(entry_kind kind, uint8_t pumps, uint32_t duration_ms, const char *name = nullptr, uint8_t profile = UINT8_MAX);
+    esp_err_t append(const entry &item);
+    esp_err_t flush();
+
+    // Reads up to max_cnt committed entries, oldest first, starting from an opaque cursor (0 to start over)
+    size_t read(uint32_t &cursor, entry *out, size_t max_cnt);
+
+private:
+    water_log() = default;
+    esp_err_t find_head();
+    esp_err_t write_pending();
+    static void flush_timer_cb(TimerHandle_t timer);
+    static void water_log_event_handler(void *_ctx, esp_event_base_t evt_base, int32_t evt_id, void *evt_data);
+
+    const esp_partition_t *part = nullptr;
+    SemaphoreHandle_t lock = nullptr;
+    TimerHandle_t flush_timer = nullptr;
+    size_t slot_cnt = 0;
+    size_t write_slot = 0; // Next free slot in the partition
+    uint32_t next_seq = 0;
+    size_t pending_cnt = 0;
+    std::array<entry, 8> pending = {};
+
+    static constexpr size_t ENTRIES_PER_SECTOR = 4096 / sizeof(entry);
+    static constexpr uint32_t FLUSH_DELAY_MS = 10 * 60 * 1000; // Don't hold a partial batch in RAM forever
+    static constexpr char PARTITION_LABEL[] = "waterlog";
+    static constexpr char TAG[] = "water_log";
+};
@@ -0,0 +1,150 @@
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <pthread.h>
+
+#include "api_schema.hpp"
+
+// POST /api/schedule parse cost, query string form against the JSON body form, for the same two schedules.
+// Time is per parse over many repeats. Stack is the deepest byte written while parsing on a painted thread stack,
+// less what an empty run on the same stack touches. Both are host numbers: compare the two forms with each other, not
+// with the device.
+
+static constexpr size_t BODY_LEN = 256; // config_server's query[] and SCHEDULE_JSON_MAX_LEN buffers
+static constexpr size_t STACK_LEN = 64 * 1024;
+static constexpr uint8_t PAINT = 0xa5;
+
+struct sample
+{
+    const char *label;
+    const char *query;
+    const char *json;
+};
+
+static constexpr sample SAMPLES[] = {
+    { "dow", "type=dow&name=Morning&pump=1&dow=127&hour=8&min=0&durd=8000&durm=5000&durw=2000",
+        R"({"name":"Morning","pump":1,"dow":127,"h":8,"m":0,"duration":[8000,5000,2000],"type":"dow"})" },
+    { "sunset", "type=sunset&name=Evening&pump=2&dow=64&off=-15&durd=3000&durm=3000&durw=3000",
+        R"({"name":"Evening","pump":2,"dow":64,"offset":-15,"duration":[3000,3000,3000],"type":"sunset"})" },
+};
+
+// Each one copies the input into a handler sized buffer first, as the handlers do, so the frames compare like for like
+static bool __attribute__((noinline)) parse_query(const char *input)
+{
+    char query[BODY_LEN] = { 0 };
+    strncpy(query, input, sizeof(query) - 1);
+    api_schema::schedule_doc doc = {};
+    return api_schema::parse_schedule_query(query, doc) == nullptr;
+}
+
+static bool __attribute__((noinline)) parse_json(const char *input)
+{
+    char buf[BODY_LEN] = { 0 };
+    const size_t len = strnlen(input, sizeof(buf) - 1);
+    memcpy(buf, input, len);
+    api_schema::schedule_doc doc = {};
+    return json_schema::parse_object(buf, (int)len, api_schema::SCHEDULE_FIELDS, api_schema::SCHEDULE_FIELD_CNT, &doc) == nullptr;
+}
+
+static bool __attribute__((noinline)) parse_none(const char *)
+{
+    return true;
+}
+
+struct stack_run
+{
+    bool (*fn)(const char *);
+    const char *input;
+    bool ok;
+};
+
+static void *stack_thread(void *_run)
+{
+    auto *run = (stack_run *)_run;
+    run->ok = run->fn(run->input);
+    return nullptr;
+}
+
+// Bytes of a painted stack the call touched, glibc keeps the thread's TLS at the top of it too
+static size_t stack_used(bool (*fn)(const char *), const char *input, bool &ok)
+{
+    auto *stack = (uint8_t *)aligned_alloc(4096, STACK_LEN);
+    memset(stack, PAINT, STACK_LEN);
+
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setstack(&attr, stack, STACK_LEN);
+    stack_run run = { fn, input, false };
+    pthread_t thread;
+    if (pthread_create(&thread, &attr, stack_thread, &run) != 0) {
+        fprintf(stderr, "Can't start stack thread\n");
+        exit(1);
+    }
+
+    pthread_join(thread, nullptr);
+    pthread_attr_destroy(&attr);
+
+    size_t untouched = 0;
+    while (untouched < STACK_LEN && stack[untouched] == PAINT) {
+        untouched += 1;
+    }
+
+    free(stack);
+    ok = run.ok;
+    return STACK_LEN - untouched;
+}
+
+// Best of a few rounds, the slower ones are the host doing something else
+static double ns_per_parse(bool (*fn)(const char *), const char *input, unsigned long repeats)
+{
+    double best = 0;
+    for (int round = 0; round < 5; round += 1) {
+        volatile bool sink = false;
+        const auto start = std::chrono::steady_clock::now();
+        for (unsigned long idx = 0; idx < repeats; idx += 1) {
+            sink = fn(input);
+        }
+
+        const auto elapsed = std::chrono::steady_clock::now() - start;
+        (void)sink;
+        const double ns = (double)std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count() / (double)repeats;
+        best = round == 0 || ns < best ? ns : best;
+    }
+
+    return best;
+}
+
+int main(int argc, char **argv)
+{
+    const unsigned long repeats = argc > 1 ? strtoul(argv[1], nullptr, 10) : 200000;
+
+    // Lazy symbol binding on first calls runs in the dynamic linker on whatever stack is current, get it done here
+    for (const auto &sample : SAMPLES) {
+        parse_query(sample.query);
+        parse_json(sample.json);
+    }
+
+    bool ok = false;
+    const size_t base = stack_used(parse_none, "", ok);
+
+    printf("%-8s %-6s %10s %8s\n", "schedule", "form", "ns/parse", "stack");
+    bool all_ok = true;
+    for (const auto &sample : SAMPLES) {
+        const size_t query_stack = stack_used(parse_query, sample.query, ok) - base;
+        all_ok = all_ok && ok;
+        const size_t json_stack = stack_used(parse_json, sample.json, ok) - base;
+        all_ok = all_ok && ok;
+
+        printf("%-8s %-6s %10.1f %8zu\n", sample.label, "query", ns_per_parse(parse_query, sample.query, repeats), query_stack);
+        printf("%-8s %-6s %10.1f %8zu\n", sample.label, "json", ns_per_parse(parse_json, sample.json, repeats), json_stack);
+    }
+
+    if (!all_ok) {
+        fprintf(stderr, "A sample failed to parse\n");
+        return 1;
+    }
+
+    return 0;
+}
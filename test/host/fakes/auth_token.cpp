@@ -0,0 +1,39 @@
+#include <cstring>
+#include <esp_timer.h>
+
+#include "auth_token.hpp"
+
+// Stands in for the pairing token: a fixed one instead of NVS and HMAC, the pairing window works as on the device
+
+static constexpr char HOST_TOKEN_HEX[] = "00112233445566778899aabbccddeeff";
+static constexpr char HOST_AP_PASSWORD[] = "hostpassword";
+
+esp_err_t auth_token::init()
+{
+    static_assert(sizeof(HOST_TOKEN_HEX) == sizeof(token_hex) && sizeof(HOST_AP_PASSWORD) == sizeof(ap_pwd));
+    memcpy(token_hex, HOST_TOKEN_HEX, sizeof(token_hex));
+    memcpy(ap_pwd, HOST_AP_PASSWORD, sizeof(ap_pwd));
+    return ESP_OK;
+}
+
+bool auth_token::check(const char *hex) const
+{
+    return memcmp(hex, token_hex, sizeof(token_hex)) == 0;
+}
+
+void auth_token::open_pairing()
+{
+    pair_deadline_us = esp_timer_get_time() + PAIR_WINDOW_MS * 1000LL;
+}
+
+bool auth_token::take_pairing(char *out, size_t out_len)
+{
+    int64_t deadline = pair_deadline_us.load();
+    if (out_len <= TOKEN_HEX_LEN || deadline == 0 || esp_timer_get_time() > deadline) {
+        return false;
+    }
+
+    pair_deadline_us = 0;
+    memcpy(out, token_hex, sizeof(token_hex));
+    return true;
+}
@@ -0,0 +1,13 @@
+#include "net_configurator.hpp"
+
+// Stands in for the WiFi side of the config API: takes any config, never connects
+
+esp_err_t net_configurator::set_wifi_config(wifi_config_t *config, bool _static_ip)
+{
+    if (config == nullptr) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    static_ip = _static_ip;
+    return ESP_OK;
+}
@@ -0,0 +1,183 @@
+#include <cstdlib>
+#include <cstring>
+#include <esp_timer.h>
+
+#include "ota_manager.hpp"
+
+// Stands in for the updater: same state machine as the real one (begin, suspend, resume, finish), buffers are plain heap
+// and come straight back on submit() as if the writer were instant. Nothing is flashed or hashed - the host's image
+// digest is all zeros, so that is the delta base and the finish() result.
+
+static constexpr size_t HOST_PARTITION_SIZE = 0x1c0000; // ota_0 and ota_1 in partitions.csv
+
+esp_err_t ota_manager::begin(size_t image_size, const uint8_t *expected_sha256_in)
+{
+    if (update_handle != 0) {
+        return ESP_ERR_INVALID_STATE;
+    } else if (image_size > HOST_PARTITION_SIZE) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    for (size_t idx = 0; idx < BUF_COUNT; idx += 1) {
+        bufs[idx] = (uint8_t *)malloc(BUF_SIZE);
+        buf_lens[idx] = SIZE_MAX; // Free
+    }
+
+    check_sha256 = expected_sha256_in != nullptr;
+    if (check_sha256) {
+        memcpy(expected_sha256, expected_sha256_in, SHA256_LEN);
+    }
+
+    update_handle = 1;
+    received = 0;
+    written = 0;
+    upload_size = image_size;
+    suspended_us = 0;
+    start_us = esp_timer_get_time();
+    return ESP_OK;
+}
+
+esp_err_t ota_manager::begin_delta(const delta_header &header, size_t upload_size_in)
+{
+    if (header.magic != DELTA_MAGIC || header.version != DELTA_VERSION) {
+        return ESP_ERR_INVALID_VERSION;
+    }
+
+    static constexpr uint8_t RUNNING_SHA256[SHA256_LEN] = {};
+    if (memcmp(RUNNING_SHA256, header.base_sha256, SHA256_LEN) != 0) {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+
+    esp_err_t ret = begin(header.image_size, header.image_sha256);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+
+    delta_handle = this;
+    received = sizeof(header);
+    upload_size = upload_size_in;
+    return ESP_OK;
+}
+
+uint8_t *ota_manager::acquire()
+{
+    for (size_t idx = 0; idx < BUF_COUNT; idx += 1) {
+        if (bufs[idx] != nullptr && buf_lens[idx] == SIZE_MAX) {
+            buf_lens[idx] = 0;
+            return bufs[idx];
+        }
+    }
+
+    return nullptr;
+}
+
+esp_err_t ota_manager::submit(uint8_t *buf, size_t len)
+{
+    for (size_t idx = 0; idx < BUF_COUNT; idx += 1) {
+        if (bufs[idx] == buf && buf_lens[idx] != SIZE_MAX) {
+            received += len;
+            written += len;
+            buf_lens[idx] = SIZE_MAX;
+            return ESP_OK;
+        }
+    }
+
+    ::abort(); // Not a buffer we handed out
+}
+
+void ota_manager::release(uint8_t *buf)
+{
+    for (size_t idx = 0; idx < BUF_COUNT; idx += 1) {
+        if (bufs[idx] == buf && buf_lens[idx] != SIZE_MAX) {
+            buf_lens[idx] = SIZE_MAX;
+            return;
+        }
+    }
+
+    ::abort();
+}
+
+void ota_manager::suspend()
+{
+    if (update_handle == 0) {
+        return;
+    }
+
+    suspended_us = esp_timer_get_time();
+}
+
+esp_err_t ota_manager::resume(size_t offset_in, size_t upload_size_in)
+{
+    expire_suspended();
+    if (update_handle == 0 || suspended_us == 0) {
+        return ESP_ERR_INVALID_STATE;
+    } else if (offset_in != received || upload_size_in != upload_size) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    suspended_us = 0;
+    return ESP_OK;
+}
+
+void ota_manager::expire_suspended()
+{
+    if (suspended_us != 0 && esp_timer_get_time() - suspended_us > RESUME_WINDOW_US) {
+        abort();
+    }
+}
+
+esp_err_t ota_manager::finish(result &out)
+{
+    out.received = received;
+    out.bytes = written;
+    out.elapsed_ms = (uint32_t)((esp_timer_get_time() - start_us) / 1000);
+    memset(out.sha256, 0, SHA256_LEN);
+
+    const bool mismatch = check_sha256 && memcmp(out.sha256, expected_sha256, SHA256_LEN) != 0;
+    delta_handle = nullptr;
+    update_handle = 0;
+    cleanup();
+    return mismatch ? ESP_ERR_INVALID_CRC : ESP_OK;
+}
+
+void ota_manager::abort()
+{
+    if (update_handle == 0) {
+        return;
+    }
+
+    delta_handle = nullptr;
+    update_handle = 0;
+    suspended_us = 0;
+    cleanup();
+}
+
+void ota_manager::cleanup()
+{
+    for (size_t idx = 0; idx < BUF_COUNT; idx += 1) {
+        if (bufs[idx] != nullptr && buf_lens[idx] != SIZE_MAX) {
+            ::abort(); // Still held by the caller
+        }
+
+        free(bufs[idx]);
+        bufs[idx] = nullptr;
+    }
+}
+
+bool ota_manager::parse_sha256_hex(const char *hex, uint8_t *out)
+{
+    if (hex == nullptr || strnlen(hex, SHA256_LEN * 2 + 1) != SHA256_LEN * 2) {
+        return false;
+    }
+
+    for (size_t idx = 0; idx < SHA256_LEN; idx += 1) {
+        char byte_str[3] = { hex[idx * 2], hex[idx * 2 + 1], '\0' };
+        char *end = nullptr;
+        out[idx] = (uint8_t)strtoul(byte_str, &end, 16);
+        if (end != byte_str + 2) {
+            return false;
+        }
+    }
+
+    return true;
+}
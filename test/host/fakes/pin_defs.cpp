@@ -0,0 +1,8 @@
+#include "pin_defs.hpp"
+
+// Stands in for the charger status pins: on battery
+
+misty::charge_state misty::get_charge_state()
+{
+    return CHARGE_NONE;
+}
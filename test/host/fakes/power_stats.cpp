@@ -0,0 +1,14 @@
+#include "power_stats.hpp"
+
+// Stands in for the PM dump with text of about the device's length, several times the stream buffer in front of it
+
+esp_err_t power_stats::dump(FILE *out) const
+{
+    for (int idx = 0; idx < 24; idx += 1) {
+        if (fprintf(out, "task %-16s %8d %3d%%\n", "host", idx * 1000, idx % 100) < 0) {
+            return ESP_FAIL;
+        }
+    }
+
+    return ESP_OK;
+}
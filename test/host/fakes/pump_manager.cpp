@@ -0,0 +1,65 @@
+#include "pump_manager.hpp"
+
+// Stands in for the pumps for the config API: same argument checks as the real runs, no motors, timers or log entries.
+// A run stays on until stop().
+
+esp_err_t pump_manager::run_a(uint32_t duration_ms, uint8_t duty)
+{
+    if (duration_ms < RUN_MIN_MS || duration_ms > RUN_MAX_MS || duty == 0 || duty > DUTY_MAX) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    motor_a_running = true;
+    return ESP_OK;
+}
+
+esp_err_t pump_manager::run_b(uint32_t duration_ms, uint8_t duty)
+{
+    if (duration_ms < RUN_MIN_MS || duration_ms > RUN_MAX_MS || duty == 0 || duty > DUTY_MAX) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    motor_b_running = true;
+    return ESP_OK;
+}
+
+esp_err_t pump_manager::run_manual(uint8_t pumps, uint32_t duration_ms, uint8_t duty)
+{
+    if (pumps == 0 || pumps > 0b11 || duration_ms < RUN_MIN_MS || duration_ms > RUN_MAX_MS || duty == 0 || duty > DUTY_MAX) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    esp_err_t ret = ESP_OK;
+    if ((pumps & 0b01) != 0) {
+        ret = run_a(duration_ms, duty);
+    }
+
+    if ((pumps & 0b10) != 0) {
+        ret = ret ?: run_b(duration_ms, duty);
+    }
+
+    return ret;
+}
+
+esp_err_t pump_manager::stop(uint8_t pumps)
+{
+    if ((pumps & 0b01) != 0) {
+        motor_a_running = false;
+    }
+
+    if ((pumps & 0b10) != 0) {
+        motor_b_running = false;
+    }
+
+    return ESP_OK;
+}
+
+uint8_t pump_manager::running_pumps() const
+{
+    return (motor_a_running ? 0b01 : 0) | (motor_b_running ? 0b10 : 0);
+}
+
+uint32_t pump_manager::remaining_ms(uint8_t) const
+{
+    return 0;
+}
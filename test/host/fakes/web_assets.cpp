@@ -0,0 +1,11 @@
+// Stands in for the gzipped page EMBED_FILES puts in flash: filler bytes, a few ASSET_CHUNK_SIZE chunks long
+
+asm(R"(
+    .section .rodata
+    .global _binary_index_html_gz_start
+    .global _binary_index_html_gz_end
+_binary_index_html_gz_start:
+    .fill 3000, 1, 0x1f
+_binary_index_html_gz_end:
+    .previous
+)");
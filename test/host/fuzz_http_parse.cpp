@@ -0,0 +1,37 @@
+#include <cctype>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#include "http_parse.hpp"
+
+// Header values as config_server gets them from httpd_req_get_hdr_value_str(), i.e. NUL-terminated
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+    const std::string value((const char *)data, strnlen((const char *)data, size));
+
+    unsigned long first = 0, last = 0, total = 0;
+    if (http_parse::parse_content_range(value.c_str(), first, last, total) && strncmp(value.c_str(), "bytes ", 6) != 0) {
+        abort();
+    }
+
+    http_parse::accepts_encoding(value.c_str(), "gzip");
+
+    // Absent header and "*" both allow anything
+    if (!http_parse::accepts_encoding(nullptr, "gzip") || !http_parse::accepts_encoding("*", "gzip")) {
+        abort();
+    }
+
+    // Appending an explicit "gzip;q=0" rules gzip out unless the value already named it, wildcards included
+    std::string lower = value;
+    for (auto &c : lower) {
+        c = (char)tolower((unsigned char)c);
+    }
+
+    if (lower.find("gzip") == std::string::npos && http_parse::accepts_encoding((value + ",gzip;q=0").c_str(), "gzip")) {
+        abort();
+    }
+
+    return 0;
+}
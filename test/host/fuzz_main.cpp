@@ -0,0 +1,164 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <dirent.h>
+#include <string>
+#include <vector>
+
+// Stand-in for libFuzzer's main when the compiler doesn't ship libFuzzer (gcc). Takes the same command line as the
+// libFuzzer build, "-runs=N [-seed=N] <corpus dir or file>...": every corpus input runs once as-is, then N inputs made
+// by mutating and splicing them. Each input gets its own exact-size heap copy so ASan sees any read past its end.
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size);
+
+static constexpr size_t MAX_LEN = 4096;
+
+// Bytes worth planting, they steer mutations towards JSON, query string and header syntax
+static constexpr char TOKENS[] = "{}[]\":,=&-+.;/*\\ \t\r\n0123456789eEqx";
+
+static uint64_t rng_state = 0x9e3779b97f4a7c15ULL;
+
+static uint64_t next_rand()
+{
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return rng_state;
+}
+
+static size_t rand_below(size_t limit)
+{
+    return limit == 0 ? 0 : (size_t)(next_rand() % limit);
+}
+
+static void run_one(const std::vector<uint8_t> &input)
+{
+    // The copy is what makes overreads visible, a vector's capacity could hide them
+    auto *copy = (uint8_t *)malloc(input.empty() ? 1 : input.size());
+    if (!input.empty()) {
+        memcpy(copy, input.data(), input.size());
+    }
+
+    LLVMFuzzerTestOneInput(copy, input.size());
+    free(copy);
+}
+
+static void load_path(const std::string &path, std::vector<std::vector<uint8_t>> &corpus)
+{
+    if (DIR *dir = opendir(path.c_str()); dir != nullptr) {
+        while (const dirent *ent = readdir(dir)) {
+            if (ent->d_name[0] != '.') {
+                load_path(path + "/" + ent->d_name, corpus);
+            }
+        }
+
+        closedir(dir);
+        return;
+    }
+
+    FILE *file = fopen(path.c_str(), "rb");
+    if (file == nullptr) {
+        return;
+    }
+
+    std::vector<uint8_t> data;
+    uint8_t buf[512];
+    size_t got = 0;
+    while ((got = fread(buf, 1, sizeof(buf), file)) > 0 && data.size() < MAX_LEN) {
+        data.insert(data.end(), buf, buf + got);
+    }
+
+    fclose(file);
+    data.resize(std::min(data.size(), MAX_LEN));
+    corpus.push_back(std::move(data));
+}
+
+static void mutate(std::vector<uint8_t> &data, const std::vector<std::vector<uint8_t>> &corpus)
+{
+    const size_t rounds = 1 + rand_below(8);
+    for (size_t round = 0; round < rounds; round += 1) {
+        const size_t pos = rand_below(data.size() + 1);
+        switch (rand_below(7)) {
+            case 0: {
+                if (pos < data.size()) {
+                    data[pos] ^= (uint8_t)(1U << rand_below(8));
+                }
+                break;
+            }
+            case 1: {
+                if (pos < data.size()) {
+                    data[pos] = (uint8_t)next_rand();
+                }
+                break;
+            }
+            case 2: {
+                if (data.size() < MAX_LEN) {
+                    data.insert(data.begin() + pos, (uint8_t)TOKENS[rand_below(sizeof(TOKENS) - 1)]);
+                }
+                break;
+            }
+            case 3: {
+                const size_t cnt = std::min(data.size() - std::min(pos, data.size()), 1 + rand_below(8));
+                data.erase(data.begin() + pos, data.begin() + pos + cnt);
+                break;
+            }
+            case 4: {
+                // Repeat a slice, e.g. a key/value pair or a nesting level
+                const size_t cnt = std::min(data.size() - std::min(pos, data.size()), 1 + rand_below(16));
+                const std::vector<uint8_t> slice(data.begin() + pos, data.begin() + pos + cnt);
+                if (data.size() + cnt <= MAX_LEN) {
+                    data.insert(data.begin() + rand_below(data.size() + 1), slice.begin(), slice.end());
+                }
+                break;
+            }
+            case 5: {
+                data.resize(pos);
+                break;
+            }
+            default: {
+                // Splice the tail of another corpus entry in
+                const auto &other = corpus[rand_below(corpus.size())];
+                const size_t from = rand_below(other.size() + 1);
+                data.resize(pos);
+                data.insert(data.end(), other.begin() + from, other.end());
+                data.resize(std::min(data.size(), MAX_LEN));
+                break;
+            }
+        }
+    }
+}
+
+int main(int argc, char **argv)
+{
+    unsigned long runs = 10000;
+    std::vector<std::vector<uint8_t>> corpus;
+    for (int idx = 1; idx < argc; idx += 1) {
+        if (strncmp(argv[idx], "-runs=", 6) == 0) {
+            runs = strtoul(argv[idx] + 6, nullptr, 10);
+        } else if (strncmp(argv[idx], "-seed=", 6) == 0) {
+            rng_state = strtoull(argv[idx] + 6, nullptr, 10) | 1;
+        } else if (argv[idx][0] != '-') {
+            load_path(argv[idx], corpus);
+        }
+    }
+
+    if (corpus.empty()) {
+        corpus.emplace_back();
+    }
+
+    for (const auto &input : corpus) {
+        run_one(input);
+    }
+
+    std::vector<uint8_t> input;
+    for (unsigned long run = 0; run < runs; run += 1) {
+        input = corpus[rand_below(corpus.size())];
+        mutate(input, corpus);
+        run_one(input);
+    }
+
+    printf("Done %lu runs over %zu corpus inputs\n", runs, corpus.size());
+    return 0;
+}
@@ -0,0 +1,37 @@
+#include <cstdint>
+#include <cstdlib>
+
+#include "mjson.h"
+
+// mjson's tokeniser and the lookups built on it, fed raw bytes with no terminator the way request bodies arrive
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+    const auto *buf = (const char *)data;
+    const int len = (int)size;
+    mjson(buf, len, nullptr, nullptr);
+
+    // Top level walk, as the schedule import does over its array
+    int offset = 0;
+    int key_off = 0, key_len = 0, val_off = 0, val_len = 0, val_type = 0;
+    while ((offset = mjson_next(buf, len, offset, &key_off, &key_len, &val_off, &val_len, &val_type)) > 0) {
+        if (key_off < 0 || key_len < 0 || key_off + key_len > len || val_off < 0 || val_len < 0 || val_off + val_len > len) {
+            abort();
+        }
+
+        mjson(buf + val_off, val_len, nullptr, nullptr);
+    }
+
+    const char *tok = nullptr;
+    int tok_len = 0;
+    if (mjson_find(buf, len, "$.duration[1]", &tok, &tok_len) != MJSON_TOK_INVALID && (tok < buf || tok + tok_len > buf + len)) {
+        abort();
+    }
+
+    char str[16];
+    double num = 0;
+    int flag = 0;
+    mjson_get_string(buf, len, "$.name", str, sizeof(str));
+    mjson_get_number(buf, len, "$.pump", &num);
+    mjson_get_bool(buf, len, "$[0].x", &flag);
+    return 0;
+}
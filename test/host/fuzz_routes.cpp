@@ -0,0 +1,217 @@
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "auth_token.hpp"
+#include "config_server.hpp"
+#include "host_fakes.h"
+#include "mjson.h"
+#include "ota_manager.hpp"
+#include "pump_manager.hpp"
+#include "sched_manager.hpp"
+#include "water_log.hpp"
+
+// Every route config_server::init() registers, called through dispatch() with a request made up from the input:
+//
+//   <flags><recv max>METHOD /uri?query
+//   Header: value
+//   ...
+//   <empty line>
+//   body
+//
+// Flags is the low five bits of its byte, '@' for none: 'A' adds a valid Authorization header, 'B' ends the body one
+// byte short of Content-Length, 'D' makes that a receive timeout instead of a close, 'H' sends the body as a websocket
+// frame and 'P' opens the pairing window. Recv max caps what one httpd_req_recv() returns ('@' for no cap), so receive
+// loops see their data in pieces.
+//
+// Each run starts from the same state: two stored schedules, an OTA upload suspended after its first buffer and both
+// pumps off.
+// A handler returning ESP_OK must have sent a whole response, and a 2xx JSON body must parse.
+
+static constexpr size_t MAX_HDR_LEN = CONFIG_HTTPD_MAX_REQ_HDR_LEN; // Longer gets a 431 before any handler runs
+static constexpr size_t OTA_SUSPENDED_SIZE = ota_manager::BUF_SIZE + 1024; // Small enough to finish within one input
+
+static config_server server;
+static char token[auth_token::TOKEN_HEX_LEN + 1] = {};
+
+static const sched_manager::named_entry SEED_SCHEDULES[] = {
+    { "morning", { .select_pumps = sched_manager::PUMP_0, .day_of_week = 0x7f, .dow = { .hour = 7, .minute = 30 },
+        .duration_ms = { 8000, 5000, 0 }, .schedule_type = ESP_SCHEDULE_TYPE_DAYS_OF_WEEK } },
+    { "dusk b", { .select_pumps = sched_manager::PUMP_ALL, .day_of_week = 0x41, .offset_minute = -15,
+        .duration_ms = { 3000, 3000, 3000 }, .schedule_type = ESP_SCHEDULE_TYPE_SUNSET } },
+};
+
+static bool setup()
+{
+    host_partition_create("waterlog", 0x10000);
+    host_partition_create("trace", 0x2000);
+
+    esp_err_t ret = water_log::instance().init();
+    ret = ret ?: auth_token::instance().init();
+    ret = ret ?: sched_manager::instance().init();
+    ret = ret ?: server.init();
+    if (ret != ESP_OK || host_httpd_route_count() == 0) {
+        fprintf(stderr, "setup failed: 0x%x\n", ret);
+        abort();
+    }
+
+    // Names with characters JSON has to escape, one slot per kind
+    static constexpr const char *LOG_NAMES[] = { "morning", "quote\"slash\\", "", "tab\there" };
+    for (size_t idx = 0; idx < 12; idx += 1) {
+        const auto kind = (water_log::entry_kind)(idx % 5);
+        water_log::instance().append(water_log::make_entry(kind, (uint8_t)(1 + idx % 3), 1000 * idx, LOG_NAMES[idx % 4]));
+    }
+
+    water_log::instance().flush();
+
+    auth_token::instance().open_pairing();
+    if (!auth_token::instance().take_pairing(token, sizeof(token))) {
+        abort();
+    }
+
+    return true;
+}
+
+static void reset_state(bool open_pairing)
+{
+    if (sched_manager::instance().replace_all_schedules(SEED_SCHEDULES, std::size(SEED_SCHEDULES)) != ESP_OK) {
+        abort();
+    }
+
+    auto &ota = ota_manager::instance();
+    ota.abort();
+    if (ota.begin(OTA_SUSPENDED_SIZE, nullptr) != ESP_OK) {
+        abort();
+    }
+
+    uint8_t *buf = ota.acquire();
+    if (buf == nullptr || ota.submit(buf, ota_manager::BUF_SIZE) != ESP_OK) {
+        abort();
+    }
+
+    ota.suspend();
+    pump_manager::instance().stop(sched_manager::PUMP_ALL);
+    if (open_pairing) {
+        auth_token::instance().open_pairing();
+    }
+}
+
+static const httpd_uri_t *find_route(const std::string &line)
+{
+    const size_t space = line.find(' ');
+    const std::string method = line.substr(0, space);
+    const std::string uri = space == std::string::npos ? "" : line.substr(space + 1, line.find('?') - space - 1);
+    const size_t cnt = host_httpd_route_count();
+    for (size_t idx = 0; idx < cnt; idx += 1) {
+        const httpd_uri_t *route = host_httpd_route(idx);
+        if (method == http_method_str(route->method) && uri == route->uri) {
+            return route;
+        }
+    }
+
+    // Mutations break the request line more often than not, still give the rest of the input a handler to go to
+    return host_httpd_route(line.size() % cnt);
+}
+
+static bool next_line(const uint8_t *data, size_t size, size_t &pos, std::string &line)
+{
+    if (pos >= size) {
+        return false;
+    }
+
+    const auto *end = (const uint8_t *)memchr(data + pos, '\n', size - pos);
+    const size_t len = end == nullptr ? size - pos : (size_t)(end - (data + pos));
+    line.assign((const char *)data + pos, len);
+    if (!line.empty() && line.back() == '\r') {
+        line.pop_back();
+    }
+
+    pos += len + (end == nullptr ? 0 : 1);
+    return true;
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+    static const bool ready = setup();
+    (void)ready;
+
+    if (size < 2) {
+        return 0;
+    }
+
+    const uint8_t flags = data[0] & 0x1f;
+    const size_t recv_max = data[1] & 0x3f;
+    size_t pos = 2;
+
+    std::string request_line;
+    next_line(data, size, pos, request_line);
+    if (request_line.size() > HTTPD_MAX_URI_LEN + 8) {
+        return 0; // 414 from the server itself
+    }
+
+    const httpd_uri_t *route = find_route(request_line);
+    const size_t query_start = request_line.find('?');
+    const std::string query = query_start == std::string::npos ? "" : request_line.substr(query_start + 1);
+
+    // Headers end at an empty line, anything after it is the body
+    std::vector<std::pair<std::string, std::string>> header_text;
+    size_t hdr_len = 0;
+    std::string line;
+    while (next_line(data, size, pos, line) && !line.empty()) {
+        hdr_len += line.size() + 2;
+        const size_t colon = line.find(':');
+        if (colon != std::string::npos) {
+            header_text.emplace_back(line.substr(0, colon), line.substr(colon + 1));
+        }
+    }
+
+    if (hdr_len > MAX_HDR_LEN) {
+        return 0;
+    }
+
+    const std::string bearer = std::string("Bearer ") + token;
+    if ((flags & 0x01) != 0) {
+        header_text.emplace_back("Authorization", bearer);
+    }
+
+    std::vector<host_http_header> headers;
+    for (const auto &[name, value] : header_text) {
+        headers.push_back({ name.c_str(), value.c_str() });
+    }
+
+    reset_state((flags & 0x10) != 0);
+
+    const size_t body_len = size - std::min(pos, size);
+    host_http_request request = {
+        .query = query_start == std::string::npos ? nullptr : query.c_str(),
+        .headers = headers.data(),
+        .header_cnt = headers.size(),
+        .body = data + size - body_len,
+        .body_len = body_len,
+        .content_len = body_len + ((flags & 0x02) != 0 ? 1 : 0),
+        .recv_max = recv_max,
+        .recv_timeout = (flags & 0x04) != 0,
+        .ws_frame = (flags & 0x08) != 0 && route->is_websocket,
+    };
+
+    const host_http_response *resp = nullptr;
+    const esp_err_t ret = host_httpd_call(route, &request, &resp);
+    host_event_run();
+
+    if (ret == ESP_OK && !request.ws_frame && !resp->complete) {
+        fprintf(stderr, "%s %s returned ESP_OK without finishing its response\n", http_method_str(route->method), route->uri);
+        abort();
+    }
+
+    if (resp->complete && resp->status[0] == '2' && strcmp(resp->type, "application/json") == 0
+        && mjson((const char *)resp->body, (int)resp->body_len, nullptr, nullptr) != (int)resp->body_len) {
+        fprintf(stderr, "%s %s sent %s with a body that isn't JSON: %.*s\n", http_method_str(route->method), route->uri,
+            resp->status, (int)resp->body_len, (const char *)resp->body);
+        abort();
+    }
+
+    return 0;
+}
@@ -0,0 +1,76 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#include "api_schema.hpp"
+#include "pump_manager.hpp"
+
+// sched_manager::validate_entry() and validate_name() over raw blobs, as read back from NVS, and over query strings.
+// Whatever they pass has to be safe to hand to the pump timers and to print into JSON unescaped.
+
+static void check_entry(const sched_manager::cron_store_entry &entry)
+{
+    if (sched_manager::validate_entry(entry) != nullptr) {
+        return;
+    }
+
+    // xTimerChangePeriod() asserts on a zero period, and the dispatcher only skips a duration of exactly 0
+    for (size_t idx = 0; idx < sched_manager::PROFILE_COUNT; idx += 1) {
+        if (entry.duration_ms[idx] != 0 && pdMS_TO_TICKS(entry.duration_ms[idx]) == 0) {
+            abort();
+        }
+    }
+
+    if (entry.select_pumps < sched_manager::PUMP_0 || entry.select_pumps > sched_manager::PUMP_ALL || entry.day_of_week == 0
+        || entry.day_of_week > 0x7f) {
+        abort();
+    }
+}
+
+static void check_name(const char *name)
+{
+    if (sched_manager::validate_name(name) != nullptr) {
+        return;
+    }
+
+    // The schedule name list writes names between plain quotes, so escaping must never be needed
+    const size_t len = strnlen(name, NVS_KEY_NAME_MAX_SIZE);
+    char quoted[NVS_KEY_NAME_MAX_SIZE * 6 + 3] = { 0 };
+    if (len == 0 || len >= NVS_KEY_NAME_MAX_SIZE || mjson_snprintf(quoted, sizeof(quoted), "%.*Q", (int)len, name) != (int)len + 2
+        || memcmp(quoted + 1, name, len) != 0) {
+        abort();
+    }
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+    if (size < 1) {
+        return 0;
+    }
+
+    if (data[0] & 1) {
+        const std::string query((const char *)data + 1, size - 1);
+        api_schema::schedule_doc doc = {};
+        if (api_schema::parse_schedule_query(query.c_str(), doc) == nullptr) {
+            check_entry(doc.entry);
+            check_name(doc.name);
+        }
+
+        return 0;
+    }
+
+    // Entry blob, then the name in a buffer of exactly the NVS key size that needn't be terminated
+    sched_manager::cron_store_entry entry = {};
+    const size_t entry_len = std::min(size - 1, sizeof(entry));
+    memcpy(&entry, data + 1, entry_len);
+    check_entry(entry);
+
+    auto *name = (char *)malloc(NVS_KEY_NAME_MAX_SIZE);
+    memset(name, 0, NVS_KEY_NAME_MAX_SIZE);
+    memcpy(name, data + 1 + entry_len, std::min(size - 1 - entry_len, (size_t)NVS_KEY_NAME_MAX_SIZE));
+    check_name(name);
+    free(name);
+    return 0;
+}
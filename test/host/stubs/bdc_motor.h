@@ -0,0 +1,5 @@
+#pragma once
+
+// Host stand-in for the bdc_motor component, pump_manager.hpp only needs the handle type
+
+typedef struct bdc_motor_t *bdc_motor_handle_t;
@@ -0,0 +1,13 @@
+#pragma once
+
+// Host stand-in, handle types only
+
+#include "gpio.h"
+
+typedef enum {
+    I2C_NUM_0 = 0,
+    I2C_NUM_MAX,
+} i2c_port_t;
+
+typedef struct i2c_master_bus_t *i2c_master_bus_handle_t;
+typedef struct i2c_master_dev_t *i2c_master_dev_handle_t;
@@ -0,0 +1,7 @@
+#pragma once
+
+// Host stand-in, placement attributes mean nothing here
+
+#define IRAM_ATTR
+#define DRAM_ATTR
+#define RTC_NOINIT_ATTR
@@ -0,0 +1,5 @@
+#pragma once
+
+// Host stand-in for ESP-IDF's esp_bit_defs.h
+
+#define BIT(nr) (1UL << (nr))
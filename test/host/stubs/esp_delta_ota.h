@@ -0,0 +1,5 @@
+#pragma once
+
+// Host stand-in, handle type only
+
+typedef void *esp_delta_ota_handle_t;
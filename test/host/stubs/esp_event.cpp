@@ -0,0 +1,98 @@
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include "esp_event.h"
+#include "host_fakes.h"
+
+// Default event loop: posts copy their data into a queue, host_event_run() hands them to the handlers in order
+
+struct registration
+{
+    esp_event_base_t base;
+    int32_t id;
+    esp_event_handler_t handler;
+    void *arg;
+    uint32_t instance; // 0 for plain esp_event_handler_register()
+};
+
+struct posted_event
+{
+    esp_event_base_t base;
+    int32_t id;
+    std::vector<uint8_t> data;
+};
+
+static std::vector<registration> handlers;
+static std::vector<posted_event> queue;
+static bool loop_created = false;
+static uint32_t instance_cnt = 0;
+
+extern "C" esp_err_t esp_event_loop_create_default(void)
+{
+    if (loop_created) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    loop_created = true;
+    return ESP_OK;
+}
+
+extern "C" esp_err_t esp_event_handler_register(esp_event_base_t base, int32_t id, esp_event_handler_t handler, void *arg)
+{
+    handlers.push_back({ base, id, handler, arg, 0 });
+    return ESP_OK;
+}
+
+extern "C" esp_err_t esp_event_handler_instance_register(esp_event_base_t base, int32_t id, esp_event_handler_t handler, void *arg,
+    esp_event_handler_instance_t *instance)
+{
+    instance_cnt += 1;
+    handlers.push_back({ base, id, handler, arg, instance_cnt });
+    if (instance != nullptr) {
+        *instance = (esp_event_handler_instance_t)(uintptr_t)instance_cnt;
+    }
+
+    return ESP_OK;
+}
+
+extern "C" esp_err_t esp_event_handler_instance_unregister(esp_event_base_t base, int32_t id, esp_event_handler_instance_t instance)
+{
+    for (auto it = handlers.begin(); it != handlers.end(); it++) {
+        if (it->base == base && it->id == id && it->instance != 0 && it->instance == (uint32_t)(uintptr_t)instance) {
+            handlers.erase(it);
+            return ESP_OK;
+        }
+    }
+
+    return ESP_ERR_NOT_FOUND;
+}
+
+extern "C" esp_err_t esp_event_post(esp_event_base_t base, int32_t id, const void *data, size_t data_size, TickType_t)
+{
+    posted_event evt = { base, id, {} };
+    if (data != nullptr) {
+        evt.data.assign((const uint8_t *)data, (const uint8_t *)data + data_size);
+    }
+
+    queue.push_back(std::move(evt));
+    return ESP_OK;
+}
+
+extern "C" size_t host_event_run(void)
+{
+    size_t cnt = 0;
+    while (!queue.empty()) {
+        posted_event evt = std::move(queue.front());
+        queue.erase(queue.begin());
+        for (const auto &reg : handlers) {
+            if (reg.base == evt.base && (reg.id == ESP_EVENT_ANY_ID || reg.id == evt.id)) {
+                reg.handler(reg.arg, evt.base, evt.id, evt.data.empty() ? nullptr : evt.data.data());
+            }
+        }
+
+        cnt += 1;
+    }
+
+    return cnt;
+}
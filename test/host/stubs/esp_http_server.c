@@ -0,0 +1,547 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include "esp_http_server.h"
+#include "host_fakes.h"
+
+// Same lookup rules as httpd_query_key_value() in esp_http_server/src/httpd_parse.c: case-insensitive key, value up to
+// the next '&', copied NUL-terminated and cut to fit with ESP_ERR_HTTPD_RESULT_TRUNC
+esp_err_t httpd_query_key_value(const char *qry, const char *key, char *val, size_t val_size)
+{
+    if (qry == NULL || key == NULL || val == NULL || val_size == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    const char *pos = qry;
+    while (*pos != '\0') {
+        const char *eq = strchr(pos, '=');
+        if (eq == NULL) {
+            break;
+        }
+
+        const size_t key_len = eq - pos;
+        if (key_len != strlen(key) || strncasecmp(pos, key, key_len) != 0) {
+            pos = strchr(eq, '&');
+            if (pos == NULL) {
+                break;
+            }
+
+            pos += 1;
+            continue;
+        }
+
+        const char *start = eq + 1;
+        const char *end = strchr(start, '&');
+        if (end == NULL) {
+            end = start + strlen(start);
+        }
+
+        const size_t needed = end - start + 1;
+        const size_t copy_len = (needed < val_size ? needed : val_size) - 1;
+        memcpy(val, start, copy_len);
+        val[copy_len] = '\0';
+        return val_size < needed ? ESP_ERR_HTTPD_RESULT_TRUNC : ESP_OK;
+    }
+
+    return ESP_ERR_NOT_FOUND;
+}
+
+// Server side: a route table per httpd_start() and one request at a time, made up by host_httpd_call() from a
+// host_http_request. The handler sees the query string and header values as exact-size heap copies and the body only
+// through httpd_req_recv(), so ASan catches a read past any of them. The response is collected in RAM; sending a second
+// one, or anything after the last chunk, would put garbage on the wire and aborts.
+
+#define LIVE_CLIENT_FD 42 // One websocket client always connected, so live broadcasts get formatted and sent
+
+typedef struct {
+    httpd_uri_t *routes;
+    size_t route_cnt;
+    size_t route_max;
+    size_t resp_hdr_max;
+} host_server;
+
+typedef struct {
+    const host_http_request *in;
+    char *query;
+    char **hdr_names;
+    char **hdr_values;
+    size_t body_pos;
+    size_t content_left;
+    size_t resp_hdr_cnt;
+    bool chunked;
+    bool complete;
+} host_req_state;
+
+static host_server *running = NULL;
+static host_http_response last_resp;
+static uint8_t *resp_body = NULL;
+static size_t resp_cap = 0;
+static volatile uint8_t ws_sink = 0;
+
+static const char *const ERR_STATUS[HTTPD_ERR_CODE_MAX] = {
+    [HTTPD_500_INTERNAL_SERVER_ERROR] = "500 Internal Server Error",
+    [HTTPD_501_METHOD_NOT_IMPLEMENTED] = "501 Method Not Implemented",
+    [HTTPD_505_VERSION_NOT_SUPPORTED] = "505 Version Not Supported",
+    [HTTPD_400_BAD_REQUEST] = "400 Bad Request",
+    [HTTPD_401_UNAUTHORIZED] = "401 Unauthorized",
+    [HTTPD_403_FORBIDDEN] = "403 Forbidden",
+    [HTTPD_404_NOT_FOUND] = "404 Not Found",
+    [HTTPD_405_METHOD_NOT_ALLOWED] = "405 Method Not Allowed",
+    [HTTPD_408_REQ_TIMEOUT] = "408 Request Timeout",
+    [HTTPD_411_LENGTH_REQUIRED] = "411 Length Required",
+    [HTTPD_414_URI_TOO_LONG] = "414 URI Too Long",
+    [HTTPD_431_REQ_HDR_FIELDS_TOO_LARGE] = "431 Request Header Fields Too Large",
+};
+
+static char *copy_str(const char *str, size_t len)
+{
+    char *copy = malloc(len + 1);
+    if (copy == NULL) {
+        abort();
+    }
+
+    memcpy(copy, str, len);
+    copy[len] = '\0';
+    return copy;
+}
+
+// strlcpy(), which glibc only has from 2.38
+static void copy_trunc(char *dst, const char *src, size_t dst_size)
+{
+    if (dst_size == 0) {
+        return;
+    }
+
+    const size_t len = strnlen(src, dst_size - 1);
+    memcpy(dst, src, len);
+    dst[len] = '\0';
+}
+
+static void resp_append(const void *data, size_t len)
+{
+    if (last_resp.body_len + len > resp_cap) {
+        resp_cap = (last_resp.body_len + len) * 2;
+        resp_body = realloc(resp_body, resp_cap);
+        if (resp_body == NULL) {
+            abort();
+        }
+    }
+
+    if (len > 0) {
+        memcpy(resp_body + last_resp.body_len, data, len);
+    }
+
+    last_resp.body_len += len;
+    last_resp.body = resp_body;
+}
+
+static host_req_state *req_state(httpd_req_t *r)
+{
+    if (r == NULL || r->aux == NULL) {
+        abort();
+    }
+
+    return r->aux;
+}
+
+const char *http_method_str(enum http_method m)
+{
+    switch (m) {
+        case HTTP_DELETE: {
+            return "DELETE";
+        }
+        case HTTP_GET: {
+            return "GET";
+        }
+        case HTTP_HEAD: {
+            return "HEAD";
+        }
+        case HTTP_POST: {
+            return "POST";
+        }
+        case HTTP_PUT: {
+            return "PUT";
+        }
+    }
+
+    return "<unknown>";
+}
+
+esp_err_t httpd_start(httpd_handle_t *handle, const httpd_config_t *config)
+{
+    if (handle == NULL || config == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    host_server *server = calloc(1, sizeof(host_server));
+    server->routes = calloc(config->max_uri_handlers, sizeof(httpd_uri_t));
+    server->route_max = config->max_uri_handlers;
+    server->resp_hdr_max = config->max_resp_headers;
+    running = server;
+    *handle = server;
+    return ESP_OK;
+}
+
+esp_err_t httpd_stop(httpd_handle_t handle)
+{
+    host_server *server = handle;
+    if (server == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    if (running == server) {
+        running = NULL;
+    }
+
+    free(server->routes);
+    free(server);
+    return ESP_OK;
+}
+
+esp_err_t httpd_register_uri_handler(httpd_handle_t handle, const httpd_uri_t *uri_handler)
+{
+    host_server *server = handle;
+    if (server == NULL || uri_handler == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    for (size_t idx = 0; idx < server->route_cnt; idx += 1) {
+        if (server->routes[idx].method == uri_handler->method && strcmp(server->routes[idx].uri, uri_handler->uri) == 0) {
+            return ESP_ERR_HTTPD_HANDLER_EXISTS;
+        }
+    }
+
+    if (server->route_cnt >= server->route_max) {
+        return ESP_ERR_HTTPD_HANDLERS_FULL;
+    }
+
+    server->routes[server->route_cnt] = *uri_handler;
+    server->route_cnt += 1;
+    return ESP_OK;
+}
+
+// The caller is taken to be the httpd task already, so the work runs straight away
+esp_err_t httpd_queue_work(httpd_handle_t handle, httpd_work_fn_t work, void *arg)
+{
+    if (handle == NULL || work == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    work(arg);
+    return ESP_OK;
+}
+
+esp_err_t httpd_get_client_list(httpd_handle_t handle, size_t *fds, int *client_fds)
+{
+    if (handle == NULL || fds == NULL || client_fds == NULL || *fds < 1) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    client_fds[0] = LIVE_CLIENT_FD;
+    *fds = 1;
+    return ESP_OK;
+}
+
+// Like httpd_req_recv(): never past content_len, 0 once it is all in or the client closed
+int httpd_req_recv(httpd_req_t *r, char *buf, size_t buf_len)
+{
+    host_req_state *state = req_state(r);
+    if (buf_len > state->content_left) {
+        buf_len = state->content_left;
+    }
+
+    if (buf_len == 0) {
+        return 0;
+    }
+
+    const host_http_request *in = state->in;
+    const size_t available = in->body_len - state->body_pos;
+    if (available == 0) {
+        return in->recv_timeout ? HTTPD_SOCK_ERR_TIMEOUT : 0;
+    }
+
+    size_t len = buf_len < available ? buf_len : available;
+    if (in->recv_max > 0 && len > in->recv_max) {
+        len = in->recv_max;
+    }
+
+    memcpy(buf, in->body + state->body_pos, len);
+    state->body_pos += len;
+    state->content_left -= len;
+    return (int)len;
+}
+
+size_t httpd_req_get_url_query_len(httpd_req_t *r)
+{
+    const host_req_state *state = req_state(r);
+    return state->query == NULL ? 0 : strlen(state->query);
+}
+
+esp_err_t httpd_req_get_url_query_str(httpd_req_t *r, char *buf, size_t buf_len)
+{
+    const host_req_state *state = req_state(r);
+    if (buf == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    } else if (state->query == NULL) {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    const size_t min_buf_len = strlen(state->query) + 1;
+    copy_trunc(buf, state->query, buf_len < min_buf_len ? buf_len : min_buf_len);
+    return buf_len < min_buf_len ? ESP_ERR_HTTPD_RESULT_TRUNC : ESP_OK;
+}
+
+// Names match case-insensitively and the value starts after any spaces, as in httpd_parse.c
+static const char *find_hdr(const host_req_state *state, const char *field)
+{
+    for (size_t idx = 0; idx < state->in->header_cnt; idx += 1) {
+        if (strcasecmp(state->hdr_names[idx], field) == 0) {
+            const char *val = state->hdr_values[idx];
+            while (*val == ' ') {
+                val += 1;
+            }
+
+            return val;
+        }
+    }
+
+    return NULL;
+}
+
+size_t httpd_req_get_hdr_value_len(httpd_req_t *r, const char *field)
+{
+    const char *val = find_hdr(req_state(r), field);
+    return val == NULL ? 0 : strlen(val);
+}
+
+esp_err_t httpd_req_get_hdr_value_str(httpd_req_t *r, const char *field, char *val, size_t val_size)
+{
+    if (field == NULL || val == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    const char *found = find_hdr(req_state(r), field);
+    if (found == NULL) {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    copy_trunc(val, found, val_size);
+    return val_size < strlen(found) + 1 ? ESP_ERR_HTTPD_RESULT_TRUNC : ESP_OK;
+}
+
+esp_err_t httpd_resp_set_status(httpd_req_t *r, const char *status)
+{
+    req_state(r);
+    copy_trunc(last_resp.status, status, sizeof(last_resp.status));
+    return ESP_OK;
+}
+
+esp_err_t httpd_resp_set_type(httpd_req_t *r, const char *type)
+{
+    req_state(r);
+    copy_trunc(last_resp.type, type, sizeof(last_resp.type));
+    return ESP_OK;
+}
+
+esp_err_t httpd_resp_set_hdr(httpd_req_t *r, const char *field, const char *value)
+{
+    host_req_state *state = req_state(r);
+    if (field == NULL || value == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    } else if (state->resp_hdr_cnt >= running->resp_hdr_max) {
+        return ESP_ERR_HTTPD_RESP_HDR;
+    }
+
+    state->resp_hdr_cnt += 1;
+    return ESP_OK;
+}
+
+esp_err_t httpd_resp_send(httpd_req_t *r, const char *buf, ssize_t buf_len)
+{
+    host_req_state *state = req_state(r);
+    if (state->complete || state->chunked) {
+        abort();
+    }
+
+    if (buf_len == HTTPD_RESP_USE_STRLEN) {
+        buf_len = buf == NULL ? 0 : (ssize_t)strlen(buf);
+    }
+
+    resp_append(buf, buf_len);
+    state->complete = true;
+    return ESP_OK;
+}
+
+esp_err_t httpd_resp_send_chunk(httpd_req_t *r, const char *buf, ssize_t buf_len)
+{
+    host_req_state *state = req_state(r);
+    if (state->complete) {
+        abort();
+    }
+
+    if (buf_len == HTTPD_RESP_USE_STRLEN) {
+        buf_len = buf == NULL ? 0 : (ssize_t)strlen(buf);
+    } else if (buf == NULL && buf_len > 0) {
+        abort();
+    }
+
+    state->chunked = true;
+    if (buf_len == 0) {
+        state->complete = true;
+        return ESP_OK;
+    }
+
+    resp_append(buf, buf_len);
+    return ESP_OK;
+}
+
+esp_err_t httpd_resp_sendstr(httpd_req_t *r, const char *str)
+{
+    return httpd_resp_send(r, str, str == NULL ? 0 : HTTPD_RESP_USE_STRLEN);
+}
+
+esp_err_t httpd_resp_send_custom_err(httpd_req_t *req, const char *status, const char *msg)
+{
+    httpd_resp_set_status(req, status);
+    httpd_resp_set_type(req, HTTPD_TYPE_TEXT);
+    return httpd_resp_send(req, msg, HTTPD_RESP_USE_STRLEN);
+}
+
+esp_err_t httpd_resp_send_err(httpd_req_t *req, httpd_err_code_t error, const char *msg)
+{
+    if ((unsigned)error >= HTTPD_ERR_CODE_MAX) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    return httpd_resp_send_custom_err(req, ERR_STATUS[error], msg == NULL ? ERR_STATUS[error] : msg);
+}
+
+esp_err_t httpd_resp_send_408(httpd_req_t *r)
+{
+    return httpd_resp_send_err(r, HTTPD_408_REQ_TIMEOUT, NULL);
+}
+
+esp_err_t httpd_ws_send_frame(httpd_req_t *req, httpd_ws_frame_t *pkt)
+{
+    host_req_state *state = req_state(req);
+    if (pkt == NULL || (pkt->payload == NULL && pkt->len > 0)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    resp_append(pkt->payload, pkt->len);
+    state->complete = true;
+    return ESP_OK;
+}
+
+// Same two step use as httpd_ws.c: max_len 0 with frame len 0 only fills in the length, then a read of that many bytes
+esp_err_t httpd_ws_recv_frame(httpd_req_t *req, httpd_ws_frame_t *pkt, size_t max_len)
+{
+    host_req_state *state = req_state(req);
+    if (pkt == NULL || !state->in->ws_frame) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    if (pkt->len == 0) {
+        pkt->type = HTTPD_WS_TYPE_TEXT;
+        pkt->final = true;
+        pkt->len = state->in->body_len;
+    }
+
+    if (max_len == 0) {
+        return ESP_OK; // Only the frame header
+    } else if (pkt->len > max_len) {
+        return ESP_ERR_INVALID_SIZE;
+    } else if (pkt->len > state->in->body_len - state->body_pos) {
+        return ESP_FAIL;
+    } else if (pkt->len == 0) {
+        return ESP_OK;
+    } else if (pkt->payload == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    memcpy(pkt->payload, state->in->body + state->body_pos, pkt->len);
+    state->body_pos += pkt->len;
+    return ESP_OK;
+}
+
+esp_err_t httpd_ws_send_frame_async(httpd_handle_t hd, int fd, httpd_ws_frame_t *frame)
+{
+    if (hd == NULL || fd != LIVE_CLIENT_FD || frame == NULL || (frame->payload == NULL && frame->len > 0)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    // Touch every byte, the frame goes out of a buffer the caller frees right after
+    for (size_t idx = 0; idx < frame->len; idx += 1) {
+        ws_sink ^= frame->payload[idx];
+    }
+
+    return ESP_OK;
+}
+
+httpd_ws_client_info_t httpd_ws_get_fd_info(httpd_handle_t hd, int fd)
+{
+    return hd != NULL && fd == LIVE_CLIENT_FD ? HTTPD_WS_CLIENT_WEBSOCKET : HTTPD_WS_CLIENT_INVALID;
+}
+
+size_t host_httpd_route_count(void)
+{
+    return running == NULL ? 0 : running->route_cnt;
+}
+
+const httpd_uri_t *host_httpd_route(size_t idx)
+{
+    return running == NULL || idx >= running->route_cnt ? NULL : &running->routes[idx];
+}
+
+esp_err_t host_httpd_call(const httpd_uri_t *route, const host_http_request *request, const host_http_response **response)
+{
+    if (running == NULL || route == NULL || request == NULL) {
+        abort();
+    }
+
+    host_req_state state = { .in = request, .content_left = request->content_len };
+    if (request->query != NULL) {
+        state.query = copy_str(request->query, strlen(request->query));
+    }
+
+    state.hdr_names = calloc(request->header_cnt + 1, sizeof(char *));
+    state.hdr_values = calloc(request->header_cnt + 1, sizeof(char *));
+    for (size_t idx = 0; idx < request->header_cnt; idx += 1) {
+        state.hdr_names[idx] = copy_str(request->headers[idx].name, strlen(request->headers[idx].name));
+        state.hdr_values[idx] = copy_str(request->headers[idx].value, strlen(request->headers[idx].value));
+    }
+
+    httpd_req_t *req = calloc(1, sizeof(httpd_req_t));
+    req->handle = running;
+    req->method = request->ws_frame ? -1 : (int)route->method; // Frames after the handshake aren't a GET
+    req->content_len = request->content_len;
+    req->aux = &state;
+    req->user_ctx = route->user_ctx;
+    snprintf((char *)req->uri, sizeof(req->uri), "%s%s%s", route->uri, state.query != NULL ? "?" : "",
+        state.query != NULL ? state.query : "");
+
+    memset(&last_resp, 0, sizeof(last_resp));
+    strcpy(last_resp.status, HTTPD_200);
+    strcpy(last_resp.type, HTTPD_TYPE_TEXT);
+    last_resp.body = resp_body;
+
+    const esp_err_t ret = route->handler(req);
+    last_resp.complete = state.complete;
+
+    free(req);
+    for (size_t idx = 0; idx < request->header_cnt; idx += 1) {
+        free(state.hdr_names[idx]);
+        free(state.hdr_values[idx]);
+    }
+
+    free(state.hdr_names);
+    free(state.hdr_values);
+    free(state.query);
+    if (response != NULL) {
+        *response = &last_resp;
+    }
+
+    return ret;
+}
@@ -0,0 +1,20 @@
+#pragma once
+
+// Host stand-in for ESP-IDF logging, printed to stderr when HOST_LOG is set in the environment.
+// No format checking: the device's size_t and uint32_t are other types than the host's.
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void host_log(char level, const char *tag, const char *fmt, ...);
+
+#ifdef __cplusplus
+}
+#endif
+
+#define ESP_LOGE(tag, fmt, ...) host_log('E', tag, fmt, ##__VA_ARGS__)
+#define ESP_LOGW(tag, fmt, ...) host_log('W', tag, fmt, ##__VA_ARGS__)
+#define ESP_LOGI(tag, fmt, ...) host_log('I', tag, fmt, ##__VA_ARGS__)
+#define ESP_LOGD(tag, fmt, ...) host_log('D', tag, fmt, ##__VA_ARGS__)
+#define ESP_LOGV(tag, fmt, ...) host_log('V', tag, fmt, ##__VA_ARGS__)
@@ -0,0 +1,10 @@
+#pragma once
+
+// Host stand-in, the handle type ota_manager.hpp declares with. esp_system.h is here for config_server.cpp, which
+// calls esp_restart() without including it and gets it through the IDF headers on the device.
+
+#include <stdint.h>
+#include "esp_partition.h"
+#include "esp_system.h"
+
+typedef uint32_t esp_ota_handle_t;
@@ -0,0 +1,96 @@
+#include <cstdlib>
+#include <cstring>
+#include <list>
+#include <vector>
+
+#include "esp_partition.h"
+#include "host_fakes.h"
+
+struct ram_partition
+{
+    esp_partition_t part;
+    std::vector<uint8_t> data;
+};
+
+// A list so the esp_partition_t pointers handed out stay put
+static std::list<ram_partition> partitions;
+
+static ram_partition *find(const esp_partition_t *part)
+{
+    for (auto &item : partitions) {
+        if (&item.part == part) {
+            return &item;
+        }
+    }
+
+    abort();
+}
+
+static bool in_range(const esp_partition_t *part, size_t offset, size_t size)
+{
+    return offset <= part->size && size <= part->size - offset;
+}
+
+extern "C" const esp_partition_t *host_partition_create(const char *label, size_t size)
+{
+    for (auto &item : partitions) {
+        if (strcmp(item.part.label, label) == 0) {
+            item.data.assign(item.data.size(), 0xff);
+            return &item.part;
+        }
+    }
+
+    ram_partition item = {};
+    item.part.type = ESP_PARTITION_TYPE_DATA;
+    item.part.size = (uint32_t)size;
+    item.part.erase_size = 4096;
+    strncpy(item.part.label, label, sizeof(item.part.label) - 1);
+    item.data.assign(size, 0xff);
+    partitions.push_back(std::move(item));
+    return &partitions.back().part;
+}
+
+extern "C" const esp_partition_t *esp_partition_find_first(esp_partition_type_t type, esp_partition_subtype_t, const char *label)
+{
+    for (auto &item : partitions) {
+        if (item.part.type == type && (label == nullptr || strcmp(item.part.label, label) == 0)) {
+            return &item.part;
+        }
+    }
+
+    return nullptr;
+}
+
+extern "C" esp_err_t esp_partition_read(const esp_partition_t *part, size_t offset, void *dst, size_t size)
+{
+    if (!in_range(part, offset, size)) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    memcpy(dst, find(part)->data.data() + offset, size);
+    return ESP_OK;
+}
+
+extern "C" esp_err_t esp_partition_write(const esp_partition_t *part, size_t offset, const void *src, size_t size)
+{
+    if (!in_range(part, offset, size)) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    uint8_t *dst = find(part)->data.data() + offset;
+    for (size_t idx = 0; idx < size; idx += 1) {
+        dst[idx] &= ((const uint8_t *)src)[idx];
+    }
+
+    return ESP_OK;
+}
+
+extern "C" esp_err_t esp_partition_erase_range(const esp_partition_t *part, size_t offset, size_t size)
+{
+    if (!in_range(part, offset, size) || offset % part->erase_size != 0 || size % part->erase_size != 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    memset(find(part)->data.data() + offset, 0xff, size);
+    return ESP_OK;
+}
@@ -0,0 +1,15 @@
+#pragma once
+
+// Host stand-in for the ROM CRC32 (little-endian, same result as zlib's crc32())
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+uint32_t esp_rom_crc32_le(uint32_t crc, const uint8_t *buf, uint32_t len);
+
+#ifdef __cplusplus
+}
+#endif
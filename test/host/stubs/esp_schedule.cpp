@@ -0,0 +1,96 @@
+#include "esp_schedule.h"
+
+// Schedules that keep their config and never fire. The next trigger is a fixed day plus the time of day (or the solar
+// offset from noon), enough for the API to report one without a clock.
+
+static constexpr time_t BASE_DAY_UTC = 1767225600; // 2026-01-01
+
+struct host_schedule
+{
+    esp_schedule_config_t config;
+    bool enabled;
+};
+
+static void update_next(esp_schedule_config_t &config)
+{
+    auto &trigger = config.trigger;
+    if (trigger.type == ESP_SCHEDULE_TYPE_DAYS_OF_WEEK) {
+        trigger.next_scheduled_time_utc = BASE_DAY_UTC + trigger.hours * 3600 + trigger.minutes * 60;
+    } else if (trigger.type == ESP_SCHEDULE_TYPE_SUNRISE || trigger.type == ESP_SCHEDULE_TYPE_SUNSET) {
+        trigger.next_scheduled_time_utc = BASE_DAY_UTC + 12 * 3600 + trigger.solar.offset_minutes * 60;
+    } else {
+        trigger.next_scheduled_time_utc = 0;
+    }
+}
+
+extern "C" esp_schedule_handle_t *esp_schedule_init(bool, char *, uint8_t *schedule_count)
+{
+    if (schedule_count != nullptr) {
+        *schedule_count = 0;
+    }
+
+    return nullptr;
+}
+
+extern "C" esp_schedule_handle_t esp_schedule_create(esp_schedule_config_t *schedule_config)
+{
+    if (schedule_config == nullptr) {
+        return nullptr;
+    }
+
+    auto *schedule = new host_schedule { *schedule_config, false };
+    update_next(schedule->config);
+    return schedule;
+}
+
+extern "C" esp_err_t esp_schedule_edit(esp_schedule_handle_t handle, esp_schedule_config_t *schedule_config)
+{
+    if (handle == nullptr || schedule_config == nullptr) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    auto *schedule = (host_schedule *)handle;
+    schedule->config = *schedule_config;
+    update_next(schedule->config);
+    return ESP_OK;
+}
+
+extern "C" esp_err_t esp_schedule_delete(esp_schedule_handle_t handle)
+{
+    if (handle == nullptr) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    delete (host_schedule *)handle;
+    return ESP_OK;
+}
+
+extern "C" esp_err_t esp_schedule_get(esp_schedule_handle_t handle, esp_schedule_config_t *schedule_config)
+{
+    if (handle == nullptr || schedule_config == nullptr) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    *schedule_config = ((host_schedule *)handle)->config;
+    return ESP_OK;
+}
+
+extern "C" esp_err_t esp_schedule_enable(esp_schedule_handle_t handle)
+{
+    if (handle == nullptr) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    ((host_schedule *)handle)->enabled = true;
+    return ESP_OK;
+}
+
+extern "C" esp_err_t esp_schedule_disable(esp_schedule_handle_t handle)
+{
+    if (handle == nullptr) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    ((host_schedule *)handle)->enabled = false;
+    return ESP_OK;
+}
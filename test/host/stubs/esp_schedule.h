@@ -0,0 +1,67 @@
+#pragma once
+
+// Host stand-in for the esp_schedule component, enum values match the real one since they end up in NVS blobs and JSON.
+// Only the config fields sched_manager fills in; esp_schedule.cpp keeps each config and never fires.
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+#include "esp_err.h"
+
+#define MAX_SCHEDULE_NAME_LEN 16
+
+typedef enum esp_schedule_type {
+    ESP_SCHEDULE_TYPE_INVALID = 0,
+    ESP_SCHEDULE_TYPE_DAYS_OF_WEEK,
+    ESP_SCHEDULE_TYPE_DATE,
+    ESP_SCHEDULE_TYPE_RELATIVE,
+    ESP_SCHEDULE_TYPE_SUNRISE,
+    ESP_SCHEDULE_TYPE_SUNSET,
+} esp_schedule_type_t;
+
+typedef void *esp_schedule_handle_t;
+typedef void (*esp_schedule_trigger_cb_t)(esp_schedule_handle_t handle, void *priv_data);
+typedef void (*esp_schedule_timestamp_cb_t)(esp_schedule_handle_t handle, uint32_t next_timestamp, void *priv_data);
+
+typedef struct esp_schedule_trigger {
+    esp_schedule_type_t type;
+    uint8_t hours;
+    uint8_t minutes;
+    struct {
+        uint8_t repeat_days;
+    } day;
+    struct {
+        int offset_minutes;
+    } solar;
+    time_t next_scheduled_time_utc;
+} esp_schedule_trigger_t;
+
+typedef struct esp_schedule_validity {
+    time_t start_time;
+    time_t end_time;
+} esp_schedule_validity_t;
+
+typedef struct esp_schedule_config {
+    char name[MAX_SCHEDULE_NAME_LEN + 1];
+    esp_schedule_trigger_t trigger;
+    esp_schedule_trigger_cb_t trigger_cb;
+    esp_schedule_timestamp_cb_t timestamp_cb;
+    void *priv_data;
+    esp_schedule_validity_t validity;
+} esp_schedule_config_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+esp_schedule_handle_t *esp_schedule_init(bool enable_nvs, char *nvs_partition, uint8_t *schedule_count);
+esp_schedule_handle_t esp_schedule_create(esp_schedule_config_t *schedule_config);
+esp_err_t esp_schedule_edit(esp_schedule_handle_t handle, esp_schedule_config_t *schedule_config);
+esp_err_t esp_schedule_delete(esp_schedule_handle_t handle);
+esp_err_t esp_schedule_get(esp_schedule_handle_t handle, esp_schedule_config_t *schedule_config);
+esp_err_t esp_schedule_enable(esp_schedule_handle_t handle);
+esp_err_t esp_schedule_disable(esp_schedule_handle_t handle);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,75 @@
+#include <cstring>
+#include <sys/time.h>
+
+#include "esp_app_desc.h"
+#include "esp_heap_caps.h"
+#include "esp_rom_crc.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+
+// Chip level bits with fixed or counted results, so runs repeat exactly
+
+static int64_t now_us = 0;
+
+static constexpr esp_app_desc_t APP_DESC = {
+    .magic_word = 0xabcd5432,
+    .secure_version = 0,
+    .reserv1 = {},
+    .version = "host",
+    .project_name = "misty",
+    .time = "00:00:00",
+    .date = "Jan  1 2026",
+    .idf_ver = "v5.5-host",
+    .app_elf_sha256 = {},
+    .reserv2 = {},
+};
+
+// Every read moves the clock on by a millisecond, enough for elapsed times to be non-zero
+extern "C" int64_t esp_timer_get_time(void)
+{
+    now_us += 1000;
+    return now_us;
+}
+
+extern "C" void esp_restart(void)
+{
+}
+
+extern "C" size_t heap_caps_get_free_size(uint32_t)
+{
+    return 200 * 1024;
+}
+
+extern "C" size_t heap_caps_get_minimum_free_size(uint32_t)
+{
+    return 150 * 1024;
+}
+
+extern "C" size_t heap_caps_get_largest_free_block(uint32_t)
+{
+    return 100 * 1024;
+}
+
+extern "C" const esp_app_desc_t *esp_app_get_description(void)
+{
+    return &APP_DESC;
+}
+
+extern "C" uint32_t esp_rom_crc32_le(uint32_t crc, const uint8_t *buf, uint32_t len)
+{
+    crc = ~crc;
+    for (uint32_t idx = 0; idx < len; idx += 1) {
+        crc ^= buf[idx];
+        for (int bit = 0; bit < 8; bit += 1) {
+            crc = (crc >> 1) ^ (0xedb88320 & (0 - (crc & 1)));
+        }
+    }
+
+    return ~crc;
+}
+
+// Takes the place of libc's, a handler setting the device clock must not set the host's
+extern "C" int settimeofday(const struct timeval *tv, const struct timezone *) noexcept
+{
+    return tv == nullptr ? -1 : 0;
+}
@@ -0,0 +1,13 @@
+#pragma once
+
+// Host stand-in: esp_restart() returns, so a handler carries on past it the way its return path reads
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void esp_restart(void);
+
+#ifdef __cplusplus
+}
+#endif
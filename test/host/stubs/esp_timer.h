@@ -0,0 +1,15 @@
+#pragma once
+
+// Host stand-in: a clock that only moves when read (see esp_system.cpp)
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int64_t esp_timer_get_time(void);
+
+#ifdef __cplusplus
+}
+#endif
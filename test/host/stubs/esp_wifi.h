@@ -0,0 +1,5 @@
+#pragma once
+
+// Host stand-in, types only
+
+#include "esp_wifi_types_generic.h"
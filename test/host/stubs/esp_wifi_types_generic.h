@@ -0,0 +1,20 @@
+#pragma once
+
+// Host stand-in, the config union with the field sizes of the device build
+
+#include <stdint.h>
+
+typedef struct {
+    uint8_t ssid[32];
+    uint8_t password[64];
+} wifi_ap_config_t;
+
+typedef struct {
+    uint8_t ssid[32];
+    uint8_t password[64];
+} wifi_sta_config_t;
+
+typedef union {
+    wifi_ap_config_t ap;
+    wifi_sta_config_t sta;
+} wifi_config_t;
@@ -0,0 +1,190 @@
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <list>
+#include <vector>
+
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include "freertos/timers.h"
+#include "host_fakes.h"
+
+// Mutexes, queues, tasks and software timers for single threaded host tests
+
+struct QueueDefinition
+{
+    int held; // Mutexes only
+    size_t length;
+    size_t item_size;
+    std::deque<std::vector<uint8_t>> items;
+};
+
+struct tmrTimerControl
+{
+    TickType_t period;
+    bool auto_reload;
+    bool active;
+    void *id;
+    TimerCallbackFunction_t cb;
+};
+
+static TickType_t tick_count = 0;
+
+// Never deleted, the device code creates these once at init
+static std::list<QueueDefinition> mutexes;
+static std::list<QueueDefinition> queues;
+static std::list<tmrTimerControl> timers;
+
+extern "C" SemaphoreHandle_t xSemaphoreCreateMutex(void)
+{
+    return &mutexes.emplace_back();
+}
+
+extern "C" BaseType_t xSemaphoreTake(SemaphoreHandle_t sem, TickType_t)
+{
+    if (sem->held > 0) {
+        abort(); // Would deadlock on the device
+    }
+
+    sem->held += 1;
+    return pdTRUE;
+}
+
+extern "C" BaseType_t xSemaphoreGive(SemaphoreHandle_t sem)
+{
+    if (sem->held == 0) {
+        abort();
+    }
+
+    sem->held -= 1;
+    return pdTRUE;
+}
+
+extern "C" QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size)
+{
+    return &queues.emplace_back(QueueDefinition { 0, length, item_size, {} });
+}
+
+extern "C" BaseType_t xQueueSend(QueueHandle_t queue, const void *item, TickType_t wait)
+{
+    if (queue->items.size() >= queue->length) {
+        if (wait == portMAX_DELAY) {
+            abort(); // Nothing else runs to make room
+        }
+
+        return pdFAIL;
+    }
+
+    queue->items.emplace_back((const uint8_t *)item, (const uint8_t *)item + queue->item_size);
+    return pdPASS;
+}
+
+extern "C" BaseType_t xQueueReceive(QueueHandle_t queue, void *item, TickType_t)
+{
+    if (queue->items.empty()) {
+        return pdFALSE;
+    }
+
+    memcpy(item, queue->items.front().data(), queue->item_size);
+    queue->items.pop_front();
+    return pdTRUE;
+}
+
+extern "C" BaseType_t xQueueReset(QueueHandle_t queue)
+{
+    queue->items.clear();
+    return pdPASS;
+}
+
+extern "C" BaseType_t xTaskCreate(TaskFunction_t, const char *, uint32_t, void *, UBaseType_t, TaskHandle_t *created)
+{
+    if (created != nullptr) {
+        *created = nullptr;
+    }
+
+    return pdPASS;
+}
+
+extern "C" void vTaskDelay(TickType_t)
+{
+}
+
+extern "C" UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t)
+{
+    return 0;
+}
+
+extern "C" void host_critical_enter(portMUX_TYPE *mux)
+{
+    mux->nest += 1;
+}
+
+extern "C" void host_critical_exit(portMUX_TYPE *mux)
+{
+    if (mux->nest == 0) {
+        abort();
+    }
+
+    mux->nest -= 1;
+}
+
+extern "C" TimerHandle_t xTimerCreate(const char *, TickType_t period, UBaseType_t auto_reload, void *id, TimerCallbackFunction_t cb)
+{
+    return &timers.emplace_back(tmrTimerControl { period, auto_reload != 0, false, id, cb });
+}
+
+extern "C" BaseType_t xTimerStart(TimerHandle_t timer, TickType_t)
+{
+    timer->active = true;
+    return pdPASS;
+}
+
+extern "C" BaseType_t xTimerStop(TimerHandle_t timer, TickType_t)
+{
+    timer->active = false;
+    return pdPASS;
+}
+
+extern "C" BaseType_t xTimerReset(TimerHandle_t timer, TickType_t)
+{
+    timer->active = true;
+    return pdPASS;
+}
+
+extern "C" BaseType_t xTimerChangePeriod(TimerHandle_t timer, TickType_t period, TickType_t)
+{
+    if (period == 0) {
+        abort(); // configASSERT on the device
+    }
+
+    timer->period = period;
+    timer->active = true;
+    return pdPASS;
+}
+
+extern "C" BaseType_t xTimerIsTimerActive(TimerHandle_t timer)
+{
+    return timer->active ? pdTRUE : pdFALSE;
+}
+
+extern "C" void *pvTimerGetTimerID(TimerHandle_t timer)
+{
+    return timer->id;
+}
+
+extern "C" TickType_t xTimerGetExpiryTime(TimerHandle_t timer)
+{
+    return tick_count + timer->period;
+}
+
+extern "C" TickType_t xTaskGetTickCount(void)
+{
+    return tick_count;
+}
+
+extern "C" void host_timer_fire(TimerHandle_t timer)
+{
+    timer->active = timer->auto_reload;
+    timer->cb(timer);
+}
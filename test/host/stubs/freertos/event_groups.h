@@ -0,0 +1,8 @@
+#pragma once
+
+// Host stand-in, handle type only
+
+#include "FreeRTOS.h"
+
+typedef struct EventGroupDef_t *EventGroupHandle_t;
+typedef TickType_t EventBits_t;
@@ -0,0 +1,52 @@
+#pragma once
+
+// Test hooks into the host stand-ins, not part of any ESP-IDF API
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "esp_http_server.h"
+#include "esp_partition.h"
+#include "freertos/timers.h"
+
+typedef struct {
+    const char *name;
+    const char *value;
+} host_http_header;
+
+typedef struct {
+    const char *query; // NULL for a URI without '?'
+    const host_http_header *headers;
+    size_t header_cnt;
+    const uint8_t *body;
+    size_t body_len;
+    size_t content_len; // More than body_len for a client that stops sending part way
+    size_t recv_max; // Most bytes one httpd_req_recv() hands out, 0 for as many as asked for
+    bool recv_timeout; // Past the end of body: HTTPD_SOCK_ERR_TIMEOUT, otherwise the client closed
+    bool ws_frame; // The body is a websocket data frame, not an HTTP request
+} host_http_request;
+
+typedef struct {
+    char status[48];
+    char type[48];
+    const uint8_t *body; // Valid until the next host_httpd_call()
+    size_t body_len;
+    bool complete; // Sent whole, as a last chunk or a websocket frame
+} host_http_response;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Adds an erased RAM partition, or erases it again if one with that label exists
+const esp_partition_t *host_partition_create(const char *label, size_t size);
+void host_timer_fire(TimerHandle_t timer);
+size_t host_event_run(void); // Delivers queued events, returns how many
+
+// Routes registered with the latest httpd_start(), and a request through one of them
+size_t host_httpd_route_count(void);
+const httpd_uri_t *host_httpd_route(size_t idx);
+esp_err_t host_httpd_call(const httpd_uri_t *route, const host_http_request *request, const host_http_response **response);
+
+#ifdef __cplusplus
+}
+#endif
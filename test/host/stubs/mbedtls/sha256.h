@@ -0,0 +1,12 @@
+#pragma once
+
+// Host stand-in, context type only
+
+#include <stdint.h>
+
+typedef struct {
+    uint32_t total[2];
+    uint32_t state[8];
+    unsigned char buffer[64];
+    int is224;
+} mbedtls_sha256_context;
@@ -0,0 +1,15 @@
+#include "newlib_compat.h"
+
+#ifdef HOST_NEEDS_STRLCPY
+size_t strlcpy(char *dst, const char *src, size_t size)
+{
+    const size_t src_len = strlen(src);
+    if (size > 0) {
+        const size_t len = src_len < size - 1 ? src_len : size - 1;
+        memcpy(dst, src, len);
+        dst[len] = '\0';
+    }
+
+    return src_len;
+}
+#endif
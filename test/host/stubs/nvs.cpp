@@ -0,0 +1,262 @@
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "nvs.h"
+
+// Non-volatile storage kept in RAM. Same return codes as the real nvs_flash for the calls the host-built sources make,
+// commits are no-ops since every write lands straight away.
+
+struct nvs_value
+{
+    nvs_type_t type;
+    std::vector<uint8_t> data;
+};
+
+using nvs_namespace = std::map<std::string, nvs_value>;
+
+struct open_handle
+{
+    std::string ns;
+    bool writable;
+    bool open;
+};
+
+struct nvs_opaque_iterator_t
+{
+    std::string ns;
+    std::vector<std::pair<std::string, nvs_type_t>> entries; // Taken when the iteration starts
+    size_t pos;
+};
+
+static std::map<std::string, nvs_namespace> namespaces;
+static std::vector<open_handle> handles; // nvs_handle_t is the index plus one
+
+static open_handle *get_handle(nvs_handle_t handle)
+{
+    if (handle == 0 || handle > handles.size() || !handles[handle - 1].open) {
+        return nullptr;
+    }
+
+    return &handles[handle - 1];
+}
+
+static esp_err_t check_key(const char *key)
+{
+    if (key == nullptr) {
+        return ESP_ERR_NVS_INVALID_NAME;
+    }
+
+    return strlen(key) > NVS_KEY_NAME_MAX_SIZE - 1 ? ESP_ERR_NVS_KEY_TOO_LONG : ESP_OK;
+}
+
+static esp_err_t set_value(nvs_handle_t handle, const char *key, nvs_type_t type, const void *data, size_t len)
+{
+    auto *open = get_handle(handle);
+    if (open == nullptr) {
+        return ESP_ERR_NVS_INVALID_HANDLE;
+    } else if (!open->writable) {
+        return ESP_ERR_NVS_READ_ONLY;
+    }
+
+    esp_err_t ret = check_key(key);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+
+    namespaces[open->ns][key] = { type, std::vector<uint8_t>((const uint8_t *)data, (const uint8_t *)data + len) };
+    return ESP_OK;
+}
+
+static esp_err_t find_value(nvs_handle_t handle, const char *key, nvs_type_t type, const nvs_value **out)
+{
+    auto *open = get_handle(handle);
+    if (open == nullptr) {
+        return ESP_ERR_NVS_INVALID_HANDLE;
+    }
+
+    esp_err_t ret = check_key(key);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+
+    const auto &ns = namespaces[open->ns];
+    const auto it = ns.find(key);
+    if (it == ns.end() || (type != NVS_TYPE_ANY && it->second.type != type)) {
+        return ESP_ERR_NVS_NOT_FOUND;
+    }
+
+    *out = &it->second;
+    return ESP_OK;
+}
+
+extern "C" esp_err_t nvs_open(const char *namespace_name, nvs_open_mode_t open_mode, nvs_handle_t *out_handle)
+{
+    if (namespace_name == nullptr || out_handle == nullptr) {
+        return ESP_ERR_INVALID_ARG;
+    } else if (strlen(namespace_name) > NVS_NS_NAME_MAX_SIZE - 1) {
+        return ESP_ERR_NVS_KEY_TOO_LONG;
+    }
+
+    handles.push_back({ namespace_name, open_mode == NVS_READWRITE, true });
+    *out_handle = handles.size();
+    return ESP_OK;
+}
+
+extern "C" void nvs_close(nvs_handle_t handle)
+{
+    if (auto *open = get_handle(handle); open != nullptr) {
+        open->open = false;
+    }
+}
+
+extern "C" esp_err_t nvs_commit(nvs_handle_t handle)
+{
+    return get_handle(handle) == nullptr ? ESP_ERR_NVS_INVALID_HANDLE : ESP_OK;
+}
+
+extern "C" esp_err_t nvs_set_u8(nvs_handle_t handle, const char *key, uint8_t value)
+{
+    return set_value(handle, key, NVS_TYPE_U8, &value, sizeof(value));
+}
+
+extern "C" esp_err_t nvs_get_u8(nvs_handle_t handle, const char *key, uint8_t *out_value)
+{
+    const nvs_value *value = nullptr;
+    esp_err_t ret = find_value(handle, key, NVS_TYPE_U8, &value);
+    if (ret == ESP_OK) {
+        *out_value = value->data[0];
+    }
+
+    return ret;
+}
+
+extern "C" esp_err_t nvs_set_blob(nvs_handle_t handle, const char *key, const void *value, size_t length)
+{
+    return set_value(handle, key, NVS_TYPE_BLOB, value, length);
+}
+
+// Like nvs_flash: a null out_value asks for the size, a short buffer gets ESP_ERR_NVS_INVALID_LENGTH and the size
+extern "C" esp_err_t nvs_get_blob(nvs_handle_t handle, const char *key, void *out_value, size_t *length)
+{
+    const nvs_value *value = nullptr;
+    esp_err_t ret = find_value(handle, key, NVS_TYPE_BLOB, &value);
+    if (ret != ESP_OK) {
+        return ret;
+    } else if (length == nullptr) {
+        return ESP_ERR_NVS_INVALID_LENGTH;
+    }
+
+    const size_t stored_len = value->data.size();
+    if (out_value != nullptr && *length < stored_len) {
+        *length = stored_len;
+        return ESP_ERR_NVS_INVALID_LENGTH;
+    }
+
+    *length = stored_len;
+    if (out_value != nullptr) {
+        memcpy(out_value, value->data.data(), stored_len);
+    }
+
+    return ESP_OK;
+}
+
+extern "C" esp_err_t nvs_find_key(nvs_handle_t handle, const char *key, nvs_type_t *out_type)
+{
+    const nvs_value *value = nullptr;
+    esp_err_t ret = find_value(handle, key, NVS_TYPE_ANY, &value);
+    if (ret == ESP_OK && out_type != nullptr) {
+        *out_type = value->type;
+    }
+
+    return ret;
+}
+
+extern "C" esp_err_t nvs_erase_key(nvs_handle_t handle, const char *key)
+{
+    const nvs_value *value = nullptr;
+    esp_err_t ret = find_value(handle, key, NVS_TYPE_ANY, &value);
+    if (ret != ESP_OK) {
+        return ret;
+    } else if (!get_handle(handle)->writable) {
+        return ESP_ERR_NVS_READ_ONLY;
+    }
+
+    namespaces[get_handle(handle)->ns].erase(key);
+    return ESP_OK;
+}
+
+extern "C" esp_err_t nvs_erase_all(nvs_handle_t handle)
+{
+    auto *open = get_handle(handle);
+    if (open == nullptr) {
+        return ESP_ERR_NVS_INVALID_HANDLE;
+    } else if (!open->writable) {
+        return ESP_ERR_NVS_READ_ONLY;
+    }
+
+    namespaces[open->ns].clear();
+    return ESP_OK;
+}
+
+// No match leaves the iterator null with ESP_ERR_NVS_NOT_FOUND, running off the end frees it the same way
+extern "C" esp_err_t nvs_entry_find_in_handle(nvs_handle_t handle, nvs_type_t type, nvs_iterator_t *output_iterator)
+{
+    auto *open = get_handle(handle);
+    if (open == nullptr || output_iterator == nullptr) {
+        return ESP_ERR_NVS_INVALID_HANDLE;
+    }
+
+    auto *it = new nvs_opaque_iterator_t { open->ns, {}, 0 };
+    for (const auto &[key, value] : namespaces[open->ns]) {
+        if (type == NVS_TYPE_ANY || value.type == type) {
+            it->entries.emplace_back(key, value.type);
+        }
+    }
+
+    if (it->entries.empty()) {
+        delete it;
+        *output_iterator = nullptr;
+        return ESP_ERR_NVS_NOT_FOUND;
+    }
+
+    *output_iterator = it;
+    return ESP_OK;
+}
+
+extern "C" esp_err_t nvs_entry_next(nvs_iterator_t *iterator)
+{
+    if (iterator == nullptr || *iterator == nullptr) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    (*iterator)->pos += 1;
+    if ((*iterator)->pos >= (*iterator)->entries.size()) {
+        delete *iterator;
+        *iterator = nullptr;
+        return ESP_ERR_NVS_NOT_FOUND;
+    }
+
+    return ESP_OK;
+}
+
+extern "C" esp_err_t nvs_entry_info(const nvs_iterator_t iterator, nvs_entry_info_t *out_info)
+{
+    if (iterator == nullptr || out_info == nullptr) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    const auto &[key, type] = iterator->entries[iterator->pos];
+    *out_info = {};
+    strncpy(out_info->namespace_name, iterator->ns.c_str(), sizeof(out_info->namespace_name) - 1);
+    strncpy(out_info->key, key.c_str(), sizeof(out_info->key) - 1);
+    out_info->type = type;
+    return ESP_OK;
+}
+
+extern "C" void nvs_release_iterator(nvs_iterator_t iterator)
+{
+    delete iterator;
+}
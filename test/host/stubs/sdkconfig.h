@@ -0,0 +1,7 @@
+#pragma once
+
+// Host stand-in, the few Kconfig values host-built sources size arrays with (device defaults)
+
+#define CONFIG_LWIP_MAX_SOCKETS 10
+#define CONFIG_HTTPD_MAX_URI_LEN 512
+#define CONFIG_HTTPD_MAX_REQ_HDR_LEN 1024
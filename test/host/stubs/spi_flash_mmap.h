@@ -0,0 +1,5 @@
+#pragma once
+
+// Host stand-in, sector size only
+
+#define SPI_FLASH_SEC_SIZE 4096
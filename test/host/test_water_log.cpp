@@ -0,0 +1,139 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include "host_fakes.h"
+#include "water_log.hpp"
+
+// water_log::read() against a RAM partition: torn slots, reads in caller sized chunks, and a log that has wrapped with
+// the head on a sector start and in the middle of one. Run under ASan so reading past the caller's buffer fails too.
+
+static constexpr size_t SECTOR_CNT = 3;
+static constexpr size_t PER_SECTOR = 4096 / sizeof(water_log::entry);
+static constexpr size_t CHUNK = 8; // GET /api/waterlog reads this many at a time
+
+static int failures = 0;
+
+#define CHECK(cond) do { if (!(cond)) { fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); failures += 1; } } while (0)
+
+static const esp_partition_t *part = nullptr;
+
+static void write_seq(size_t slot, uint32_t seq)
+{
+    auto item = water_log::make_entry(water_log::KIND_SCHEDULED, 0b01, 1000, "test");
+    item.seq = seq;
+    CHECK(esp_partition_write(part, slot * sizeof(item), &item, sizeof(item)) == ESP_OK);
+}
+
+// Body written but seq still erased, as left by a power cut between the two
+static void write_torn(size_t slot)
+{
+    auto item = water_log::make_entry(water_log::KIND_SCHEDULED, 0b01, 1000, "torn");
+    item.seq = UINT32_MAX;
+    CHECK(esp_partition_write(part, slot * sizeof(item), &item, sizeof(item)) == ESP_OK);
+}
+
+static void reset_flash()
+{
+    part = host_partition_create("waterlog", SECTOR_CNT * 4096);
+}
+
+// Everything read() returns from a fresh cursor, each chunk through its own exactly sized heap buffer
+static std::vector<uint32_t> read_all()
+{
+    std::vector<uint32_t> seqs;
+    uint32_t cursor = 0;
+    for (size_t round = 0; round < SECTOR_CNT * PER_SECTOR; round += 1) {
+        auto *buf = new water_log::entry[CHUNK];
+        const size_t cnt = water_log::instance().read(cursor, buf, CHUNK);
+        CHECK(cnt <= CHUNK);
+        for (size_t idx = 0; idx < cnt; idx += 1) {
+            seqs.push_back(buf[idx].seq);
+        }
+
+        delete[] buf;
+        if (cnt == 0) {
+            break;
+        }
+    }
+
+    return seqs;
+}
+
+static std::vector<uint32_t> seq_range(uint32_t first, uint32_t last)
+{
+    std::vector<uint32_t> seqs;
+    for (uint32_t seq = first; seq <= last; seq += 1) {
+        seqs.push_back(seq);
+    }
+
+    return seqs;
+}
+
+static void test_torn_slots()
+{
+    reset_flash();
+    for (size_t slot = 0; slot < 10; slot += 1) {
+        if (slot == 3) {
+            write_torn(slot);
+        } else {
+            write_seq(slot, slot);
+        }
+    }
+
+    CHECK(water_log::instance().init() == ESP_OK);
+    auto expected = seq_range(0, 9);
+    expected.erase(expected.begin() + 3);
+    CHECK(read_all() == expected);
+}
+
+static void test_wrap_on_sector_start()
+{
+    // Sector 0 was the oldest and has just been filled again, so the head is on sector 1's start, not yet erased
+    reset_flash();
+    for (size_t slot = 0; slot < PER_SECTOR; slot += 1) {
+        write_seq(PER_SECTOR + slot, slot);
+        write_seq(2 * PER_SECTOR + slot, PER_SECTOR + slot);
+        write_seq(slot, 2 * PER_SECTOR + slot);
+    }
+
+    CHECK(water_log::instance().init() == ESP_OK);
+    CHECK(read_all() == seq_range(0, 3 * PER_SECTOR - 1));
+
+    // The next entry erases sector 1 and takes its first slot
+    auto item = water_log::make_entry(water_log::KIND_API, 0b10, 2000);
+    CHECK(water_log::instance().append(item) == ESP_OK);
+    CHECK(water_log::instance().flush() == ESP_OK);
+    CHECK(read_all() == seq_range(PER_SECTOR, 3 * PER_SECTOR));
+}
+
+static void test_wrap_mid_sector()
+{
+    reset_flash();
+    for (size_t slot = 0; slot < PER_SECTOR; slot += 1) {
+        write_seq(2 * PER_SECTOR + slot, PER_SECTOR + slot);
+        write_seq(slot, 2 * PER_SECTOR + slot);
+    }
+
+    for (size_t slot = 0; slot < 5; slot += 1) {
+        write_seq(PER_SECTOR + slot, 3 * PER_SECTOR + slot);
+    }
+
+    CHECK(water_log::instance().init() == ESP_OK);
+    CHECK(read_all() == seq_range(PER_SECTOR, 3 * PER_SECTOR + 4));
+}
+
+int main()
+{
+    test_torn_slots();
+    test_wrap_on_sector_start();
+    test_wrap_mid_sector();
+
+    if (failures != 0) {
+        fprintf(stderr, "%d checks failed\n", failures);
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,77 @@
+#!/usr/bin/env python3
+"""Build a delta OTA image for POST /api/ota with X-OTA-Format: delta.
+
+The patch only applies on top of the exact firmware the device is running, so keep the
+.bin of every release that went out. Needs detools (pip install detools).
+
+Usage:
+    ota_delta.py old/misty-firmware.bin build/misty-firmware.bin update.patch
+    curl -X POST -H "X-OTA-Format: delta" --data-binary @update.patch http://192.168.4.1/api/ota
+"""
+
+import argparse
+import hashlib
+import io
+import struct
+import sys
+
+import detools
+
+# Must match ota_manager::delta_header
+HEADER = struct.Struct("<IB3xI32s32s")
+MAGIC = 0x544C444D
+VERSION = 1
+
+IMAGE_MAGIC = 0xE9
+HASH_APPENDED_OFFSET = 23
+
+
+def appended_digest(image, name):
+    """Return the SHA-256 esptool appends to the image, which is what the device reports for its running partition."""
+    if len(image) < HASH_APPENDED_OFFSET + 1 + 32 or image[0] != IMAGE_MAGIC:
+        raise ValueError(f"{name}: not an ESP app image")
+    if image[HASH_APPENDED_OFFSET] != 1:
+        raise ValueError(f"{name}: image has no appended SHA-256")
+
+    digest = image[-32:]
+    if hashlib.sha256(image[:-32]).digest() != digest:
+        raise ValueError(f"{name}: appended SHA-256 doesn't match, truncated or padded image?")
+    return digest
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("base", help="firmware currently running on the device")
+    parser.add_argument("target", help="new firmware")
+    parser.add_argument("out", help="patch output")
+    args = parser.parse_args()
+
+    try:
+        with open(args.base, "rb") as f:
+            base = f.read()
+        with open(args.target, "rb") as f:
+            target = f.read()
+
+        base_digest = appended_digest(base, args.base)
+        appended_digest(target, args.target)
+
+        # Sequential patches only read the source forward, so the device can stream them without seeking
+        patch = io.BytesIO()
+        detools.create_patch(io.BytesIO(base), io.BytesIO(target), patch,
+                             compression="heatshrink", patch_type="sequential")
+
+        header = HEADER.pack(MAGIC, VERSION, len(target), base_digest, hashlib.sha256(target).digest())
+        with open(args.out, "wb") as f:
+            f.write(header)
+            f.write(patch.getvalue())
+    except (OSError, ValueError) as e:
+        print(f"error: {e}", file=sys.stderr)
+        return 1
+
+    size = HEADER.size + len(patch.getvalue())
+    print(f"{args.out}: {size} bytes, {size * 100 / len(target):.1f}% of the {len(target)} byte image")
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
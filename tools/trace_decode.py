@@ -0,0 +1,154 @@
+#!/usr/bin/env python3
+"""Decode the binary event trace served by GET /api/trace (or /api/trace?src=flash).
+
+Usage:
+    trace_decode.py http://192.168.4.1/api/trace
+    trace_decode.py trace.bin
+    curl -s http://192.168.4.1/api/trace | trace_decode.py -
+"""
+
+import argparse
+import statistics
+import struct
+import sys
+import urllib.request
+
+HEADER = struct.Struct("<IBBHII")
+RECORD = struct.Struct("<IHHII")
+MAGIC = 0x4352544D
+VERSIONS = (1, 2)  # 1 left record_count reserved, so only the dump length says how many records follow
+
+PROFILES = {0: "DRY", 1: "MODERATE", 2: "WET"}
+SCHED_TYPES = {0: "invalid", 1: "dow", 2: "date", 3: "relative", 4: "sunrise", 5: "sunset"}
+
+
+def signed32(val):
+    return val - (1 << 32) if val & 0x80000000 else val
+
+
+def centi(val):
+    return f"{signed32(val) / 100:.2f}"
+
+
+def fmt_sched_parsed(a0, a1, a2):
+    pumps, dow, b2, b3 = a1 & 0xFF, (a1 >> 8) & 0xFF, (a1 >> 16) & 0xFF, (a1 >> 24) & 0xFF
+    sched_type = SCHED_TYPES.get(a0, str(a0))
+    if sched_type == "dow":
+        when = f"{b2:02d}:{b3:02d}"
+    else:
+        offset = (a1 >> 16) & 0xFFFF
+        when = f"offset={offset - 0x10000 if offset & 0x8000 else offset}min"
+    return f"type={sched_type} pumps={pumps} dow=0x{dow:02x} {when} moderate={a2}ms"
+
+
+# Keep in sync with event_trace::event_id in main/event_trace.hpp
+EVENTS = {
+    1: ("SCHED_TRIGGER", lambda a0, a1, a2: f"sched={a0} fire={a1}"),
+    2: ("SCHED_ENQUEUED", lambda a0, a1, a2: f"sched={a0} fire={a1}"),
+    3: ("DISPATCH_DEQUEUED", lambda a0, a1, a2: f"sched={a0} fire={a1}"),
+    4: ("DISPATCH_PROFILE", lambda a0, a1, a2: f"sched={a0} fire={a1} profile={PROFILES.get(a2, a2)}"),
+    5: ("PUMP_RUN_BEGIN", lambda a0, a1, a2: f"pump={a0} duration={a1}ms"),
+    6: ("PUMP_TIMER_ARMED", lambda a0, a1, a2: f"pump={a0} duration={a1}ms"),
+    7: ("PUMP_MOTOR_ON", lambda a0, a1, a2: f"pump={a0} duration={a1}ms err=0x{a2:x}"),
+    8: ("DISPATCH_DONE", lambda a0, a1, a2: f"sched={a0} fire={a1}"),
+    9: ("PUMP_MOTOR_OFF", lambda a0, a1, a2: f"pump={a0}"),
+    10: ("SENSE_SAMPLE", lambda a0, a1, a2: f"n={a0} temp={centi(a1)}C rh={centi(a2)}%"),
+    11: ("SENSE_SLOT_COMMIT", lambda a0, a1, a2: f"slot={a0} temp={centi(a1)}C rh={centi(a2)}%"),
+    12: ("SENSE_AVERAGE", lambda a0, a1, a2: f"valid={a0} temp={centi(a1)}C rh={centi(a2)}%"),
+    13: ("SCHED_PARSED", fmt_sched_parsed),
+    14: ("SCHED_SET", lambda a0, a1, a2: f"inserted={a0} err=0x{a2:x}"),
+    15: ("SCHED_LOADED", lambda a0, a1, a2: f"count={a0}"),
+    16: ("SCHED_LIST", lambda a0, a1, a2: f"bytes={a0}"),
+    17: ("PUMP_TEST_MODE", lambda a0, a1, a2: f"enabled={a0}"),
+    18: ("SENSE_RESTORED", lambda a0, a1, a2: f"valid={a0} age={a1}s missed={a2}"),
+    19: ("SCHED_REPLACED", lambda a0, a1, a2: f"count={a0} old={a1} err=0x{a2:x}"),
+    20: ("OTA_SELF_TEST", lambda a0, a1, a2: f"pending={a0} took={a1}ms err=0x{a2:x}"),
+    21: ("SCHED_REJECTED", lambda a0, a1, a2: f"on_load={a0} size={a1} err=0x{a2:x}"),
+    22: ("NET_CONNECTED", lambda a0, a1, a2: f"fast={a0 & 1} lease={(a0 >> 1) & 1} took={a1}ms retries={a2}"),
+}
+
+
+def load(src):
+    if src == "-":
+        return sys.stdin.buffer.read()
+    if src.startswith("http://") or src.startswith("https://"):
+        with urllib.request.urlopen(src, timeout=10) as resp:
+            return resp.read()
+    with open(src, "rb") as f:
+        return f.read()
+
+
+def parse(blob):
+    if len(blob) < HEADER.size:
+        raise ValueError("dump shorter than header")
+
+    magic, version, rec_size, rec_cnt, first_seq, now_us = HEADER.unpack_from(blob)
+    if magic != MAGIC:
+        raise ValueError(f"bad magic 0x{magic:08x}")
+    if version not in VERSIONS or rec_size != RECORD.size:
+        raise ValueError(f"unsupported dump version {version} / record size {rec_size}")
+
+    avail = (len(blob) - HEADER.size) // rec_size
+    count = avail if version == 1 else min(rec_cnt, avail)
+    records = [RECORD.unpack_from(blob, HEADER.size + i * rec_size) for i in range(count)]
+    return first_seq, now_us, records
+
+
+def latency_summary(records):
+    """Per fire ID: trigger -> each hop, and trigger -> last motor on before DISPATCH_DONE."""
+    fires = {}
+    current = None
+    for ts, evt, a0, a1, a2 in records:
+        if evt in (1, 2, 3, 4, 8):
+            fire = fires.setdefault(a1, {})
+            fire.setdefault(evt, ts)
+            current = a1 if evt in (3, 4) else (None if evt == 8 else current)
+        elif evt == 7 and current is not None:
+            fires[current][7] = ts
+
+    hops = {2: "enqueue", 3: "dequeue", 4: "profile", 7: "motor_on", 8: "done"}
+    results = {name: [] for name in hops.values()}
+    for fire in fires.values():
+        if 1 not in fire:
+            continue
+        for evt, name in hops.items():
+            if evt in fire:
+                results[name].append(((fire[evt] - fire[1]) & 0xFFFFFFFF))
+    return results
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("src", help="URL, file path, or - for stdin")
+    parser.add_argument("--no-summary", action="store_true", help="don't print the latency summary")
+    args = parser.parse_args()
+
+    try:
+        first_seq, now_us, records = parse(load(args.src))
+    except (OSError, ValueError) as e:
+        print(f"error: {e}", file=sys.stderr)
+        return 1
+
+    print(f"# {len(records)} records, {first_seq} dropped before, device time {now_us} us")
+    prev = None
+    for idx, (ts, evt, a0, a1, a2) in enumerate(records):
+        name, fmt = EVENTS.get(evt, (f"UNKNOWN_{evt}", lambda x, y, z: f"{x} {y} {z}"))
+        delta = 0 if prev is None else (ts - prev) & 0xFFFFFFFF
+        age = (now_us - ts) & 0xFFFFFFFF
+        print(f"{first_seq + idx:8d} -{age / 1e6:10.3f}s +{delta:9d}us {name:<18} {fmt(a0, a1, a2)}")
+        prev = ts
+
+    if not args.no_summary:
+        results = latency_summary(records)
+        print("\n# Latency from SCHED_TRIGGER (us): hop, count, min, mean, max, stdev")
+        for name, vals in results.items():
+            if not vals:
+                continue
+            stdev = statistics.pstdev(vals) if len(vals) > 1 else 0
+            print(f"{name:<10} {len(vals):5d} {min(vals):9d} {statistics.mean(vals):11.1f} {max(vals):9d} {stdev:9.1f}")
+
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
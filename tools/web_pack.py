@@ -0,0 +1,49 @@
+#!/usr/bin/env python3
+"""Minify and gzip the embedded web UI at build time.
+
+Called from main/CMakeLists.txt, the output is embedded into the firmware as-is and
+served with Content-Encoding: gzip.
+
+Usage:
+    web_pack.py main/index.html build/index.html.gz
+"""
+
+import argparse
+import gzip
+import re
+import sys
+
+
+def minify(text):
+    """Conservative minify: drop HTML comments, indentation and blank lines.
+
+    Line breaks are kept so the inline JS doesn't depend on semicolon insertion rules.
+    """
+    text = re.sub(r"<!--.*?-->", "", text, flags=re.DOTALL)
+    lines = (line.strip() for line in text.splitlines())
+    return "\n".join(line for line in lines if line) + "\n"
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("src", help="HTML source")
+    parser.add_argument("dst", help="gzipped output")
+    args = parser.parse_args()
+
+    try:
+        with open(args.src, "r", encoding="utf-8") as f:
+            raw = f.read()
+        packed = minify(raw).encode("utf-8")
+
+        # mtime=0 keeps the output byte-identical between builds, so the ETag only changes with the content
+        with open(args.dst, "wb") as f:
+            f.write(gzip.compress(packed, compresslevel=9, mtime=0))
+    except OSError as e:
+        print(f"error: {e}", file=sys.stderr)
+        return 1
+
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())